@@ -7,9 +7,12 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = ViewerSR
 TEMPLATE = app
 
-CONFIG += c++14
+CONFIG += c++14 thread
 CONFIG(release, release|debug):QMAKE_CXXFLAGS += -Wall -O2
 
+# qmake CONFIG+=avx2 enables the AVX2 paths (normalkernel.cpp)
+avx2:QMAKE_CXXFLAGS += -mavx2 -mfma
+
 CONFIG(release, release|debug):DESTDIR = release/
 CONFIG(release, release|debug):OBJECTS_DIR = release/
 CONFIG(release, release|debug):MOC_DIR = release/
@@ -32,7 +35,25 @@ SOURCES += \
     main_window.cc \
     glwidget.cc \
     camera.cc \
-    vertexclustering.cpp
+    vertexclustering.cpp \
+    lodmetrics.cpp \
+    normalkernel.cpp \
+    clusterstats.cpp \
+    lodassetmanager.cpp \
+    geometryarena.cpp \
+    frustumculler.cpp \
+    pvs.cpp \
+    occlusionculler.cpp \
+    hizculler.cpp \
+    lodselector.cpp \
+    budgetcontroller.cpp \
+    indexedheap.cpp \
+    frameprofiler.cpp \
+    instancebatcher.cpp \
+    camerapath.cpp \
+    impostor.cpp \
+    wallgeometry.cpp \
+    portals.cpp
 
 HEADERS  += \
     mapmanager.h \
@@ -41,7 +62,25 @@ HEADERS  += \
     main_window.h \
     glwidget.h \
     camera.h \
-    vertexclustering.h
+    vertexclustering.h \
+    lodmetrics.h \
+    normalkernel.h \
+    clusterstats.h \
+    lodassetmanager.h \
+    geometryarena.h \
+    frustumculler.h \
+    pvs.h \
+    occlusionculler.h \
+    hizculler.h \
+    lodselector.h \
+    budgetcontroller.h \
+    indexedheap.h \
+    frameprofiler.h \
+    instancebatcher.h \
+    camerapath.h \
+    impostor.h \
+    wallgeometry.h \
+    portals.h
 
 FORMS    += \
     main_window.ui
@@ -50,6 +89,12 @@ OTHER_FILES +=
 
 DISTFILES += \
     shaders/phong.frag \
-    shaders/phong.vert
+    shaders/phong.vert \
+    shaders/box.frag \
+    shaders/box.vert \
+    shaders/impostor.vert \
+    shaders/impostor.frag \
+    shaders/impostor_bake.vert \
+    shaders/impostor_bake.frag
 
 
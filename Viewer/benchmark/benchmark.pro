@@ -0,0 +1,67 @@
+# Headless rendering benchmark: replays a camera path in an offscreen EGL
+# context and writes the frame stats as JSON.
+#   qmake benchmark.pro && make
+#   ./release/benchmark -m ../models/teapot.ply -n 20 -p ../paths/orbit.txt
+
+TARGET = benchmark
+TEMPLATE = app
+
+CONFIG += console c++14 thread
+CONFIG -= qt app_bundle
+CONFIG(release, release|debug):QMAKE_CXXFLAGS += -Wall -O2
+
+# qmake CONFIG+=avx2 enables the AVX2 paths (normalkernel.cpp, frustumculler.cpp)
+avx2:QMAKE_CXXFLAGS += -mavx2 -mfma
+
+CONFIG(release, release|debug):DESTDIR = release/
+CONFIG(release, release|debug):OBJECTS_DIR = release/
+
+CONFIG(debug, release|debug):DESTDIR = debug/
+CONFIG(debug, release|debug):OBJECTS_DIR = debug/
+
+INCLUDEPATH += .. /usr/include/eigen3/
+
+LIBS += -lGLEW -lEGL -lGL
+
+SOURCES += \
+    main.cc \
+    ../triangle_mesh.cc \
+    ../mesh_io.cc \
+    ../vertexclustering.cpp \
+    ../lodmetrics.cpp \
+    ../normalkernel.cpp \
+    ../clusterstats.cpp \
+    ../geometryarena.cpp \
+    ../lodassetmanager.cpp \
+    ../instancebatcher.cpp \
+    ../frustumculler.cpp \
+    ../lodselector.cpp \
+    ../budgetcontroller.cpp \
+    ../frameprofiler.cpp \
+    ../mapmanager.cpp \
+    ../pvs.cpp \
+    ../camerapath.cpp \
+    ../impostor.cpp \
+    ../wallgeometry.cpp \
+    ../portals.cpp
+
+HEADERS  += \
+    ../triangle_mesh.h \
+    ../mesh_io.h \
+    ../vertexclustering.h \
+    ../lodmetrics.h \
+    ../normalkernel.h \
+    ../clusterstats.h \
+    ../geometryarena.h \
+    ../lodassetmanager.h \
+    ../instancebatcher.h \
+    ../frustumculler.h \
+    ../lodselector.h \
+    ../budgetcontroller.h \
+    ../frameprofiler.h \
+    ../mapmanager.h \
+    ../pvs.h \
+    ../camerapath.h \
+    ../impostor.h \
+    ../wallgeometry.h \
+    ../portals.h
@@ -0,0 +1,696 @@
+// Headless rendering benchmark.
+//
+// Usage: benchmark [-m model]... [-M method] [-n instances] [-d offset]
+//                  [--map map] [-p path] [-f frames] [-w width] [-h height]
+//                  [-b budget] [-i] [--pvs] [--portals] [-s shaders]
+//                  [-o output]
+//   -m       PLY model, may be repeated up to 3 times; instances cycle
+//            through them like the viewer slots (default ../models/sphere.ply)
+//   -M       Clustering method (default "Mean")
+//   -n       Instances per side of the grid drawn when the map places no
+//            models (default 10)
+//   -d       Distance between instances (default 1)
+//   --map    Map file; its model cells place the instances if it has any,
+//            and its walls are drawn
+//   -p       Camera path, text or recorded by the viewer (see camerapath.h;
+//            default an orbit)
+//   -f       Frames rendered, 1/60 s of path each (default 300)
+//   -w, -h   Framebuffer size (default 1280x720)
+//   -b       Triangle budget of the LOD selection (default 1000000)
+//   -i       Draw the instances smaller than 16 pixels as impostors
+//   --pvs    Cull the instances with the map PVS like in the viewer (loaded
+//            from <map>.pvs, or computed and saved there before the run)
+//   --portals  Cull the instances of the map rooms not seen through its
+//            portals, as the viewer's portal culling
+//   -s       Shader directory (default ../shaders)
+//   -o       JSON report (default stdout)
+//
+// Renders into an FBO of an EGL surfaceless context, so it runs without a
+// window or a GPU (e.g. Mesa llvmpipe). The path is sampled at the fixed time
+// step of the viewer replays, and the LOD selection uses a fixed budget instead
+// of the frame-time controller, so runs are comparable between machines.
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./budgetcontroller.h"
+#include "./camerapath.h"
+#include "./frameprofiler.h"
+#include "./frustumculler.h"
+#include "./impostor.h"
+#include "./instancebatcher.h"
+#include "./lodassetmanager.h"
+#include "./lodselector.h"
+#include "./mapmanager.h"
+#include "./pvs.h"
+#include "./portals.h"
+#include "./wallgeometry.h"
+
+namespace {
+
+const double kFieldOfView = 60;
+const double kZNear = 0.01;
+const double kZFar = 100;
+
+const int kMaxSlots = 3;
+const int kMaxInstanceLod = 5;
+const float kMinScreenRadius = 0.5f;
+const float kImpostorScreenRadius = 16.0f;
+
+// Untimed frames first: shader compilation and the first (broken on some
+// drivers) timer query stay out of the stats
+const int kWarmupFrames = 2;
+
+// Seconds of camera path time per frame, as kReplayStep in the viewer
+const double kReplayStep = 1.0 / 60.0;
+
+const int kVertexAttributeIdx = 0;
+const int kNormalAttributeIdx = 1;
+const int kInstanceAttributeIdx = 2;
+const int kCornerAttributeIdx = 0;
+
+struct Options {
+  std::vector<std::string> models;
+  std::string method = "Mean";
+  int instances = 10;
+  float offset = 1.0f;
+  std::string map;
+  std::string path;
+  int frames = 300;
+  int width = 1280;
+  int height = 720;
+  double budget = 1e6;
+  bool impostors = false;
+  bool pvs = false;
+  bool portals = false;
+  std::string shaders = "../shaders";
+  std::string output;
+};
+
+bool ParseArguments(int argc, char *argv[], Options *options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "-m" && has_value) {
+      options->models.push_back(argv[++i]);
+    } else if (arg == "-M" && has_value) {
+      options->method = argv[++i];
+    } else if (arg == "-n" && has_value) {
+      options->instances = atoi(argv[++i]);
+    } else if (arg == "-d" && has_value) {
+      options->offset = atof(argv[++i]);
+    } else if (arg == "--map" && has_value) {
+      options->map = argv[++i];
+    } else if (arg == "-p" && has_value) {
+      options->path = argv[++i];
+    } else if (arg == "-f" && has_value) {
+      options->frames = atoi(argv[++i]);
+    } else if (arg == "-w" && has_value) {
+      options->width = atoi(argv[++i]);
+    } else if (arg == "-h" && has_value) {
+      options->height = atoi(argv[++i]);
+    } else if (arg == "-b" && has_value) {
+      options->budget = atof(argv[++i]);
+    } else if (arg == "-i") {
+      options->impostors = true;
+    } else if (arg == "--pvs") {
+      options->pvs = true;
+    } else if (arg == "--portals") {
+      options->portals = true;
+    } else if (arg == "-s" && has_value) {
+      options->shaders = argv[++i];
+    } else if (arg == "-o" && has_value) {
+      options->output = argv[++i];
+    } else {
+      return false;
+    }
+  }
+
+  if (options->models.empty()) options->models.push_back("../models/sphere.ply");
+  return static_cast<int>(options->models.size()) <= kMaxSlots &&
+         options->frames > 0 && options->width > 0 && options->height > 0;
+}
+
+// Surfaceless EGL display with a current desktop GL 4.3 core context; the
+// frames go to an FBO, so no window system is needed.
+bool CreateContext() {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+          eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display != nullptr)
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                   EGL_DEFAULT_DISPLAY, nullptr);
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (!eglInitialize(display, &major, &minor)) return false;
+
+  const EGLint kConfig[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  eglChooseConfig(display, kConfig, &config, 1, &num_configs);
+  if (!eglBindAPI(EGL_OPENGL_API)) return false;
+
+  const EGLint kContext[] = {EGL_CONTEXT_MAJOR_VERSION, 4,
+                             EGL_CONTEXT_MINOR_VERSION, 3,
+                             EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                             EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+  EGLContext context = eglCreateContext(
+      display, num_configs > 0 ? config : nullptr, EGL_NO_CONTEXT, kContext);
+  if (context == EGL_NO_CONTEXT) return false;
+
+  return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+GLuint CreateFramebuffer(int width, int height) {
+  GLuint fbo, color, depth;
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(1, &color);
+  glGenRenderbuffers(1, &depth);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    return 0;
+  return fbo;
+}
+
+bool ReadFile(const std::string &filename, std::string *source) {
+  std::ifstream infile(filename.c_str());
+  if (!infile.is_open()) {
+    std::cerr << "Error " + filename + " not found." << std::endl;
+    return false;
+  }
+
+  std::stringstream stream;
+  stream << infile.rdbuf();
+  *source = stream.str();
+  return true;
+}
+
+GLuint CompileShader(GLenum type, const std::string &source) {
+  GLuint shader = glCreateShader(type);
+  const char *text = source.c_str();
+  glShaderSource(shader, 1, &text, nullptr);
+  glCompileShader(shader);
+
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    std::cerr << "Shader error: " << log << std::endl;
+  }
+  return shader;
+}
+
+// One of the viewer's programs, built with plain GL instead of Qt.
+GLuint LoadProgram(const std::string &dir, const std::string &name) {
+  std::string vertex, fragment;
+  if (!ReadFile(dir + "/" + name + ".vert", &vertex) ||
+      !ReadFile(dir + "/" + name + ".frag", &fragment))
+    return 0;
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, CompileShader(GL_VERTEX_SHADER, vertex));
+  glAttachShader(program, CompileShader(GL_FRAGMENT_SHADER, fragment));
+  glBindAttribLocation(program, kVertexAttributeIdx, "vertex");
+  glBindAttribLocation(program, kNormalAttributeIdx, "normal");
+  glLinkProgram(program);
+
+  GLint ok = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &ok);
+  return ok ? program : 0;
+}
+
+// Same as Camera::SetProjection.
+Eigen::Matrix4f Perspective(double fov, double aspect, double znear,
+                            double zfar) {
+  double f = 1.0 / std::tan(fov * M_PI / 360.0);
+  Eigen::Matrix4f p = Eigen::Matrix4f::Zero();
+  p(0, 0) = f / aspect;
+  p(1, 1) = f;
+  p(2, 2) = -(zfar + znear) / (zfar - znear);
+  p(2, 3) = -2.0 * zfar * znear / (zfar - znear);
+  p(3, 2) = -1.0f;
+  return p;
+}
+
+// Same as Camera::UpdateModel followed by Camera::SetModel.
+Eigen::Matrix4f ModelMatrix(const Eigen::Vector3f &min,
+                            const Eigen::Vector3f &max) {
+  Eigen::Vector3f size = max - min;
+  float scaling = 1.0f / std::max(size[0], std::max(size[1], size[2]));
+  const Eigen::Affine3f kScaling(Eigen::Scaling(scaling, scaling, scaling));
+  const Eigen::Affine3f kTranslation(Eigen::Translation3f(-(min + max) / 2));
+  return kScaling.matrix() * kTranslation.matrix();
+}
+
+// Same as GLWidget::DrawImpostors, with the atlases already baked and their
+// texture units set.
+void DrawImpostors(GLuint program, const Eigen::Matrix4f &projection,
+                   const Eigen::Matrix4f &view, const Eigen::Matrix4f &model,
+                   const Eigen::Matrix3f &normal,
+                   const std::vector<const ImpostorAtlas *> &atlases,
+                   ImpostorRenderer *impostors) {
+  Eigen::Matrix4f view_model = view * model;
+  Eigen::Vector3f right =
+      view_model.block<1, 3>(0, 0).transpose().normalized();
+  Eigen::Vector3f up = view_model.block<1, 3>(1, 0).transpose().normalized();
+  Eigen::Vector4f eye = view_model.inverse() * Eigen::Vector4f(0, 0, 0, 1);
+
+  glUseProgram(program);
+  glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE,
+                     projection.data());
+  glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE,
+                     view.data());
+  glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE,
+                     model.data());
+  glUniformMatrix3fv(glGetUniformLocation(program, "normal_matrix"), 1,
+                     GL_FALSE, normal.data());
+  glUniform3fv(glGetUniformLocation(program, "camera_right"), 1, right.data());
+  glUniform3fv(glGetUniformLocation(program, "camera_up"), 1, up.data());
+  glUniform3f(glGetUniformLocation(program, "eye"), eye[0] / eye[3],
+              eye[1] / eye[3], eye[2] / eye[3]);
+
+  impostors->draw(atlases, glGetUniformLocation(program, "center"),
+                  glGetUniformLocation(program, "radius"));
+}
+
+struct Stats {
+  double sum = 0.0;
+  double max = 0.0;
+
+  void Add(double x) {
+    sum += x;
+    max = std::max(max, x);
+  }
+  double Mean(int n) const { return n > 0 ? sum / n : 0.0; }
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!ParseArguments(argc, argv, &options)) {
+    std::cerr << "Usage: benchmark [-m model]... [-M method] [-n instances] "
+                 "[-d offset] [--map map] [-p path] [-f frames] [-w width] "
+                 "[-h height] [-b budget] [-i] [--pvs] [--portals] "
+                 "[-s shaders] [-o output]"
+              << std::endl;
+    return 1;
+  }
+
+  if (!CreateContext()) {
+    std::cerr << "Error no offscreen GL context." << std::endl;
+    return 1;
+  }
+
+  // GLEW looks for a GLX display first; the entry points still load on EGL
+  glewExperimental = GL_TRUE;
+  GLenum glew = glewInit();
+  if (glew != GLEW_OK && glew != GLEW_ERROR_NO_GLX_DISPLAY) {
+    std::cerr << "Error glewInit " << glew << std::endl;
+    return 1;
+  }
+  glGetError();
+
+  GLuint fbo = CreateFramebuffer(options.width, options.height);
+  GLuint program = LoadProgram(options.shaders, "phong");
+  GLuint impostor_program = LoadProgram(options.shaders, "impostor");
+  GLuint bake_program = LoadProgram(options.shaders, "impostor_bake");
+  if (fbo == 0 || program == 0 || impostor_program == 0 || bake_program == 0) {
+    std::cerr << "Error framebuffer or shaders could not be created."
+              << std::endl;
+    return 1;
+  }
+
+  // The asset manager and the PVS log to stdout, which is for the report
+  std::streambuf *report_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+  // Assets are released before the context goes away at exit
+  std::unique_ptr<LODAssetManager> assets(
+      new LODAssetManager(kVertexAttributeIdx, kNormalAttributeIdx));
+  std::vector<std::shared_ptr<LODAsset>> models;
+  std::vector<LODAsset *> active;
+  for (const std::string &file : options.models) {
+    std::shared_ptr<LODAsset> asset = assets->acquire(file, options.method);
+    if (!asset) {
+      std::cerr << "Error " + file + " could not be read." << std::endl;
+      return 1;
+    }
+    models.push_back(asset);
+    active.push_back(asset.get());
+  }
+
+  mapManager map;
+  PotentiallyVisibleSet pvs;
+  if (!options.map.empty()) {
+    if (!map.loadMap(options.map)) {
+      std::cerr << "Error " + options.map + " could not be read." << std::endl;
+      return 1;
+    }
+    if (options.pvs) pvs.loadOrCompute(options.map + ".pvs", map);
+  }
+  PortalGraph portals;
+  if (options.portals && !map.empty()) {
+    portals.build(map);
+    std::cerr << portals.numRooms() << " rooms, " << portals.numPortals()
+              << " portals" << std::endl;
+  }
+  std::cout.rdbuf(report_buffer);
+
+  const float kOffset = options.offset;
+
+  // Instance table, as GLWidget::PlaceInstances: the map places the
+  // instances when it has model cells, otherwise a grid of -n per side
+  std::vector<MapInstance> instances = map.instances();
+  int side = options.instances;
+  if (instances.empty()) {
+    for (int i = 0; i < side; ++i) {
+      for (int j = 0; j < side; ++j) {
+        MapInstance instance;
+        instance.row = j;
+        instance.col = i;
+        instance.slot = (side * i + j) % kMaxSlots;
+        instances.push_back(instance);
+      }
+    }
+  } else {
+    side = std::max(map.rows(), map.cols());
+  }
+  for (MapInstance &instance : instances) {
+    instance.place(kOffset);
+    instance.slot %= active.size();
+  }
+  const int kNum = instances.size();
+  const int kLevels = std::min(kMaxInstanceLod + 1, active[0]->numLevels);
+
+  const Eigen::Matrix4f kModel =
+      ModelMatrix(active[0]->mesh->min_, active[0]->mesh->max_);
+  const Eigen::Matrix4f kProjection =
+      Perspective(kFieldOfView,
+                  static_cast<double>(options.width) / options.height,
+                  kZNear, kZFar);
+  const float kFocalPixels =
+      options.height / (2.0f * std::tan(kFieldOfView * M_PI / 360.0));
+
+  CameraPath path;
+  if (!options.path.empty() && !path.load(options.path)) {
+    std::cerr << "Error " + options.path + " could not be read." << std::endl;
+    return 1;
+  }
+  if (path.empty()) {
+    float extent = side * kOffset * kModel(0, 0);
+    path = CameraPath::orbit(10.0, 1.5 * extent + 1.0, 0.5);
+  }
+
+  FrustumCuller culler;
+  culler.resize(kNum);
+  LODSelector selector;
+  selector.resize(kNum, kLevels);
+  InstanceBatcher batcher(kInstanceAttributeIdx);
+  ImpostorRenderer impostors(kCornerAttributeIdx, kInstanceAttributeIdx);
+  WallGeometry walls(kVertexAttributeIdx, kNormalAttributeIdx,
+                     kInstanceAttributeIdx);
+  if (!map.empty()) walls.build(map, kOffset);
+  std::vector<const ImpostorAtlas *> atlases;
+  if (options.impostors) {
+    glUseProgram(bake_program);
+    for (LODAsset *asset : active)
+      atlases.push_back(&asset->bakeImpostor(bake_program));
+    glUseProgram(impostor_program);
+    glUniform1i(glGetUniformLocation(impostor_program, "color_atlas"), 0);
+    glUniform1i(glGetUniformLocation(impostor_program, "normal_depth_atlas"),
+                1);
+  }
+  FrameProfiler profiler(options.frames);
+  GpuTimer gpu_timer;
+
+  std::vector<int> levels(kNum, 0);
+  Stats gpu_ms, triangles, calls, commands, visible, impostor_count, rooms;
+  std::vector<double> per_level(kLevels, 0.0);
+  int gpu_frames = 0;
+  long long switches = 0;
+
+  glViewport(0, 0, options.width, options.height);
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+  glEnable(GL_DEPTH_TEST);
+
+  glUseProgram(program);
+  glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE,
+                     kProjection.data());
+  glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE,
+                     kModel.data());
+  glUniform3f(glGetUniformLocation(program, "meshPosition"), 0.0f, 0.0f, 0.0f);
+  const GLint kViewLocation = glGetUniformLocation(program, "view");
+  const GLint kNormalLocation = glGetUniformLocation(program, "normal_matrix");
+
+  for (int frame = -kWarmupFrames; frame < options.frames; ++frame) {
+    double time = std::max(frame, 0) * kReplayStep;
+    Eigen::Matrix4f view = path.sample(path.start() + time).view();
+
+    profiler.beginFrame();
+    gpu_timer.begin();
+    glClearColor(0.55f, 0.63f, 0.77f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Culling, as GLWidget::CullInstances without the occlusion tests
+    profiler.begin(FrameProfiler::Culling);
+    for (int k = 0; k < kNum; ++k) {
+      const data_representation::TriangleMesh &mesh =
+          *active[instances[k].slot]->mesh;
+      Eigen::Vector3f c =
+          (instances[k].transform *
+           ((mesh.min_ + mesh.max_) / 2).homogeneous()).head<3>();
+      culler.setSphere(k, c[0], c[1], c[2],
+                       (mesh.max_ - mesh.min_).norm() / 2);
+    }
+    Frustum frustum;
+    frustum.extract(kProjection * view * kModel);
+    culler.cull(frustum);
+    culler.measure(view * kModel, kFocalPixels);
+    for (int k = 0; k < kNum; ++k)
+      if (culler.visible(k) && culler.screenRadius(k) < kMinScreenRadius)
+        culler.hide(k);
+
+    if (!pvs.empty()) {
+      Eigen::Vector4f eye =
+          (view * kModel).inverse() * Eigen::Vector4f(0, 0, 0, 1);
+      int cam_col = std::floor(eye[0] / eye[3] / kOffset + 0.5f);
+      int cam_row = std::floor(eye[2] / eye[3] / kOffset + 0.5f);
+      if (map.inside(cam_row, cam_col) && !map.isOpaque(cam_row, cam_col)) {
+        for (int k = 0; k < kNum; ++k) {
+          const MapInstance &instance = instances[k];
+          if (map.inside(instance.row, instance.col) &&
+              !pvs.visible(cam_row, cam_col, instance.row, instance.col))
+            culler.hide(k);
+        }
+      }
+    }
+
+    // Portal traversal from the camera room, as GLWidget::CullInstances
+    int visible_rooms = 0;
+    if (!portals.empty() &&
+        portals.traverse(kProjection, view * kModel, kOffset)) {
+      visible_rooms = portals.visibleRooms();
+      for (int k = 0; k < kNum; ++k) {
+        const MapInstance &instance = instances[k];
+        int room = portals.room(instance.row, instance.col);
+        if (room < 0 || !culler.visible(k)) continue;
+        const data_representation::TriangleMesh &mesh =
+            *active[instance.slot]->mesh;
+        Eigen::Vector3f c = (mesh.min_ + mesh.max_) / 2 + instance.offset;
+        float radius = std::hypot(mesh.max_[0] - mesh.min_[0],
+                                  mesh.max_[2] - mesh.min_[2]) / 2;
+        if (!portals.circleVisible(room, c[0] / kOffset, c[2] / kOffset,
+                                   radius / kOffset))
+          culler.hide(k);
+      }
+    }
+
+    // Small instances become impostors, as in GLWidget::paintGL
+    impostors.clear(active.size());
+    if (options.impostors) {
+      for (int k = 0; k < kNum; ++k) {
+        if (!culler.visible(k) || culler.screenRadius(k) >= kImpostorScreenRadius)
+          continue;
+        const Eigen::Vector3f &offset = instances[k].offset;
+        impostors.add(instances[k].slot, offset[0], offset[1], offset[2]);
+        culler.hide(k);
+      }
+    }
+    profiler.end(FrameProfiler::Culling);
+
+    // LOD selection with the knapsack selector and a fixed budget
+    profiler.begin(FrameProfiler::LODSelection);
+    float cost[kMaxInstanceLod + 1], benefit[kMaxInstanceLod + 1];
+    for (int k = 0; k < kNum; ++k) {
+      if (!culler.visible(k)) continue;
+      const LODAsset &asset = *active[instances[k].slot];
+      for (int l = 0; l < kLevels; ++l) {
+        cost[l] = asset.lod.infoPerLOD[l].numFaces;
+        benefit[l] = -asset.contribution(l, culler.distance(k), kModel(0, 0));
+      }
+      selector.setOptions(k, levels[k], cost, benefit);
+    }
+    // Walls count against the budget as in the viewer, with the last
+    // frame's standing in for this one's
+    selector.select(
+        std::max(0.0, options.budget - walls.drawnTriangles()));
+    int lod_switches = 0;
+    for (int k = 0; k < kNum; ++k) {
+      lod_switches += culler.visible(k) && selector.level(k) != levels[k];
+      levels[k] = selector.level(k);
+    }
+    profiler.end(FrameProfiler::LODSelection);
+
+    profiler.begin(FrameProfiler::DrawSubmission);
+    Eigen::Matrix4f vm = view * kModel;
+    Eigen::Matrix3f normal = vm.block<3, 3>(0, 0).inverse().transpose();
+    glUseProgram(program);
+    glUniformMatrix4fv(kViewLocation, 1, GL_FALSE, view.data());
+    glUniformMatrix3fv(kNormalLocation, 1, GL_FALSE, normal.data());
+
+    batcher.clear(active.size(), active[0]->numLevels);
+    for (int k = 0; k < kNum; ++k) {
+      if (!culler.visible(k)) continue;
+      const Eigen::Vector3f &offset = instances[k].offset;
+      batcher.add(instances[k].slot, levels[k], offset[0], offset[1],
+                  offset[2]);
+    }
+    batcher.draw(active, assets->arena());
+    walls.draw(frustum);
+    if (options.impostors)
+      DrawImpostors(impostor_program, kProjection, view, kModel, normal,
+                    atlases, &impostors);
+    profiler.end(FrameProfiler::DrawSubmission);
+
+    // No swap offscreen: waiting for the GPU stands in for it
+    profiler.begin(FrameProfiler::Swap);
+    gpu_timer.end();
+    glFinish();
+    profiler.end(FrameProfiler::Swap);
+    // The profiler holds options.frames frames, so the warm-up ones drop out
+    int drawn_triangles = batcher.triangles() + 2 * impostors.instances() +
+                          walls.drawnTriangles();
+    profiler.endFrame(lod_switches, drawn_triangles);
+
+    double ms;
+    while (gpu_timer.poll(&ms)) {
+      if (frame < 0) continue;
+      gpu_ms.Add(ms);
+      ++gpu_frames;
+    }
+    if (frame < 0) continue;
+
+    switches += lod_switches;
+    triangles.Add(drawn_triangles);
+    calls.Add(batcher.drawCalls() + impostors.drawCalls() + walls.drawCalls());
+    commands.Add(batcher.commands());
+    visible.Add(culler.numVisible() + impostors.instances());
+    impostor_count.Add(impostors.instances());
+    rooms.Add(visible_rooms);
+    const std::vector<int> &drawn = batcher.instancesPerLevel();
+    for (int l = 0; l < kLevels && l < static_cast<int>(drawn.size()); ++l)
+      per_level[l] += drawn[l];
+  }
+
+  if (glGetError() != GL_NO_ERROR)
+    std::cerr << "Warning GL errors while rendering." << std::endl;
+
+  // Report
+  const int kFrames = profiler.size();
+  Stats frame_ms;
+  std::vector<double> phase_ms(FrameProfiler::NumPhases, 0.0);
+  for (int i = 0; i < kFrames; ++i) {
+    const FrameProfiler::Frame &f = profiler.frame(i);
+    frame_ms.Add(f.totalMs);
+    for (int p = 0; p < FrameProfiler::NumPhases; ++p)
+      phase_ms[p] += f.phaseMs[p];
+  }
+
+  std::ostringstream json;
+  json << "{\n"
+       << "  \"renderer\": \""
+       << reinterpret_cast<const char *>(glGetString(GL_RENDERER)) << "\",\n"
+       << "  \"models\": [";
+  for (size_t m = 0; m < options.models.size(); ++m)
+    json << (m > 0 ? ", " : "") << "\"" << options.models[m] << "\"";
+  json << "],\n"
+       << "  \"method\": \"" << options.method << "\",\n"
+       << "  \"map\": \"" << options.map << "\",\n"
+       << "  \"instances\": " << kNum << ",\n"
+       << "  \"width\": " << options.width << ",\n"
+       << "  \"height\": " << options.height << ",\n"
+       << "  \"budget\": " << options.budget << ",\n"
+       << "  \"frames\": " << kFrames << ",\n"
+       << "  \"frame_ms\": {\"mean\": " << frame_ms.Mean(kFrames)
+       << ", \"p50\": " << profiler.percentile(0.50)
+       << ", \"p95\": " << profiler.percentile(0.95)
+       << ", \"p99\": " << profiler.percentile(0.99)
+       << ", \"max\": " << frame_ms.max << "},\n"
+       << "  \"phase_ms\": {";
+  for (int p = 0; p < FrameProfiler::NumPhases; ++p)
+    json << (p > 0 ? ", " : "") << "\""
+         << FrameProfiler::phaseName(FrameProfiler::Phase(p))
+         << "\": " << phase_ms[p] / std::max(kFrames, 1);
+  json << "},\n"
+       << "  \"gpu_ms\": {\"mean\": " << gpu_ms.Mean(gpu_frames)
+       << ", \"max\": " << gpu_ms.max << ", \"frames\": " << gpu_frames
+       << "},\n"
+       << "  \"triangles\": {\"mean\": " << triangles.Mean(kFrames)
+       << ", \"max\": " << triangles.max << "},\n"
+       << "  \"draw_calls\": {\"mean\": " << calls.Mean(kFrames)
+       << ", \"max\": " << calls.max << "},\n"
+       << "  \"draw_commands\": {\"mean\": " << commands.Mean(kFrames)
+       << ", \"max\": " << commands.max << "},\n"
+       << "  \"visible_instances\": {\"mean\": " << visible.Mean(kFrames)
+       << ", \"max\": " << visible.max << "},\n"
+       << "  \"impostors\": {\"mean\": " << impostor_count.Mean(kFrames)
+       << ", \"max\": " << impostor_count.max << "},\n"
+       << "  \"visible_rooms\": {\"mean\": " << rooms.Mean(kFrames)
+       << ", \"max\": " << rooms.max << "},\n"
+       << "  \"walls\": {\"triangles\": " << walls.triangles()
+       << ", \"box_triangles\": " << walls.naiveTriangles()
+       << ", \"chunks\": " << walls.numChunks() << "},\n"
+       << "  \"lod_switches\": " << switches << ",\n"
+       << "  \"lod_distribution\": [";
+  for (int l = 0; l < kLevels; ++l)
+    json << (l > 0 ? ", " : "") << per_level[l] / std::max(kFrames, 1);
+  json << "]\n}\n";
+
+  models.clear();
+  active.clear();
+  assets.reset();
+
+  if (options.output.empty()) {
+    std::cout << json.str();
+  } else {
+    std::ofstream out(options.output.c_str());
+    out << json.str();
+    if (!out.good()) return 1;
+  }
+  return 0;
+}
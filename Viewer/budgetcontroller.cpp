@@ -0,0 +1,106 @@
+#include "budgetcontroller.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+GpuTimer::GpuTimer()
+    : next( 0 ), oldest( 0 ), running( false )
+{
+    std::fill( queries, queries + GPUTIMER_QUERIES, 0 );
+    std::fill( pending, pending + GPUTIMER_QUERIES, false );
+}
+
+
+GpuTimer::~GpuTimer()
+{
+    if ( queries[ 0 ] != 0 ) glDeleteQueries( GPUTIMER_QUERIES, queries );
+}
+
+
+void GpuTimer::begin()
+{
+    if ( queries[ 0 ] == 0 ) glGenQueries( GPUTIMER_QUERIES, queries );
+    if ( pending[ next ] ) return;      // GPU too far behind: skip this frame
+
+    glBeginQuery( GL_TIME_ELAPSED, queries[ next ] );
+    running = true;
+}
+
+
+void GpuTimer::end()
+{
+    if ( not running ) return;
+
+    glEndQuery( GL_TIME_ELAPSED );
+    pending[ next ] = true;
+    next = ( next + 1 ) % GPUTIMER_QUERIES;
+    running = false;
+}
+
+
+bool GpuTimer::poll( double* ms )
+{
+    bool any = false;
+    while ( pending[ oldest ] ) {
+        GLint available = 0;
+        glGetQueryObjectiv( queries[ oldest ], GL_QUERY_RESULT_AVAILABLE, &available );
+        if ( not available ) break;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v( queries[ oldest ], GL_QUERY_RESULT, &ns );
+        *ms = ns * 1e-6;
+        any = true;
+
+        pending[ oldest ] = false;
+        oldest = ( oldest + 1 ) % GPUTIMER_QUERIES;
+    }
+    return any;
+}
+
+
+BudgetController::BudgetController( double target, double initialBudget )
+    : targetMs( target ), current( initialBudget ), minBudget( 1e4 ), maxBudget( 1e8 ),
+      kp( 0.5 ), ki( 0.1 ), smoothing( 0.2 ), deadband( 0.05 ), maxStep( std::log( 1.25 ) ),
+      smoothed( 0.0 ), lastError( 0.0 ), started( false )
+{
+}
+
+
+void BudgetController::setLimits( double lo, double hi )
+{
+    minBudget = lo;
+    maxBudget = hi;
+    current = std::max( minBudget, std::min( current, maxBudget ) );
+}
+
+
+double BudgetController::update( double frameMs )
+{
+    if ( not started ) {
+        smoothed = frameMs;
+        started = true;
+    }
+    else smoothed += smoothing * ( frameMs - smoothed );
+
+    double error = std::max( -1.0, std::min( ( targetMs - smoothed ) / targetMs, 1.0 ) );
+    if ( std::abs( error ) < deadband ) error = 0.0;
+
+    // Velocity form: the integral lives in the budget itself, so clamping
+    // the budget is all the anti-windup needed
+    double step = kp * ( error - lastError ) + ki * error;
+    step = std::max( -maxStep, std::min( step, maxStep ) );
+    lastError = error;
+
+    current = std::max( minBudget, std::min( current * std::exp( step ), maxBudget ) );
+    return current;
+}
+
+
+void BudgetController::reset( double budget )
+{
+    current = std::max( minBudget, std::min( budget, maxBudget ) );
+    smoothed = 0.0;
+    lastError = 0.0;
+    started = false;
+}
@@ -0,0 +1,114 @@
+#ifndef BUDGETCONTROLLER_H
+#define BUDGETCONTROLLER_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+
+
+#define GPUTIMER_QUERIES 4              // frames the GPU may run behind
+
+
+/**
+ * @brief The GpuTimer class GPU time of a frame with GL_TIME_ELAPSED queries
+ * (GL 3.3). The queries of the last few frames are kept in a ring and read
+ * only once available, so the CPU never waits for the GPU; the result is
+ * one to a few frames old.
+ */
+class GpuTimer
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer( const GpuTimer& ) = delete;
+    GpuTimer& operator=( const GpuTimer& ) = delete;
+
+    /**
+     * @brief begin / end Bracket the GL commands of a frame. A frame is
+     * skipped when every query is still in flight.
+     */
+    void begin();
+    void end();
+
+    /**
+     * @brief poll Reads the finished queries.
+     * @return Whether ms holds a new result (the latest finished frame).
+     */
+    bool poll( double* ms );
+
+private:
+    GLuint queries[ GPUTIMER_QUERIES ];
+    bool pending[ GPUTIMER_QUERIES ];
+    int next;           // ring slot of the next begin
+    int oldest;         // ring slot of the oldest pending query
+    bool running;
+};
+
+
+/**
+ * @brief The BudgetController class Adjusts the triangle budget so the frame
+ * time stays at a target. A PI controller on the log of the budget, so steps
+ * are relative:
+ *     e = ( target - t ) / target
+ *     log budget += kp * ( e - e_prev ) + ki * e
+ * Against oscillation the measured time is smoothed (exponential moving
+ * average), errors within a deadband count as zero, each step is limited and
+ * the budget is clamped, which also keeps the integral from winding up.
+ */
+class BudgetController
+{
+public:
+    BudgetController( double targetMs = 16.6, double initialBudget = 1e6 );
+
+    void setTarget( double ms ) { targetMs = ms; }
+    double target() const { return targetMs; }
+
+    void setLimits( double minBudget, double maxBudget );
+    void setGains( double proportional, double integral ) { kp = proportional; ki = integral; }
+
+    /**
+     * @brief update Feeds the time of the last frame (the slowest of CPU and
+     * GPU) and returns the budget for the next one.
+     */
+    double update( double frameMs );
+
+    /**
+     * @brief reset Restarts the controller from budget, forgetting the
+     * smoothed time and the last error.
+     */
+    void reset( double budget );
+
+    double budget() const { return current; }
+    double smoothedMs() const { return smoothed; }
+
+private:
+    double targetMs;
+    double current, minBudget, maxBudget;
+    double kp, ki;
+    double smoothing;       // weight of the new sample
+    double deadband;        // relative error ignored
+    double maxStep;         // largest change of log budget per frame
+
+    double smoothed;
+    double lastError;
+    bool started;
+};
+
+
+/**
+ * @brief The CpuTimer class Wall time of a section with std::chrono.
+ */
+class CpuTimer
+{
+public:
+    void begin() { start = std::chrono::steady_clock::now(); }
+    double elapsedMs() const {
+        return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // BUDGETCONTROLLER_H
@@ -132,6 +132,18 @@ void Camera::Rotate(double modifier) {
   rotation_y_ += AngleIncrement * modifier;
 }
 
+CameraKey Camera::State(double time) const {
+  return CameraKey{time, rotation_x_, rotation_y_, distance_, pan_x_, pan_y_};
+}
+
+void Camera::SetState(const CameraKey &key) {
+  rotation_x_ = key.rotationX;
+  rotation_y_ = key.rotationY;
+  distance_ = key.distance;
+  pan_x_ = key.panX;
+  pan_y_ = key.panY;
+}
+
 void Camera::UpdateModel(Eigen::Vector3f min, Eigen::Vector3f max) {
   Eigen::Vector3d center = (min + max).cast<double>() / 2.0;
   centering_x_ = -center[0];
@@ -5,6 +5,8 @@
 
 #include <eigen3/Eigen/Geometry>
 
+#include "./camerapath.h"
+
 namespace data_visualization {
 
 const double kMaxCameraDistance = 30.0;
@@ -226,6 +228,21 @@ class Camera {
    */
   void Rotate(double modifier);
 
+  /**
+   * @brief State Returns the parameters of the viewing transform (rotations,
+   * zoom distance and pan), e.g. to record them.
+   * @param time Time stamp of the returned key.
+   * @return The camera state at time.
+   */
+  CameraKey State(double time) const;
+
+  /**
+   * @brief SetState Sets the parameters of the viewing transform, e.g. from a
+   * recorded camera path. Ongoing mouse interaction is not affected.
+   * @param key Camera state to apply.
+   */
+  void SetState(const CameraKey &key);
+
   /**
    * @brief UpdateModel Updates the intrinsic parameters to compute a modeling
    * transform that centers the bounding box of the model and makes its longest
@@ -0,0 +1,133 @@
+#include "camerapath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+
+namespace {
+
+const char kMagic[ 4 ] = { 'C', 'P', 'T', 'H' };
+const uint32_t kVersion = 1;
+
+}  // namespace
+
+
+Eigen::Matrix4f CameraKey::view() const
+{
+    const Eigen::Affine3f translation( Eigen::Translation3f( Eigen::Vector3f( panX, panY, -distance ) ) );
+    const Eigen::Affine3f rotationA( Eigen::AngleAxisf( rotationX, Eigen::Vector3f( 1, 0, 0 ) ) );
+    const Eigen::Affine3f rotationB( Eigen::AngleAxisf( rotationY, Eigen::Vector3f( 0, 1, 0 ) ) );
+
+    return translation.matrix() * rotationA.matrix() * rotationB.matrix();
+}
+
+
+bool CameraPath::load( const std::string& filename )
+{
+    std::ifstream in( filename.c_str(), std::ios::binary );
+    if ( not in.is_open() ) return false;
+
+    keys.clear();
+    char magic[ 4 ] = {};
+    in.read( magic, 4 );
+    if ( in.gcount() == 4 and std::memcmp( magic, kMagic, 4 ) == 0 ) return loadBinary( in );
+    in.clear();
+    in.seekg( 0 );
+
+    std::string line;
+    while ( std::getline( in, line ) ) {
+        line = line.substr( 0, line.find( '#' ) );
+        std::istringstream fields( line );
+        CameraKey key;
+        if ( fields >> key.time >> key.rotationX >> key.rotationY >> key.distance >> key.panX >> key.panY ) add( key );
+    }
+    return not keys.empty();
+}
+
+
+bool CameraPath::loadBinary( std::istream& in )
+{
+    uint32_t version = 0, count = 0;
+    in.read( reinterpret_cast<char*>( &version ), sizeof( version ) );
+    in.read( reinterpret_cast<char*>( &count ), sizeof( count ) );
+    if ( not in or version != kVersion ) return false;
+
+    keys.reserve( count );
+    for ( uint32_t k = 0; k < count; ++k ) {
+        double time;
+        float p[ 5 ];
+        in.read( reinterpret_cast<char*>( &time ), sizeof( time ) );
+        in.read( reinterpret_cast<char*>( p ), sizeof( p ) );
+        if ( not in ) return false;
+        add( CameraKey{ time, p[0], p[1], p[2], p[3], p[4] } );
+    }
+    return not keys.empty();
+}
+
+
+bool CameraPath::save( const std::string& filename ) const
+{
+    std::ofstream out( filename.c_str(), std::ios::binary );
+    if ( not out.is_open() ) return false;
+
+    uint32_t count = keys.size();
+    out.write( kMagic, 4 );
+    out.write( reinterpret_cast<const char*>( &kVersion ), sizeof( kVersion ) );
+    out.write( reinterpret_cast<const char*>( &count ), sizeof( count ) );
+    for ( const CameraKey& key : keys ) {
+        float p[ 5 ] = { float( key.rotationX ), float( key.rotationY ), float( key.distance ),
+                         float( key.panX ), float( key.panY ) };
+        out.write( reinterpret_cast<const char*>( &key.time ), sizeof( key.time ) );
+        out.write( reinterpret_cast<const char*>( p ), sizeof( p ) );
+    }
+    return out.good();
+}
+
+
+CameraPath CameraPath::orbit( double seconds, double distance, double rotationX )
+{
+    CameraPath path;
+    path.add( CameraKey{ 0.0, rotationX, 0.0, distance, 0.0, 0.0 } );
+    path.add( CameraKey{ seconds, rotationX, 2 * M_PI, distance, 0.0, 0.0 } );
+    return path;
+}
+
+
+void CameraPath::add( const CameraKey& key )
+{
+    auto later = std::upper_bound( keys.begin(), keys.end(), key,
+                                   []( const CameraKey& a, const CameraKey& b ) { return a.time < b.time; } );
+    keys.insert( later, key );
+}
+
+
+CameraKey CameraPath::sample( double t ) const
+{
+    if ( t <= keys.front().time ) return keys.front();
+    if ( t >= keys.back().time ) return keys.back();
+
+    size_t k = 1;
+    while ( keys[ k ].time < t ) ++k;
+    const CameraKey& a = keys[ k - 1 ];
+    const CameraKey& b = keys[ k ];
+    double w = ( t - a.time ) / std::max( b.time - a.time, 1e-9 );
+
+    CameraKey key;
+    key.time = t;
+    key.rotationX = a.rotationX + w * ( b.rotationX - a.rotationX );
+    key.rotationY = a.rotationY + w * ( b.rotationY - a.rotationY );
+    key.distance = a.distance + w * ( b.distance - a.distance );
+    key.panX = a.panX + w * ( b.panX - a.panX );
+    key.panY = a.panY + w * ( b.panY - a.panY );
+    return key;
+}
+
+
+double CameraPath::duration() const
+{
+    return keys.empty() ? 0.0 : keys.back().time - keys.front().time;
+}
@@ -0,0 +1,74 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Geometry>
+
+
+/**
+ * @brief The CameraKey struct One key of a camera path, in the terms of the
+ * viewer's orbit camera (see Camera::SetView).
+ */
+struct CameraKey
+{
+    double time;            // seconds
+    double rotationX, rotationY;
+    double distance;
+    double panX, panY;
+
+    /**
+     * @brief view Same view matrix as Camera::SetView.
+     */
+    Eigen::Matrix4f view() const;
+};
+
+
+/**
+ * @brief The CameraPath class Keys sorted by time, interpolated linearly.
+ *
+ * Text files have one key per line, '#' starts a comment:
+ *     time rotation_x rotation_y distance pan_x pan_y
+ * Recordings are binary: "CPTH", version and key count (uint32), then per
+ * key the time (double) and the five parameters (float, which is what the
+ * view matrix is computed with), all in native byte order.
+ */
+class CameraPath
+{
+public:
+    /**
+     * @brief load Reads a recording or a text path, told apart by the magic.
+     */
+    bool load( const std::string& filename );
+
+    /**
+     * @brief save Writes the keys as a recording.
+     */
+    bool save( const std::string& filename ) const;
+
+    /**
+     * @brief orbit A full turn around the y axis at the given distance and
+     * elevation, as default path.
+     */
+    static CameraPath orbit( double seconds, double distance, double rotationX );
+
+    void add( const CameraKey& key );
+    void clear() { keys.clear(); }
+
+    /**
+     * @brief sample Key at time t, clamped to the path.
+     */
+    CameraKey sample( double t ) const;
+
+    double start() const { return keys.empty() ? 0.0 : keys.front().time; }
+    double duration() const;
+    bool empty() const { return keys.empty(); }
+
+private:
+    bool loadBinary( std::istream& in );
+
+    std::vector< CameraKey > keys;
+};
+
+#endif // CAMERAPATH_H
@@ -0,0 +1,51 @@
+#include "clusterstats.h"
+
+#include <iomanip>
+#include <sstream>
+
+
+LevelStats::LevelStats()
+    : resolution(0.0f), binningMs(0.0), representativeMs(0.0), remapMs(0.0), normalsMs(0.0),
+      occupiedCells(0), totalCells(0), outVertices(0), outFaces(0), allocBytes(0),
+      quadricSolves(0), quadricInvertible(0) {}
+
+
+std::string ClusterStats::toJson() const {
+    std::ostringstream json;
+    json << "{\"method\": \"" << method << "\", \"in_vertices\": " << inVertices << ", \"in_faces\": " << inFaces
+         << ", \"setup_ms\": " << setupMs << ", \"total_ms\": " << totalMs << ", \"levels\": [";
+    for (int i = 0; i < (int) levels.size(); ++i) {
+        const LevelStats& l = levels[ i ];
+        json << ( i > 0 ? ", " : "" )
+             << "{\"resolution\": " << l.resolution
+             << ", \"binning_ms\": " << l.binningMs
+             << ", \"representative_ms\": " << l.representativeMs
+             << ", \"remap_ms\": " << l.remapMs
+             << ", \"normals_ms\": " << l.normalsMs
+             << ", \"occupied_cells\": " << l.occupiedCells
+             << ", \"total_cells\": " << l.totalCells
+             << ", \"occupancy\": " << l.occupancy()
+             << ", \"out_vertices\": " << l.outVertices
+             << ", \"out_faces\": " << l.outFaces
+             << ", \"alloc_bytes\": " << l.allocBytes
+             << ", \"quadric_solves\": " << l.quadricSolves
+             << ", \"quadric_invertible_rate\": " << l.invertibleRate() << "}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+
+std::string ClusterStats::summary() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << method << ": " << totalMs << " ms\n";
+    for (int i = 0; i < (int) levels.size(); ++i) {
+        const LevelStats& l = levels[ i ];
+        out << "L" << i << " " << l.binningMs + l.representativeMs + l.remapMs + l.normalsMs << " ms, "
+            << l.outVertices << " v, " << int( 100 * l.occupancy() ) << "% occ";
+        if ( l.quadricSolves > 0 ) out << ", " << int( 100 * l.invertibleRate() ) << "% inv";
+        out << "\n";
+    }
+    return out.str();
+}
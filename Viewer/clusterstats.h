@@ -0,0 +1,82 @@
+#ifndef CLUSTERSTATS_H
+#define CLUSTERSTATS_H
+
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief The LevelStats struct Timings and counters of one level built by
+ * VertexClustering::buildCluster.
+ */
+struct LevelStats
+{
+    /**
+     * @brief resolution Grid cells per axis, or the error bound for the
+     * Adaptive Octree method.
+     */
+    float resolution;
+
+    // Wall time per stage, in milliseconds. The octree bins while it recurses,
+    // so its binning time is reported inside representativeMs. The normals
+    // are accumulated inside the face remap loop, so remapMs includes that
+    // and normalsMs is only the final normalization.
+    double binningMs;
+    double representativeMs;
+    double remapMs;
+    double normalsMs;
+
+    /**
+     * @brief occupiedCells Non-empty cells (octree leaves) out of totalCells
+     * (octree nodes visited).
+     */
+    int occupiedCells;
+    int totalCells;
+
+    int outVertices;
+    int outFaces;
+
+    /**
+     * @brief allocBytes Bytes held by the grid and the level buffers.
+     */
+    size_t allocBytes;
+
+    /**
+     * @brief quadricSolves Quadric systems solved, and how many were invertible.
+     */
+    int quadricSolves;
+    int quadricInvertible;
+
+    LevelStats();
+
+    float occupancy() const { return totalCells > 0 ? float( occupiedCells ) / totalCells : 0.0f; }
+    float invertibleRate() const { return quadricSolves > 0 ? float( quadricInvertible ) / quadricSolves : 0.0f; }
+};
+
+
+/**
+ * @brief The ClusterStats struct Stats of one buildCluster call.
+ */
+struct ClusterStats
+{
+    std::string method;
+    int inVertices;
+    int inFaces;
+    double setupMs;   // quadrics and scratch allocation
+    double totalMs;
+    std::vector< LevelStats > levels;
+
+    ClusterStats() : inVertices(0), inFaces(0), setupMs(0.0), totalMs(0.0) {}
+
+    /**
+     * @brief toJson Serializes the stats as a JSON object.
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief summary Short human readable report, one line per level.
+     */
+    std::string summary() const;
+};
+
+#endif // CLUSTERSTATS_H
@@ -0,0 +1,138 @@
+#include "frameprofiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+namespace {
+
+// Eighth blocks, from empty to full, for the text histogram
+const char* const kBars[] = { " ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+}  // namespace
+
+
+FrameProfiler::FrameProfiler( int capacity )
+    : origin( Clock::now() ), ring( capacity ), next( 0 ), count( 0 ), frames( 0 )
+{
+    frameStart = origin;
+    current = Frame();
+}
+
+
+void FrameProfiler::beginFrame()
+{
+    frameStart = Clock::now();
+    current = Frame();
+    current.index = frames;
+    current.startMs = ms( origin, frameStart );
+}
+
+
+void FrameProfiler::begin( Phase phase )
+{
+    phaseStart[ phase ] = Clock::now();
+}
+
+
+void FrameProfiler::end( Phase phase )
+{
+    current.phaseMs[ phase ] += ms( phaseStart[ phase ], Clock::now() );
+}
+
+
+void FrameProfiler::endFrame( int lodSwitches, int triangles )
+{
+    current.totalMs = ms( frameStart, Clock::now() );
+    current.lodSwitches = lodSwitches;
+    current.triangles = triangles;
+
+    ring[ next ] = current;
+    next = ( next + 1 ) % ring.size();
+    count = std::min<int>( count + 1, ring.size() );
+    ++frames;
+}
+
+
+const FrameProfiler::Frame& FrameProfiler::frame( int i ) const
+{
+    int oldest = ( next - count + ring.size() ) % ring.size();
+    return ring[ ( oldest + i ) % ring.size() ];
+}
+
+
+double FrameProfiler::percentile( double p ) const
+{
+    if ( count == 0 ) return 0.0;
+
+    scratch.resize( count );
+    for ( int i = 0; i < count; ++i ) scratch[ i ] = frame( i ).totalMs;
+    int k = std::min<int>( count - 1, p * count );
+    std::nth_element( scratch.begin(), scratch.begin() + k, scratch.end() );
+    return scratch[ k ];
+}
+
+
+std::vector<int> FrameProfiler::histogram( int bins, double maxMs ) const
+{
+    std::vector<int> h( bins, 0 );
+    for ( int i = 0; i < count; ++i ) {
+        int b = frame( i ).totalMs / maxMs * bins;
+        ++h[ std::max( 0, std::min( b, bins - 1 ) ) ];
+    }
+    return h;
+}
+
+
+std::string FrameProfiler::summary( double maxMs ) const
+{
+    char line[ 128 ];
+    std::snprintf( line, sizeof( line ), "p50 %.1f  p95 %.1f  p99 %.1f ms\n",
+                   percentile( 0.50 ), percentile( 0.95 ), percentile( 0.99 ) );
+
+    std::vector<int> h = histogram( 24, maxMs );
+    int highest = std::max( 1, *std::max_element( h.begin(), h.end() ) );
+
+    std::ostringstream out;
+    out << line;
+    for ( int n : h ) out << kBars[ ( n * 8 + highest - 1 ) / highest ];
+    std::snprintf( line, sizeof( line ), "\n0%*.0f ms", 23, maxMs );
+    out << line;
+    return out.str();
+}
+
+
+bool FrameProfiler::exportCsv( const std::string& filename ) const
+{
+    std::ofstream out( filename.c_str() );
+    if ( not out.is_open() ) return false;
+
+    double hitch = 2.0 * percentile( 0.5 );
+
+    out << "frame,start_ms";
+    for ( int p = 0; p < NumPhases; ++p ) out << "," << phaseName( Phase( p ) ) << "_ms";
+    out << ",total_ms,lod_switches,triangles,hitch\n";
+
+    for ( int i = 0; i < count; ++i ) {
+        const Frame& f = frame( i );
+        out << f.index << "," << f.startMs;
+        for ( int p = 0; p < NumPhases; ++p ) out << "," << f.phaseMs[ p ];
+        out << "," << f.totalMs << "," << f.lodSwitches << "," << f.triangles
+            << "," << ( f.totalMs > hitch ? 1 : 0 ) << "\n";
+    }
+    return out.good();
+}
+
+
+const char* FrameProfiler::phaseName( Phase phase )
+{
+    switch ( phase ) {
+    case Culling:        return "culling";
+    case LODSelection:   return "lod";
+    case DrawSubmission: return "draw";
+    case Swap:           return "swap";
+    default:             return "unknown";
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+#define FRAMEPROFILER_CAPACITY 1024     // frames kept for the rolling stats
+
+
+/**
+ * @brief The FrameProfiler class Per-frame steady_clock timings of each
+ * phase of a frame, kept in a ring buffer of the last frames. Gives rolling
+ * percentiles and a histogram of the frame time, and exports the ring as CSV
+ * so single slow frames (hitches, LOD switches) can be found afterwards.
+ */
+class FrameProfiler
+{
+public:
+    enum Phase { Culling, LODSelection, DrawSubmission, Swap, NumPhases };
+
+    struct Frame {
+        long long index;
+        double startMs;                 // since the profiler was created
+        double phaseMs[ NumPhases ];
+        double totalMs;                 // beginFrame to endFrame
+        int lodSwitches;                // instances whose level changed
+        int triangles;
+    };
+
+    FrameProfiler( int capacity = FRAMEPROFILER_CAPACITY );
+
+    void beginFrame();
+
+    /**
+     * @brief begin / end Time a phase of the current frame; a phase timed
+     * more than once in a frame adds up.
+     */
+    void begin( Phase phase );
+    void end( Phase phase );
+
+    void endFrame( int lodSwitches, int triangles );
+
+    /**
+     * @brief size Frames in the ring; frame( 0 ) is the oldest.
+     */
+    int size() const { return count; }
+    const Frame& frame( int i ) const;
+
+    /**
+     * @brief percentile Frame time (ms) below which a fraction p of the
+     * frames in the ring are, p in [0, 1].
+     */
+    double percentile( double p ) const;
+
+    /**
+     * @brief histogram Frames in the ring per bin of width maxMs / bins; the
+     * last bin also counts the frames above maxMs.
+     */
+    std::vector<int> histogram( int bins, double maxMs ) const;
+
+    /**
+     * @brief summary "p50 / p95 / p99" and a text histogram for the UI.
+     */
+    std::string summary( double maxMs ) const;
+
+    /**
+     * @brief exportCsv Writes one line per frame in the ring. Frames over
+     * twice the median are flagged as hitches.
+     */
+    bool exportCsv( const std::string& filename ) const;
+
+    static const char* phaseName( Phase phase );
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static double ms( Clock::time_point a, Clock::time_point b ) {
+        return std::chrono::duration<double, std::milli>( b - a ).count();
+    }
+
+    Clock::time_point origin, frameStart;
+    Clock::time_point phaseStart[ NumPhases ];
+    Frame current;
+
+    std::vector<Frame> ring;
+    int next;
+    int count;
+    long long frames;
+    mutable std::vector<double> scratch;
+};
+
+#endif // FRAMEPROFILER_H
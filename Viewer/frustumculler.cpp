@@ -0,0 +1,165 @@
+#include "frustumculler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+void Frustum::extract( const Eigen::Matrix4f& clip )
+{
+    // left, right, bottom, top, near, far
+    Eigen::Vector4f p[ 6 ] = {
+        clip.row( 3 ) + clip.row( 0 ),
+        clip.row( 3 ) - clip.row( 0 ),
+        clip.row( 3 ) + clip.row( 1 ),
+        clip.row( 3 ) - clip.row( 1 ),
+        clip.row( 3 ) + clip.row( 2 ),
+        clip.row( 3 ) - clip.row( 2 )
+    };
+
+    for ( int k = 0; k < 6; ++k ) {
+        float len = p[ k ].head<3>().norm();
+        if ( len > 0.0f ) p[ k ] /= len;
+        for ( int c = 0; c < 4; ++c ) planes[ k ][ c ] = p[ k ][ c ];
+    }
+}
+
+
+FrustumCuller::FrustumCuller() : n( 0 ), visibleCount( 0 )
+{
+}
+
+
+void FrustumCuller::resize( int num )
+{
+    n = num;
+    int padded = ( n + 7 ) & ~7;
+    cx.assign( padded, 0.0f );
+    cy.assign( padded, 0.0f );
+    cz.assign( padded, 0.0f );
+    r.assign( padded, 0.0f );
+    vis.assign( padded, 1 );
+    dist.assign( padded, 0.0f );
+    screen.assign( padded, 0.0f );
+}
+
+
+int FrustumCuller::cull( const Frustum& frustum )
+{
+    int padded = cx.size();
+
+#if defined(__AVX2__)
+    for ( int k = 0; k < padded; k += 8 ) {
+        __m256 x = _mm256_loadu_ps( &cx[ k ] );
+        __m256 y = _mm256_loadu_ps( &cy[ k ] );
+        __m256 z = _mm256_loadu_ps( &cz[ k ] );
+        __m256 negR = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( &r[ k ] ) );
+
+        __m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+        for ( int p = 0; p < 6; ++p ) {
+            const float* P = frustum.planes[ p ];
+            __m256 d = _mm256_fmadd_ps( _mm256_set1_ps( P[0] ), x, _mm256_set1_ps( P[3] ) );
+            d = _mm256_fmadd_ps( _mm256_set1_ps( P[1] ), y, d );
+            d = _mm256_fmadd_ps( _mm256_set1_ps( P[2] ), z, d );
+            inside = _mm256_and_ps( inside, _mm256_cmp_ps( d, negR, _CMP_GE_OQ ) );
+        }
+
+        int mask = _mm256_movemask_ps( inside );
+        for ( int b = 0; b < 8; ++b ) vis[ k + b ] = ( mask >> b ) & 1;
+    }
+#elif defined(__SSE2__)
+    for ( int k = 0; k < padded; k += 4 ) {
+        __m128 x = _mm_loadu_ps( &cx[ k ] );
+        __m128 y = _mm_loadu_ps( &cy[ k ] );
+        __m128 z = _mm_loadu_ps( &cz[ k ] );
+        __m128 negR = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( &r[ k ] ) );
+
+        __m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+        for ( int p = 0; p < 6; ++p ) {
+            const float* P = frustum.planes[ p ];
+            __m128 d = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( P[0] ), x ), _mm_set1_ps( P[3] ) );
+            d = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( P[1] ), y ), d );
+            d = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( P[2] ), z ), d );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps( d, negR ) );
+        }
+
+        int mask = _mm_movemask_ps( inside );
+        for ( int b = 0; b < 4; ++b ) vis[ k + b ] = ( mask >> b ) & 1;
+    }
+#else
+    for ( int k = 0; k < padded; ++k ) {
+        bool inside = true;
+        for ( int p = 0; p < 6 and inside; ++p ) {
+            const float* P = frustum.planes[ p ];
+            inside = P[0] * cx[ k ] + P[1] * cy[ k ] + P[2] * cz[ k ] + P[3] >= -r[ k ];
+        }
+        vis[ k ] = inside;
+    }
+#endif
+
+    visibleCount = 0;
+    for ( int k = 0; k < n; ++k ) visibleCount += vis[ k ];
+    return visibleCount;
+}
+
+
+void FrustumCuller::measure( const Eigen::Matrix4f& viewModel, float focalPixels )
+{
+    int padded = cx.size();
+    const Eigen::Matrix4f& M = viewModel;
+    float radiusScale = focalPixels * M.block<3, 1>( 0, 0 ).norm();
+    const float minDistance = 1e-6f;
+
+#if defined(__AVX2__)
+    for ( int k = 0; k < padded; k += 8 ) {
+        __m256 x = _mm256_loadu_ps( &cx[ k ] );
+        __m256 y = _mm256_loadu_ps( &cy[ k ] );
+        __m256 z = _mm256_loadu_ps( &cz[ k ] );
+
+        __m256 d2 = _mm256_setzero_ps();
+        for ( int row = 0; row < 3; ++row ) {
+            __m256 v = _mm256_fmadd_ps( _mm256_set1_ps( M( row, 0 ) ), x, _mm256_set1_ps( M( row, 3 ) ) );
+            v = _mm256_fmadd_ps( _mm256_set1_ps( M( row, 1 ) ), y, v );
+            v = _mm256_fmadd_ps( _mm256_set1_ps( M( row, 2 ) ), z, v );
+            d2 = _mm256_fmadd_ps( v, v, d2 );
+        }
+        __m256 d = _mm256_max_ps( _mm256_sqrt_ps( d2 ), _mm256_set1_ps( minDistance ) );
+        __m256 s = _mm256_div_ps( _mm256_mul_ps( _mm256_set1_ps( radiusScale ), _mm256_loadu_ps( &r[ k ] ) ), d );
+        _mm256_storeu_ps( &dist[ k ], d );
+        _mm256_storeu_ps( &screen[ k ], s );
+    }
+#elif defined(__SSE2__)
+    for ( int k = 0; k < padded; k += 4 ) {
+        __m128 x = _mm_loadu_ps( &cx[ k ] );
+        __m128 y = _mm_loadu_ps( &cy[ k ] );
+        __m128 z = _mm_loadu_ps( &cz[ k ] );
+
+        __m128 d2 = _mm_setzero_ps();
+        for ( int row = 0; row < 3; ++row ) {
+            __m128 v = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( M( row, 0 ) ), x ), _mm_set1_ps( M( row, 3 ) ) );
+            v = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( M( row, 1 ) ), y ), v );
+            v = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( M( row, 2 ) ), z ), v );
+            d2 = _mm_add_ps( _mm_mul_ps( v, v ), d2 );
+        }
+        __m128 d = _mm_max_ps( _mm_sqrt_ps( d2 ), _mm_set1_ps( minDistance ) );
+        __m128 s = _mm_div_ps( _mm_mul_ps( _mm_set1_ps( radiusScale ), _mm_loadu_ps( &r[ k ] ) ), d );
+        _mm_storeu_ps( &dist[ k ], d );
+        _mm_storeu_ps( &screen[ k ], s );
+    }
+#else
+    for ( int k = 0; k < padded; ++k ) {
+        float d2 = 0.0f;
+        for ( int row = 0; row < 3; ++row ) {
+            float v = M( row, 0 ) * cx[ k ] + M( row, 1 ) * cy[ k ] + M( row, 2 ) * cz[ k ] + M( row, 3 );
+            d2 += v * v;
+        }
+        dist[ k ] = std::max( std::sqrt( d2 ), minDistance );
+        screen[ k ] = radiusScale * r[ k ] / dist[ k ];
+    }
+#endif
+}
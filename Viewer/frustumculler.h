@@ -0,0 +1,94 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <eigen3/Eigen/Geometry>
+
+
+/**
+ * @brief The Frustum struct The six planes (a, b, c, d) of a clip matrix,
+ * normalized so a x + b y + c z + d is a signed distance. Points inside have
+ * every distance >= 0.
+ */
+struct Frustum
+{
+    float planes[ 6 ][ 4 ];
+
+    /**
+     * @brief extract Gribb-Hartmann extraction from projection * view * model.
+     * The planes live in the space the matrix is applied to.
+     */
+    void extract( const Eigen::Matrix4f& clip );
+
+    /**
+     * @brief sphereVisible Scalar test of one sphere.
+     */
+    bool sphereVisible( float x, float y, float z, float r ) const {
+        for ( int p = 0; p < 6; ++p )
+            if ( planes[ p ][0] * x + planes[ p ][1] * y + planes[ p ][2] * z + planes[ p ][3] < -r ) return false;
+        return true;
+    }
+};
+
+
+/**
+ * @brief The FrustumCuller class Bounding spheres stored as structure of
+ * arrays and tested against a frustum in batches (8 wide with AVX2, 4 wide
+ * with SSE2, scalar otherwise). The same batches also measure the view
+ * distance and projected size of every sphere, kept in a per-sphere table
+ * for LOD selection.
+ */
+class FrustumCuller
+{
+public:
+    FrustumCuller();
+
+    /**
+     * @brief resize Sets the number of spheres; all start as a point at the
+     * origin.
+     */
+    void resize( int n );
+
+    void setSphere( int k, float x, float y, float z, float radius ) {
+        cx[ k ] = x; cy[ k ] = y; cz[ k ] = z; r[ k ] = radius;
+    }
+
+    /**
+     * @brief cull Tests every sphere against the frustum.
+     * @return Number of visible spheres.
+     */
+    int cull( const Frustum& frustum );
+
+    bool visible( int k ) const { return vis[ k ] != 0; }
+
+    /**
+     * @brief measure Computes the distance to the eye and the projected
+     * radius of every sphere. viewModel takes the sphere space to view space
+     * (with at most a uniform scale), focalPixels is the viewport height over
+     * 2 tan( fovy / 2 ).
+     */
+    void measure( const Eigen::Matrix4f& viewModel, float focalPixels );
+
+    float distance( int k ) const { return dist[ k ]; }
+    float screenRadius( int k ) const { return screen[ k ]; }
+
+    /**
+     * @brief hide Marks sphere k as not visible (e.g. rejected by another test).
+     */
+    void hide( int k ) { visibleCount -= vis[ k ]; vis[ k ] = 0; }
+
+    int size() const { return n; }
+    int numVisible() const { return visibleCount; }
+
+private:
+    // Padded to a multiple of 8 so the batch loop needs no tail
+    std::vector<float> cx, cy, cz, r;
+    std::vector<uint8_t> vis;
+    std::vector<float> dist, screen;
+    int n;
+    int visibleCount;
+};
+
+#endif // FRUSTUMCULLER_H
@@ -0,0 +1,200 @@
+#include "geometryarena.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+#define ARENA_MIN_VERTICES ( 1 << 16 )
+#define ARENA_MIN_INDICES  ( 1 << 18 )
+
+
+RangeAllocator::RangeAllocator() : capacity_( 0 ), used_( 0 )
+{
+}
+
+
+long RangeAllocator::allocate( long n )
+{
+    if ( n == 0 ) return 0;
+
+    for ( auto it = free_.begin(); it != free_.end(); ++it ) {
+        if ( it->second < n ) continue;
+
+        long first = it->first;
+        long rest = it->second - n;
+        free_.erase( it );
+        if ( rest > 0 ) free_[ first + n ] = rest;
+        used_ += n;
+        return first;
+    }
+    return -1;
+}
+
+
+void RangeAllocator::release( long first, long n )
+{
+    if ( n == 0 ) return;
+    used_ -= n;
+
+    auto next = free_.lower_bound( first );
+
+    // Merge with the following free range
+    if ( next != free_.end() and next->first == first + n ) {
+        n += next->second;
+        next = free_.erase( next );
+    }
+
+    // Merge with the preceding one
+    if ( next != free_.begin() ) {
+        auto prev = std::prev( next );
+        if ( prev->first + prev->second == first ) {
+            prev->second += n;
+            return;
+        }
+    }
+    free_[ first ] = n;
+}
+
+
+void RangeAllocator::grow( long newCapacity )
+{
+    if ( newCapacity <= capacity_ ) return;
+    release( capacity_, newCapacity - capacity_ );
+    used_ += newCapacity - capacity_;   // release() accounted it as freed
+    capacity_ = newCapacity;
+}
+
+
+
+GeometryArena::GeometryArena( GLuint vertexAttrib, GLuint normalAttrib )
+    : vertexAttrib_( vertexAttrib ), normalAttrib_( normalAttrib ), vao_( 0 ), vbo_( 0 ), ibo_( 0 )
+{
+}
+
+
+GeometryArena::~GeometryArena()
+{
+    if ( vao_ != 0 ) {
+        glDeleteVertexArrays( 1, &vao_ );
+        glDeleteBuffers( 1, &vbo_ );
+        glDeleteBuffers( 1, &ibo_ );
+    }
+}
+
+
+void GeometryArena::init()
+{
+    glGenVertexArrays( 1, &vao_ );
+    glGenBuffers( 1, &vbo_ );
+    glGenBuffers( 1, &ibo_ );
+}
+
+
+void GeometryArena::growBuffer( GLuint& buffer, size_t oldBytes, size_t newBytes )
+{
+    GLuint grown;
+    glGenBuffers( 1, &grown );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, grown );
+    glBufferData( GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW );
+
+    if ( oldBytes > 0 ) {
+        glBindBuffer( GL_COPY_READ_BUFFER, buffer );
+        glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes );
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    }
+    glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+    glDeleteBuffers( 1, &buffer );
+    buffer = grown;
+}
+
+
+void GeometryArena::reserve( long vertices, long indices )
+{
+    if ( vao_ == 0 ) init();
+
+    bool changed = false;
+    if ( vertices > vertices_.capacity() ) {
+        long cap = std::max( { vertices, 2 * vertices_.capacity(), (long) ARENA_MIN_VERTICES } );
+        growBuffer( vbo_, vertices_.capacity() * 6 * sizeof( float ), cap * 6 * sizeof( float ) );
+        vertices_.grow( cap );
+        changed = true;
+    }
+    if ( indices > indices_.capacity() ) {
+        long cap = std::max( { indices, 2 * indices_.capacity(), (long) ARENA_MIN_INDICES } );
+        growBuffer( ibo_, indices_.capacity() * sizeof( GLuint ), cap * sizeof( GLuint ) );
+        indices_.grow( cap );
+        changed = true;
+    }
+    if ( not changed ) return;
+
+    // The VAO still points at the old buffers
+    glBindVertexArray( vao_ );
+    glBindBuffer( GL_ARRAY_BUFFER, vbo_ );
+    glVertexAttribPointer( vertexAttrib_, 3, GL_FLOAT, GL_FALSE, 6 * sizeof( float ), (const GLvoid*) 0 );
+    glEnableVertexAttribArray( vertexAttrib_ );
+    glVertexAttribPointer( normalAttrib_, 3, GL_FLOAT, GL_FALSE, 6 * sizeof( float ), (const GLvoid*) ( 3 * sizeof( float ) ) );
+    glEnableVertexAttribArray( normalAttrib_ );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo_ );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+
+ArenaRange GeometryArena::upload( const std::vector<float>& vtx, const std::vector<float>& normals, const std::vector<int>& faces )
+{
+    long numVertices = vtx.size() / 3;
+    long numIndices = faces.size();
+
+    long v = vertices_.allocate( numVertices );
+    if ( v < 0 ) {
+        reserve( vertices_.capacity() + numVertices, 0 );
+        v = vertices_.allocate( numVertices );
+    }
+    long f = indices_.allocate( numIndices );
+    if ( f < 0 ) {
+        reserve( 0, indices_.capacity() + numIndices );
+        f = indices_.allocate( numIndices );
+    }
+
+    ArenaRange range;
+    range.firstIndex = f;
+    range.indexCount = numIndices;
+    range.baseVertex = v;
+    range.vertexCount = numVertices;
+    if ( numVertices == 0 and numIndices == 0 ) return range;
+
+    std::vector<float> interleaved( 6 * numVertices );
+    for ( long i = 0; i < numVertices; ++i ) {
+        std::copy( &vtx[ 3*i ], &vtx[ 3*i ] + 3, &interleaved[ 6*i ] );
+        std::copy( &normals[ 3*i ], &normals[ 3*i ] + 3, &interleaved[ 6*i + 3 ] );
+    }
+
+    // Write through the copy target so no VAO binding is touched
+    glBindBuffer( GL_COPY_WRITE_BUFFER, vbo_ );
+    glBufferSubData( GL_COPY_WRITE_BUFFER, v * 6 * sizeof( float ), interleaved.size() * sizeof( float ), interleaved.data() );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, ibo_ );
+    glBufferSubData( GL_COPY_WRITE_BUFFER, f * sizeof( GLuint ), numIndices * sizeof( GLuint ), faces.data() );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+    return range;
+}
+
+
+void GeometryArena::release( const ArenaRange& range )
+{
+    vertices_.release( range.baseVertex, range.vertexCount );
+    indices_.release( range.firstIndex, range.indexCount );
+}
+
+
+size_t GeometryArena::gpuBytes() const
+{
+    return vertices_.capacity() * 6 * sizeof( float ) + indices_.capacity() * sizeof( GLuint );
+}
+
+
+size_t GeometryArena::usedBytes() const
+{
+    return vertices_.used() * 6 * sizeof( float ) + indices_.used() * sizeof( GLuint );
+}
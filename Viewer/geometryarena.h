@@ -0,0 +1,124 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+
+/**
+ * @brief The ArenaRange struct Where one mesh (one LOD level) lives inside the
+ * arena, in the units glDrawElements*BaseVertex and the indirect commands use.
+ */
+struct ArenaRange
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLint baseVertex;
+    GLuint vertexCount;
+};
+
+
+/**
+ * @brief The DrawElementsIndirectCommand struct Layout read by
+ * glMultiDrawElementsIndirect.
+ */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+
+/**
+ * @brief The RangeAllocator class First-fit allocator of element ranges with
+ * coalescing of freed neighbours. It does not own any memory.
+ */
+class RangeAllocator
+{
+public:
+    RangeAllocator();
+
+    /**
+     * @brief allocate Returns the first element of a free range of n
+     * elements, or -1 if none is large enough.
+     */
+    long allocate( long n );
+    void release( long first, long n );
+
+    /**
+     * @brief grow Appends elements at the end of the managed space.
+     */
+    void grow( long newCapacity );
+
+    long capacity() const { return capacity_; }
+    long used() const { return used_; }
+
+private:
+    std::map< long, long > free_;   // first -> size
+    long capacity_;
+    long used_;
+};
+
+
+/**
+ * @brief The GeometryArena class One interleaved vertex buffer (position,
+ * normal) and one index buffer shared by every level of every model, with a
+ * single VAO. Indices stay local to their mesh and are offset with the base
+ * vertex at draw time. Buffers grow by copying on the GPU; released ranges are
+ * reused.
+ */
+class GeometryArena
+{
+public:
+    GeometryArena( GLuint vertexAttrib, GLuint normalAttrib );
+    ~GeometryArena();
+
+    GeometryArena( const GeometryArena& ) = delete;
+    GeometryArena& operator=( const GeometryArena& ) = delete;
+
+    /**
+     * @brief upload Interleaves and stores one mesh. vtx and normals hold 3
+     * floats per vertex, faces 3 local indices per triangle. Needs a current GL
+     * context.
+     */
+    ArenaRange upload( const std::vector<float>& vtx, const std::vector<float>& normals, const std::vector<int>& faces );
+
+    /**
+     * @brief release Gives a range back to the arena.
+     */
+    void release( const ArenaRange& range );
+
+    /**
+     * @brief vao The arena VAO, with the vertex and index buffers bound.
+     */
+    GLuint vao() const { return vao_; }
+
+    /**
+     * @brief gpuBytes Bytes allocated on the GPU, and bytes in use.
+     */
+    size_t gpuBytes() const;
+    size_t usedBytes() const;
+
+private:
+    void init();
+    void reserve( long vertices, long indices );
+    static void growBuffer( GLuint& buffer, size_t oldBytes, size_t newBytes );
+
+    GLuint vertexAttrib_;
+    GLuint normalAttrib_;
+
+    GLuint vao_;
+    GLuint vbo_;
+    GLuint ibo_;
+
+    RangeAllocator vertices_;
+    RangeAllocator indices_;
+};
+
+#endif // GEOMETRYARENA_H
@@ -2,12 +2,14 @@
 
 #include "glwidget.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
 
-#include "./mesh_io.h"
 #include "./triangle_mesh.h"
 #include "./vertexclustering.h"
 
@@ -21,36 +23,48 @@ const double kZFar = 100;
 
 int totalFrames;
 
+// Seconds of camera path time per replayed frame
+const double kReplayStep = 1.0 / 60.0;
+
+// Keys returned by GLWidget::scheduleKeys
+const int kScheduleUp = 1;
+const int kScheduleDown = 2;
+
+// Relative change of view distance that makes GLWidget::updateSchedule
+// recompute the keys of an instance while the camera moves
+const float kScheduleDistanceTolerance = 0.02f;
+
 const char kPhongVertexShaderFile[] = "../shaders/phong.vert";
 const char kPhongFragmentShaderFile[] = "../shaders/phong.frag";
+const char kBoxVertexShaderFile[] = "../shaders/box.vert";
+const char kBoxFragmentShaderFile[] = "../shaders/box.frag";
 
 const int kVertexAttributeIdx = 0;
 const int kNormalAttributeIdx = 1;
+const int kInstanceAttributeIdx = 2;
 
-const GLfloat quadVertices[] = { // 3D positions of the quads in NDC
-// Vtx coord in XYZ      UV texture pos
- -1.0f, -1.0f,  0.0f,     0.0f,  0.0f,
- -1.0f,  1.0f,  0.0f,     0.0f,  1.0f,
-  1.0f, -1.0f,  0.0f,     1.0f,  0.0f,
-  1.0f,  1.0f,  0.0f,     1.0f,  1.0f
-};
+// Attributes of the occlusion query box program
+const int kBoxCornerAttributeIdx = 0;
+const int kBoxMinAttributeIdx = 1;
+const int kBoxMaxAttributeIdx = 2;
 
+const char kImpostorVertexShaderFile[] = "../shaders/impostor.vert";
+const char kImpostorFragmentShaderFile[] = "../shaders/impostor.frag";
+const char kImpostorBakeVertexShaderFile[] = "../shaders/impostor_bake.vert";
+const char kImpostorBakeFragmentShaderFile[] = "../shaders/impostor_bake.frag";
 
-const GLubyte quadIndices[] = { // indices per quad
-  //0, 1, 2,      3, 2, 1
-    1, 0, 2,      2, 3, 1
-};
+// Attribute of the impostor quad corners
+const int kCornerAttributeIdx = 0;
 
 
+#define INITIAL_TRI_BUDGET 1000000
+#define TARGET_FRAME_MS 16.6
+#define MAX_INSTANCE_LOD 5       // instances draw levels 0..MAX_INSTANCE_LOD
+#define MIN_SCREEN_RADIUS 0.5f   // pixels; smaller instances are culled
+#define HIZ_MAX_OCCLUDERS 32     // instances rasterized as Hi-Z occluders
+#define IMPOSTOR_SCREEN_RADIUS 16.0f   // pixels; smaller instances are drawn as impostors
 
 
-#define MAX_TRI_PER_FRAME 1000000
-
-/*** FRAMERATE ***/
-int FPS = 0;
-time_t iniTime;
-time_t endTime;
-
 bool ReadFile(const std::string filename, std::string *shader_source) {
   std::ifstream infile(filename.c_str());
 
@@ -88,96 +102,158 @@ bool LoadProgram(const std::string &vertex, const std::string &fragment, QOpenGL
 }  // namespace
 
 
-// Vertex clustering LoD manager.
-static VertexClustering LOD;
-
-//std::vector< std::vector < std::vector <int> > > modelInstanceLOD( 3, std::vector<int>( 20, std::vector<int>(20) ) );
-//std::vector< std::vector < std::vector <int> > > modelFrameLOD(    3, std::vector<int>( 20, std::vector<int>(20) ) );
-std::vector < std::vector < int > > modelInstanceLOD( 50, std::vector<int>(50) );
-std::vector < std::vector < int > > modelFrameLOD(    50, std::vector<int>(50) );
-
-
 GLWidget::GLWidget(QWidget *parent)
-    : QGLWidget(parent), initialized_(false), width_(0.0), height_(0.0),
-      triSum_(0), num_instances(1), dist_offset(1.0), myLod(0), hyst_( false ),
-      my_method( "Mean" ), file("../models/sphere.ply")
+    : QGLWidget(parent),
+      batcher_(kInstanceAttributeIdx),
+      impostors_(kCornerAttributeIdx, kInstanceAttributeIdx),
+      impostors_enabled_(false),
+      walls_(kVertexAttributeIdx, kNormalAttributeIdx, kInstanceAttributeIdx),
+      assets_(kVertexAttributeIdx, kNormalAttributeIdx),
+      myLod(0),
+      num_instances(1),
+      my_method("Mean"),
+      dist_offset(1.0),
+      initialized_(false),
+      width_(0.0),
+      height_(0.0),
+      schedule_scale_(1.0f),
+      schedule_dirty_(true),
+      knapsack_(false),
+      budget_(TARGET_FRAME_MS, INITIAL_TRI_BUDGET),
+      gpu_ms_(0.0),
+      stats_frames_(0),
+      recording_active_(false),
+      replay_frame_(0),
+      replaying_(false),
+      pvs_ready_(false),
+      pvs_cancel_(false),
+      portal_culling_(false),
+      occlusion_(kBoxCornerAttributeIdx, kBoxMinAttributeIdx, kBoxMaxAttributeIdx),
+      occlusion_queries_(false),
+      hiz_culling_(false),
+      triSum_(0),
+      hyst_(false),
+      free_cpu_lods_(true)
 {
   setFocusPolicy(Qt::StrongFocus);
-  iniTime = time( NULL );
-  VAO = std::vector< GLuint >(10);
-  vbo_v_id = std::vector< GLuint >(10);
-  vbo_n_id = std::vector< GLuint >(10);
-  faces_id = std::vector< GLuint >(10);
+  stats_timer_.begin();
+  models_.resize(kMaxSlots);
+  files_.resize(kMaxSlots);
+}
 
+GLWidget::~GLWidget() {
+  StopPvs();
 
+  // The assets delete their GPU buffers, so they must go with the context current
+  makeCurrent();
+  active_.clear();
+  models_.clear();
 }
 
-GLWidget::~GLWidget() {}
+void GLWidget::CacheUniforms() {
+  projection_location_ = phong_program_->uniformLocation("projection");
+  view_location_ = phong_program_->uniformLocation("view");
+  model_location_ = phong_program_->uniformLocation("model");
+  normal_matrix_location_ = phong_program_->uniformLocation("normal_matrix");
+  mesh_position_location_ = phong_program_->uniformLocation("meshPosition");
+
+  box_projection_location_ = box_program_->uniformLocation("projection");
+  box_view_location_ = box_program_->uniformLocation("view");
+  box_model_location_ = box_program_->uniformLocation("model");
+
+  impostor_projection_location_ = impostor_program_->uniformLocation("projection");
+  impostor_view_location_ = impostor_program_->uniformLocation("view");
+  impostor_model_location_ = impostor_program_->uniformLocation("model");
+  impostor_normal_matrix_location_ = impostor_program_->uniformLocation("normal_matrix");
+  impostor_center_location_ = impostor_program_->uniformLocation("center");
+  impostor_radius_location_ = impostor_program_->uniformLocation("radius");
+  impostor_right_location_ = impostor_program_->uniformLocation("camera_right");
+  impostor_up_location_ = impostor_program_->uniformLocation("camera_up");
+  impostor_eye_location_ = impostor_program_->uniformLocation("eye");
+  impostor_color_atlas_location_ = impostor_program_->uniformLocation("color_atlas");
+  impostor_normal_depth_atlas_location_ = impostor_program_->uniformLocation("normal_depth_atlas");
+
+  // Texture units of the atlases, fixed for the life of the program
+  impostor_program_->bind();
+  glUniform1i(impostor_color_atlas_location_, 0);
+  glUniform1i(impostor_normal_depth_atlas_location_, 1);
+  impostor_program_->release();
+}
 
 bool GLWidget::LoadModel(const QString &filename, int slot) {
-  /*std::string*/ file = filename.toUtf8().constData();
-  size_t pos = file.find_last_of(".");
-  std::string type = file.substr(pos + 1);
+  if (slot < 0 || slot >= kMaxSlots) return false;
 
-  std::unique_ptr<data_representation::TriangleMesh> mesh =
-      std::make_unique<data_representation::TriangleMesh>();
+  std::string file = filename.toUtf8().constData();
 
-  bool res = false;
-  if (type.compare("ply") == 0) {
-    res = data_representation::ReadFromPly(file, mesh.get());
-  }
+  makeCurrent();
+  std::shared_ptr<LODAsset> asset = assets_.acquire(file, my_method);
+  if (!asset) return false;
 
-  if (res) {
-    mesh_.reset(mesh.release());
-    camera_.UpdateModel(mesh_->min_, mesh_->max_);
-
-    int N = LOD.buildCluster( mesh_->vertices_, mesh_->faces_, mesh_->normals_,   mesh_->min_, mesh_->max_, my_method );
-
-    // TODO(students): Create / Initialize buffers.
-    for (int i = 0; i < N; ++i) {
-        // Create & bind empty VAO
-        glGenVertexArrays(1, &VAO[i]);
-        glBindVertexArray(VAO[i]);
+  models_[slot] = asset;
+  files_[slot] = file;
 
-        // Initialize VBO for vertices
-        glGenBuffers(1, &vbo_v_id[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_v_id[i]);
-        glBufferData(GL_ARRAY_BUFFER, LOD.vtxPerLOD[i].size() * sizeof(float), &LOD.vtxPerLOD[i][0], GL_STATIC_DRAW);
-        glVertexAttribPointer(kVertexAttributeIdx, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(kVertexAttributeIdx);
+  active_.clear();
+  for (auto &m : models_)
+    if (m) active_.push_back(m.get());
 
+  if (slot == 0) camera_.UpdateModel(asset->mesh->min_, asset->mesh->max_);
 
-        // Initialize VBO for normals
-        glGenBuffers(1, &vbo_n_id[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_n_id[i]);
-        glBufferData(GL_ARRAY_BUFFER, LOD.normPerLOD[i].size() * sizeof(float), &LOD.normPerLOD[i][0], GL_STATIC_DRAW);
-        glVertexAttribPointer(kNormalAttributeIdx, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(kNormalAttributeIdx);
+  cluster_stats_ = asset->stats;
+  emit SetBuildStats( QString( cluster_stats_.summary().c_str() ) );
+  std::cout << assets_.alive() << " assets alive, " << assets_.loads() << " files loaded" << std::endl;
 
-        glBindVertexArray(0);
+  return true;
+}
 
-        // Initialize VBO for faces
-        glGenBuffers(1, &faces_id[i]);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_id[i]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, LOD.facesPerLOD[i].size() * sizeof(int), &LOD.facesPerLOD[i][0], GL_STATIC_DRAW);
+bool GLWidget::LoadMap(const QString &filename) {
+  std::string file = filename.toUtf8().constData();
+
+  // The PVS thread reads map_
+  StopPvs();
+  if (!map_.loadMap(file)) return false;
+
+  // The PVS is cached next to the map and recomputed if the map changed, on
+  // its own thread
+  pvs_.clear();
+  pvs_thread_ = std::thread([this, file]() {
+    pvs_pending_.loadOrCompute(file + ".pvs", map_, &pvs_cancel_);
+    pvs_ready_ = true;
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+  });
+  portals_.build(map_);
+  std::cout << portals_.numRooms() << " rooms, " << portals_.numPortals() << " portals" << std::endl;
+
+  makeCurrent();
+  walls_.build(map_, dist_offset);
+  std::cout << walls_.triangles() << " wall triangles in " << walls_.numChunks() << " chunks ("
+            << walls_.naiveTriangles() << " as boxes)" << std::endl;
+
+  PlaceInstances();
+  return true;
+}
 
-    }
-    // END.
-
-    /*modelInstanceLOD.clear();
-    modelInstanceLOD.push_back( std::vector< int > ( num_instances ) );
-    for (int i = 0; i < num_instances; ++i) {
-        modelInstanceLOD[i].push_back( num_instances );
-        for (int j = 0; j < num_instances; ++j) {
-            modelInstanceLOD[i][j] = -1;
-        }
-    }*/
+void GLWidget::StopPvs() {
+  if (pvs_thread_.joinable()) {
+    pvs_cancel_ = true;
+    pvs_thread_.join();
+  }
+  pvs_cancel_ = false;
+  pvs_ready_ = false;
+  pvs_pending_.clear();
+}
 
+void GLWidget::ReloadModels() {
+  std::vector< std::string > files = files_;
 
-    return true;
-  }
+  // Drop everything first so nothing stale stays cached and the memory is
+  // released before loading again; slots sharing a file still load it once
+  makeCurrent();
+  active_.clear();
+  for (auto &m : models_) m.reset();
+  assets_.setFreeCPU( free_cpu_lods_ );
 
-  return false;
+  for (int s = 0; s < kMaxSlots; ++s)
+    if (!files[s].empty()) LoadModel( QString::fromUtf8(files[s].c_str()), s );
 }
 
 void GLWidget::initializeGL() {
@@ -194,9 +270,29 @@ void GLWidget::initializeGL() {
                          phong_program_.get());
   if (!res) exit(0);
 
+  box_program_ = std::make_unique<QOpenGLShaderProgram>();
+  res = LoadProgram(kBoxVertexShaderFile, kBoxFragmentShaderFile,
+                    box_program_.get());
+  if (!res) exit(0);
+
+  impostor_program_ = std::make_unique<QOpenGLShaderProgram>();
+  res = LoadProgram(kImpostorVertexShaderFile, kImpostorFragmentShaderFile,
+                    impostor_program_.get());
+  if (!res) exit(0);
+
+  impostor_bake_program_ = std::make_unique<QOpenGLShaderProgram>();
+  res = LoadProgram(kImpostorBakeVertexShaderFile, kImpostorBakeFragmentShaderFile,
+                    impostor_bake_program_.get());
+  if (!res) exit(0);
+  CacheUniforms();
+
   LoadModel("../models/sphere.ply", 0);
 
+  // Swapped by paintGL, so the swap is timed with the rest of the frame
+  setAutoBufferSwap(false);
+
   totalFrames = 0;
+  PlaceInstances();
   initialized_ = true;
 }
 
@@ -260,16 +356,32 @@ void GLWidget::keyPressEvent(QKeyEvent *event) {
     phong_program_ = std::make_unique<QOpenGLShaderProgram>();
     LoadProgram(kPhongVertexShaderFile, kPhongFragmentShaderFile,
                 phong_program_.get());
+    CacheUniforms();
   }
 
   updateGL();
 }
 
 void GLWidget::paintGL() {
+  profiler_.beginFrame();
+  int lodSwitches = 0;
+
   glClearColor(0.55f, 0.63f, 0.77f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   if (initialized_) {
+    cpu_timer_.begin();
+    gpu_timer_.begin();
+
+    // Replays advance by a fixed step per frame, not by the real time
+    if (replaying_) {
+      double time = replay_frame_++ * kReplayStep;
+      camera_.SetState(replay_.sample(replay_.start() + time));
+      replaying_ = time < replay_.duration();
+    }
+    if (recording_active_)
+      recording_.add(camera_.State(record_timer_.elapsedMs() / 1000.0));
+
     camera_.SetViewport();
 
     Eigen::Matrix4f projection = camera_.SetProjection();
@@ -283,74 +395,95 @@ void GLWidget::paintGL() {
 
     normal = normal.inverse().transpose();
 
-    if (mesh_ != nullptr) {
-      GLint projection_location, view_location, model_location, normal_matrix_location,
-            numinst_location, offset_location, mesh_position, instance_position;
-
-    calculateLevelPerModelInstance( hyst_, model, view, totalFrames );
-
-    triSum_ = 0;
-    int vtxSum = 0;
-
-
-    for ( int i = 0 ; i < num_instances ; ++i) {
-        for ( int j = 0 ; j < num_instances ; ++j) {
-            phong_program_->bind();
-            projection_location = phong_program_->uniformLocation("projection");
-            view_location = phong_program_->uniformLocation("view");
-            model_location = phong_program_->uniformLocation("model");
-            normal_matrix_location = phong_program_->uniformLocation("normal_matrix");
-            numinst_location = phong_program_->uniformLocation("num_instances");
-            offset_location = phong_program_->uniformLocation("offset");
-
-            mesh_position = phong_program_->uniformLocation("meshPosition");
-            instance_position = phong_program_->uniformLocation("myInstance");
-
-
-            glUniformMatrix4fv(projection_location, 1, GL_FALSE, projection.data());
-            glUniformMatrix4fv(view_location, 1, GL_FALSE, view.data());
-            glUniformMatrix4fv(model_location, 1, GL_FALSE, model.data());
-            glUniformMatrix3fv(normal_matrix_location, 1, GL_FALSE, normal.data());
-            glUniform1i(numinst_location, num_instances );
-            glUniform1f(offset_location, dist_offset );
-
-            glUniform3f(mesh_position, 0.0, 0.0, 0.0 );
-            glUniform1i(instance_position, num_instances*i + j );
-
-            // myLod = modelInstanceLOD[0][i][j];
-            myLod = modelInstanceLOD[i][j];
-
-            //  model rendering.
-            glBindVertexArray(VAO[ myLod ]);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_id[ myLod ]);
-
-            glDrawElements(GL_TRIANGLES, LOD.facesPerLOD[ myLod ].size(), GL_UNSIGNED_INT, 0);
-            //glDrawElementsInstanced(GL_TRIANGLES, LOD.facesPerLOD[ myLod ].size(), GL_UNSIGNED_INT, 0, num_instances * num_instances);
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-            glBindVertexArray(0);
-
-            triSum_ += ( LOD.facesPerLOD[ myLod ].size() / 3 );
-            vtxSum  += ( LOD.vtxPerLOD[ myLod ].size()   / 3 );
-
-       }
-     }
+    if (!active_.empty()) {
+    profiler_.begin( FrameProfiler::Culling );
+    CullInstances( projection, view, model );
+
+    // Instances too small on screen for their meshes to matter become
+    // impostors; they leave the LOD selection and its triangle budget
+    impostors_.clear( active_.size() );
+    if ( impostors_enabled_ ) {
+        for ( int k = 0 ; k < (int) instances_.size() ; ++k ) {
+            if ( not culler_.visible( k ) or culler_.screenRadius( k ) >= IMPOSTOR_SCREEN_RADIUS ) continue;
+            const Eigen::Vector3f& offset = instances_[ k ].offset;
+            impostors_.add( slotOf( k ), offset[0], offset[1], offset[2] );
+            culler_.hide( k );
+        }
+    }
+    profiler_.end( FrameProfiler::Culling );
+
+    profiler_.begin( FrameProfiler::LODSelection );
+    if ( knapsack_ ) selectLevelsKnapsack( model, view );
+    else calculateLevelPerModelInstance( hyst_, model, view, totalFrames );
+    profiler_.end( FrameProfiler::LODSelection );
+
+    // Instances that changed level, for the frame log
+    last_levels_.resize( instances_.size(), 0 );
+    for ( size_t k = 0 ; k < instances_.size() ; ++k ) {
+        lodSwitches += last_levels_[ k ] != modelInstanceLOD[ k ];
+        last_levels_[ k ] = modelInstanceLOD[ k ];
+    }
 
+    profiler_.begin( FrameProfiler::DrawSubmission );
+    phong_program_->bind();
+    glUniformMatrix4fv(projection_location_, 1, GL_FALSE, projection.data());
+    glUniformMatrix4fv(view_location_, 1, GL_FALSE, view.data());
+    glUniformMatrix4fv(model_location_, 1, GL_FALSE, model.data());
+    glUniformMatrix3fv(normal_matrix_location_, 1, GL_FALSE, normal.data());
+    glUniform3f(mesh_position_location_, 0.0, 0.0, 0.0 );
+
+    // Visible instances, drawn grouped by (slot, LOD)
+    batcher_.clear( active_.size(), active_[0]->numLevels );
+    for ( int k = 0 ; k < (int) instances_.size() ; ++k ) {
+        if ( not culler_.visible( k ) ) continue;
+        const Eigen::Vector3f& offset = instances_[ k ].offset;
+        batcher_.add( slotOf( k ), modelInstanceLOD[ k ], offset[0], offset[1], offset[2] );
+    }
+    batcher_.draw( active_, assets_.arena() );
+
+    // Walls with the same program, chunks out of the frustum skipped
+    Frustum frustum;
+    frustum.extract( projection * view * model );
+    walls_.draw( frustum );
+
+    if ( impostors_enabled_ ) DrawImpostors( projection, view, model, normal );
+
+    // Everything drawn counts against the budget, the walls included
+    triSum_ = batcher_.triangles() + 2 * impostors_.instances() + walls_.drawnTriangles();
+    int vtxSum = batcher_.vertices() + 4 * impostors_.instances() + 2 * walls_.drawnTriangles();   // walls are quads
+
+    // Boxes of the instances to test, against the depth of what was drawn;
+    // their results are read in a later frame
+    if ( occlusion_queries_ ) {
+        box_program_->bind();
+        glUniformMatrix4fv(box_projection_location_, 1, GL_FALSE, projection.data());
+        glUniformMatrix4fv(box_view_location_, 1, GL_FALSE, view.data());
+        glUniformMatrix4fv(box_model_location_, 1, GL_FALSE, model.data());
+        occlusion_.issueQueries();
+    }
+    profiler_.end( FrameProfiler::DrawSubmission );
 
       emit SetFaces(    QString( std::to_string( triSum_ ).c_str() ) );
       emit SetVertices( QString( std::to_string( vtxSum ).c_str() ) );
       // END.
     }
     
-    // Framerate counter
-    ++FPS;
+    // Slowest of CPU and GPU drives the triangle budget of the next frames.
+    // The GPU time comes from an earlier frame, when it is there at all.
+    // Replays keep the budget pinned, so they select the same levels on
+    // every run whatever the frame times.
+    gpu_timer_.end();
+    double cpuMs = cpu_timer_.elapsedMs();
+    gpu_timer_.poll( &gpu_ms_ );
+    if ( not replaying_ ) budget_.update( std::max( cpuMs, gpu_ms_ ) );
+
+    std::ostringstream times;
+    times.precision( 1 );
+    times << std::fixed << cpuMs << " / " << gpu_ms_;
+    emit SetBudget( QString( std::to_string( (int) budget_.budget() ).c_str() ) );
+    emit SetFrameTime( QString( times.str().c_str() ) );
+
     ++totalFrames;
-    endTime = time( NULL );
-    if ( endTime > iniTime ) {
-        emit SetFramerate(QString( std::to_string( FPS / (endTime - iniTime) ).c_str() ));
-        iniTime = endTime;
-        FPS = 0;
-    }
 
     model = camera_.SetIdentity();
 
@@ -365,142 +498,388 @@ void GLWidget::paintGL() {
     }
     */
   }
+
+  profiler_.begin( FrameProfiler::Swap );
+  swapBuffers();
+  profiler_.end( FrameProfiler::Swap );
+  profiler_.endFrame( lodSwitches, triSum_ );
+
+  // Framerate and frame time stats, once per second
+  ++stats_frames_;
+  double elapsed = stats_timer_.elapsedMs();
+  if ( elapsed >= 1000.0 ) {
+      std::ostringstream fps;
+      fps.precision( 1 );
+      fps << std::fixed << stats_frames_ * 1000.0 / elapsed;
+      emit SetFramerate( QString( fps.str().c_str() ) );
+      emit SetFrameStats( QString( profiler_.summary( 2 * budget_.target() ).c_str() ) );
+      stats_timer_.begin();
+      stats_frames_ = 0;
+  }
+
+  if (replaying_) update();
 }
 
 
 
+bool GLWidget::ExportFrameTimes(const QString &filename) {
+  return profiler_.exportCsv( filename.toUtf8().constData() );
+}
 
+void GLWidget::StartRecording() {
+  recording_.clear();
+  record_timer_.begin();
+  recording_active_ = true;
+  updateGL();
+}
+
+bool GLWidget::StopRecording(const QString &filename) {
+  recording_active_ = false;
+  if (filename.isEmpty() || recording_.empty()) return filename.isEmpty();
+  return recording_.save( filename.toUtf8().constData() );
+}
+
+bool GLWidget::ReplayCameraPath(const QString &filename) {
+  if (!replay_.load( filename.toUtf8().constData() )) return false;
+
+  // Same starting state on every replay: levels from scratch, budget pinned
+  ResetSelection();
+  budget_.reset(INITIAL_TRI_BUDGET);
+  replay_frame_ = 0;
+  replaying_ = true;
+  updateGL();
+  return true;
+}
 
-int GLWidget::getContribution( Eigen::Matrix4f& model, Eigen::Matrix4f& view, int& i, int& j, int OFFSET ) {
-    // Get diagonal
-    Eigen::Vector3f diagVec = mesh_->max_ - mesh_->min_ ;
-    float d = diagVec.norm();
 
 
-    float Xcoord = mesh_->max_[0];
-    //Get viewpoint distance
-    Eigen::Affine3f tV( Eigen::Translation3f( Eigen::Vector3f(
-       2*Xcoord*float( i ) - ( num_instances / ( 2*Xcoord ) ),
-       0,
-       2*Xcoord*float( j ) - ( num_instances / ( 2*Xcoord ) )
-    )));
-    Eigen::Matrix4f mtx = tV.matrix();
-    mtx = model * mtx;
 
-    Eigen::Vector3f diagCtr = diagVec / 2;
-    Eigen::Vector4f viewCtr (diagCtr[0], diagCtr[1], diagCtr[2], 1.0f); // center coordinates in Vec4 ....
-                    viewCtr = view * mtx * viewCtr;                     // ... into view position
-    Eigen::Vector3f Ctr( viewCtr[0], viewCtr[1], viewCtr[2] );
 
-    float bigD = Ctr.norm();
+void GLWidget::DrawImpostors( const Eigen::Matrix4f& projection, const Eigen::Matrix4f& view, const Eigen::Matrix4f& model, const Eigen::Matrix3f& normal ) {
+    // Atlases are baked the first time their asset is drawn as impostor
+    std::vector< const ImpostorAtlas* > atlases;
+    for ( LODAsset* asset : active_ ) {
+        if ( not asset->impostor ) {
+            impostor_bake_program_->bind();
+            asset->bakeImpostor( impostor_bake_program_->programId() );
+        }
+        atlases.push_back( asset->impostor.get() );
+    }
 
+    // View axes and eye in the space of the instance offsets
+    Eigen::Matrix4f viewModel = view * model;
+    Eigen::Vector3f right = viewModel.block<1, 3>(0, 0).transpose().normalized();
+    Eigen::Vector3f up = viewModel.block<1, 3>(1, 0).transpose().normalized();
+    Eigen::Vector4f eye = viewModel.inverse() * Eigen::Vector4f( 0, 0, 0, 1 );
+
+    impostor_program_->bind();
+    glUniformMatrix4fv(impostor_projection_location_, 1, GL_FALSE, projection.data());
+    glUniformMatrix4fv(impostor_view_location_, 1, GL_FALSE, view.data());
+    glUniformMatrix4fv(impostor_model_location_, 1, GL_FALSE, model.data());
+    glUniformMatrix3fv(impostor_normal_matrix_location_, 1, GL_FALSE, normal.data());
+    glUniform3fv(impostor_right_location_, 1, right.data());
+    glUniform3fv(impostor_up_location_, 1, up.data());
+    glUniform3f(impostor_eye_location_, eye[0] / eye[3], eye[1] / eye[3], eye[2] / eye[3]);
+
+    impostors_.draw( atlases, impostor_center_location_, impostor_radius_location_ );
+}
 
-    // Geometry size is implicit
-    int L = modelInstanceLOD[i][j] + OFFSET;
 
-    float myContribution = d / ( float( 2 << L ) * bigD );
-          myContribution = d / ( pow( 2 , L ) * bigD );
-    return myContribution;
+
+void GLWidget::WallBox( int row, int col, Eigen::Vector3f *lo, Eigen::Vector3f *hi ) const {
+    float half = dist_offset / 2;
+    *lo = Eigen::Vector3f( col * dist_offset - half, -half, row * dist_offset - half );
+    *hi = Eigen::Vector3f( col * dist_offset + half,  half, row * dist_offset + half );
 }
 
 
 
-std::pair<int, int> GLWidget::getMinPosition( Eigen::Matrix4f& model, Eigen::Matrix4f& view ) {
-    std::pair<int, int> myPair{ -1, -1 };
-    int MIN_COST = 10;
+void GLWidget::CullInstances( const Eigen::Matrix4f& projection, const Eigen::Matrix4f& view, const Eigen::Matrix4f& model ) {
+    int n = instances_.size();
+    if ( culler_.size() != n ) culler_.resize( n );
+    if ( occlusion_queries_ and occlusion_.size() != n ) occlusion_.resize( n );
 
-    //for (int i = 0; i < num_instances; ++i) {
-    //    for (int j = 0; j < num_instances; ++j) {
-    for (int i = num_instances - 1; i >= 0; --i) {
-        for (int j = num_instances - 1; j >= 0; --j) {
-            int LOD = modelInstanceLOD[i][j];
-            if (0 <= LOD and LOD <= 4) {
-                int myCost = getContribution( model, view, i, j, 1 ) - getContribution( model, view, i, j, 0 );
-                if ( myPair.first == -1 ) {
-                    myPair.first = i; myPair.second = j;
-                    MIN_COST = myCost;
-                }
-                else {
-                    if ( myCost < MIN_COST ) {
-                        MIN_COST = myCost;
-                        myPair.first = i; myPair.second = j;
-                    }
-                }
-            }
+    // PVS of the map, once its thread is done
+    if ( pvs_ready_ ) {
+        pvs_thread_.join();
+        pvs_ready_ = false;
+        std::swap( pvs_, pvs_pending_ );
+        pvs_pending_.clear();
+    }
+
+    // Boxes and spheres of each instance, in the space the instance offsets
+    // are applied in (before the model matrix)
+    instance_boxes_.resize( 6 * n );
+    for ( int k = 0 ; k < n ; ++k ) {
+        const MapInstance &instance = instances_[ k ];
+        const data_representation::TriangleMesh &mesh = *assetOf( k ).mesh;
+        Eigen::Vector3f c = ( instance.transform * ( ( mesh.min_ + mesh.max_ ) / 2 ).homogeneous() ).head<3>();
+        float radius = ( mesh.max_ - mesh.min_ ).norm() / 2;
+        culler_.setSphere( k, c[0], c[1], c[2], radius );
+
+        // Padded so the box never ties in depth with its own surface
+        Eigen::Vector3f pad = ( mesh.max_ - mesh.min_ ) * 0.01f;
+        Eigen::Vector3f lo = mesh.min_ - pad + instance.offset, hi = mesh.max_ + pad + instance.offset;
+        std::copy( lo.data(), lo.data() + 3, &instance_boxes_[ 6 * k ] );
+        std::copy( hi.data(), hi.data() + 3, &instance_boxes_[ 6 * k + 3 ] );
+        if ( occlusion_queries_ ) occlusion_.setBox( k, lo.data(), hi.data() );
+    }
+
+    Frustum frustum;
+    frustum.extract( projection * view * model );
+    culler_.cull( frustum );
+
+    // Distance and projected size of every instance in one batch pass; too
+    // small to cover a pixel is culled as well
+    float focalPixels = height_ / ( 2.0f * std::tan( kFieldOfView * M_PI / 360.0 ) );
+    culler_.measure( view * model, focalPixels );
+    for ( int k = 0 ; k < n ; ++k )
+        if ( culler_.visible( k ) and culler_.screenRadius( k ) < MIN_SCREEN_RADIUS ) culler_.hide( k );
+
+    Eigen::Vector4f eye = ( view * model ).inverse() * Eigen::Vector4f( 0, 0, 0, 1 );
+    int camCol = std::floor( eye[0] / eye[3] / dist_offset + 0.5f );
+    int camRow = std::floor( eye[2] / eye[3] / dist_offset + 0.5f );
+    bool inMap = not pvs_.empty() and map_.inside( camRow, camCol ) and not map_.isOpaque( camRow, camCol );
+
+    // Potentially visible set of the camera cell. The cell of an instance
+    // spans dist_offset around its offset.
+    if ( inMap ) {
+        for ( int k = 0 ; k < n ; ++k ) {
+            const MapInstance &instance = instances_[ k ];
+            if ( map_.inside( instance.row, instance.col ) and not pvs_.visible( camRow, camCol, instance.row, instance.col ) )
+                culler_.hide( k );
         }
     }
-    return myPair;
-}
-
-
-
-std::pair<int, int> GLWidget::getMaxPosition( Eigen::Matrix4f& model, Eigen::Matrix4f& view ) {
-    std::pair<int, int> myPair{ -1, -1 };
-    int MAX_COST = -10;
-    for (int i = num_instances - 1; i >= 0; --i) {
-        for (int j = num_instances - 1; j >= 0; --j) {
-            int LOD = modelInstanceLOD[i][j];
-            if (1 <= LOD and LOD <= 5) {
-                int myCost = - getContribution( model, view, i, j, 0 ) + getContribution( model, view, i, j, -1 );
-                if ( myPair.first == -1 ) {
-                    myPair.first = i; myPair.second = j;
-
-                    MAX_COST = myCost;
-                }
-                else {
-                    if ( MAX_COST < myCost ) {
-                        MAX_COST = myCost;
-                        myPair.first = i; myPair.second = j;
-                    }
-                }
-            }
+
+    // Rooms seen through the portals from the camera room; instances of a
+    // room are kept if they are in a direction the room was seen in
+    if ( portal_culling_ and not portals_.empty() and portals_.traverse( projection, view * model, dist_offset ) ) {
+        for ( int k = 0 ; k < n ; ++k ) {
+            int room = portals_.room( instances_[ k ].row, instances_[ k ].col );
+            if ( room < 0 or not culler_.visible( k ) ) continue;
+            const float *b = &instance_boxes_[ 6 * k ];
+            float radius = std::hypot( b[3] - b[0], b[5] - b[2] ) / 2;
+            if ( not portals_.circleVisible( room, ( b[0] + b[3] ) / 2 / dist_offset, ( b[2] + b[5] ) / 2 / dist_offset, radius / dist_offset ) )
+                culler_.hide( k );
         }
     }
-    return myPair;
+
+    if ( hiz_culling_ ) {
+        hiz_.begin( projection * view * model );
+
+        // Map walls in the frustum (and in the PVS, if the camera is in the
+        // map), looked up through the wall chunks. Each is rasterized as its
+        // own box: the merged wall quads would cross the near plane near the
+        // camera, where occlusion matters most.
+        float half = dist_offset / 2;
+        walls_.forEachWall( frustum, [&]( int row, int col ) {
+            if ( inMap and not pvs_.visible( camRow, camCol, row, col ) ) return;
+            if ( not frustum.sphereVisible( col * dist_offset, 0.0f, row * dist_offset, half * 1.7321f ) ) return;
+
+            Eigen::Vector3f lo, hi;
+            WallBox( row, col, &lo, &hi );
+            hiz_.addOccluderBox( lo, hi );
+        } );
+
+        // Coarse LOD of the instances that look largest
+        std::vector< std::pair< float, int > > bySize;
+        for ( int k = 0 ; k < n ; ++k ) {
+            if ( not culler_.visible( k ) ) continue;
+            const float *b = &instance_boxes_[ 6 * k ];
+            Eigen::Vector3f c( ( b[0] + b[3] ) / 2, ( b[1] + b[4] ) / 2, ( b[2] + b[5] ) / 2 );
+            float radius = ( Eigen::Vector3f( b[3], b[4], b[5] ) - Eigen::Vector3f( b[0], b[1], b[2] ) ).norm() / 2;
+            float distance = std::max( ( c - eye.head<3>() / eye[3] ).norm(), 1e-3f );
+            bySize.push_back( std::make_pair( radius / distance, k ) );
+        }
+        int numOccluders = std::min( (int) bySize.size(), HIZ_MAX_OCCLUDERS );
+        std::partial_sort( bySize.begin(), bySize.begin() + numOccluders, bySize.end(), std::greater< std::pair< float, int > >() );
+        for ( int o = 0 ; o < numOccluders ; ++o ) {
+            int k = bySize[ o ].second;
+            const LODAsset &asset = assetOf( k );
+            hiz_.addOccluder( asset.occluderVtx, asset.occluderFaces, instances_[ k ].offset );
+        }
+
+        hiz_.buildHierarchy();
+
+        std::vector< uint8_t > visible( n );
+        for ( int k = 0 ; k < n ; ++k ) visible[ k ] = culler_.visible( k );
+        hiz_.testBoxes( instance_boxes_.data(), n, visible );
+        for ( int k = 0 ; k < n ; ++k )
+            if ( culler_.visible( k ) and not visible[ k ] ) culler_.hide( k );
+    }
+
+    // Occlusion queries only for what survived the cheaper tests
+    if ( occlusion_queries_ ) {
+        occlusion_.collect();
+        occlusion_.filter( culler_ );
+    }
 }
 
+
+
+int GLWidget::scheduleKeys( int k, float scale, float *up, float *down ) {
+    if ( not culler_.visible( k ) ) return 0;
+
+    const LODAsset& asset = assetOf( k );
+    float bigD = culler_.distance( k );
+    int L = modelInstanceLOD[ k ];
+    float c = asset.contribution( L, bigD, scale );
+
+    int keys = 0;
+    if ( L < MAX_INSTANCE_LOD ) {   // smallest (most negative) upgrade cost first
+        *up = asset.contribution( L + 1, bigD, scale ) - c;
+        keys |= kScheduleUp;
+    }
+    if ( 0 < L ) {                  // largest downgrade cost first
+        *down = - ( asset.contribution( L - 1, bigD, scale ) - c );
+        keys |= kScheduleDown;
+    }
+    return keys;
+}
+
+
+
+void GLWidget::rescheduleInstance( int k, float scale ) {
+    float up, down;
+    int keys = scheduleKeys( k, scale, &up, &down );
+
+    if ( keys & kScheduleUp ) upgrades_.set( k, up );
+    else upgrades_.erase( k );
+
+    if ( keys & kScheduleDown ) downgrades_.set( k, down );
+    else downgrades_.erase( k );
+}
+
+
+
+void GLWidget::updateSchedule( Eigen::Matrix4f& model, Eigen::Matrix4f& view ) {
+    int n = instances_.size();
+
+    bool rebuild = schedule_dirty_ or (int) schedule_visible_.size() != n or
+                   schedule_assets_ != active_ or model(0, 0) != schedule_scale_;
+    if ( not rebuild ) {
+        // Only instances culled or uncovered since last frame, or whose
+        // distance moved past the tolerance since their keys were computed
+        for ( int k = 0 ; k < n ; ++k ) {
+            bool visible = culler_.visible( k );
+            if ( visible == schedule_visible_[ k ] and
+                 ( not visible or std::fabs( culler_.distance( k ) - schedule_distance_[ k ] ) <=
+                                  kScheduleDistanceTolerance * schedule_distance_[ k ] ) ) continue;
+            schedule_visible_[ k ] = visible;
+            schedule_distance_[ k ] = culler_.distance( k );
+            rescheduleInstance( k, model(0, 0) );
+        }
+        return;
+    }
+
+    // Recompute every key and heapify in O(n)
+    schedule_visible_.resize( n );
+    schedule_distance_.resize( n );
+    std::vector< int > upIds, downIds;
+    std::vector< float > upKeys, downKeys;
+    for ( int k = 0 ; k < n ; ++k ) {
+        schedule_visible_[ k ] = culler_.visible( k );
+        schedule_distance_[ k ] = culler_.distance( k );
+        float up, down;
+        int keys = scheduleKeys( k, model(0, 0), &up, &down );
+        if ( keys & kScheduleUp ) { upIds.push_back( k ); upKeys.push_back( up ); }
+        if ( keys & kScheduleDown ) { downIds.push_back( k ); downKeys.push_back( down ); }
+    }
+    upgrades_.reset( n );
+    downgrades_.reset( n );
+    upgrades_.build( upIds, upKeys );
+    downgrades_.build( downIds, downKeys );
+
+    schedule_scale_ = model(0, 0);
+    schedule_assets_ = active_;
+    schedule_dirty_ = false;
+}
+
+
+
+void GLWidget::selectLevelsKnapsack( Eigen::Matrix4f& model, Eigen::Matrix4f& view ) {
+    const int levels = MAX_INSTANCE_LOD + 1;
+    int n = instances_.size();
+    if ( selector_.size() != n ) selector_.resize( n, levels );
+
+    // Options of the visible instances: faces drawn vs. screen-space error
+    // avoided, warm-started from the levels drawn last frame
+    float cost[ MAX_INSTANCE_LOD + 1 ], benefit[ MAX_INSTANCE_LOD + 1 ];
+    for ( int k = 0 ; k < n ; ++k ) {
+        if ( not culler_.visible( k ) ) continue;
+        const LODAsset& asset = assetOf( k );
+        float bigD = culler_.distance( k );
+        for ( int L = 0 ; L < levels ; ++L ) {
+            cost[ L ] = asset.lod.infoPerLOD[ L ].numFaces;
+            benefit[ L ] = - asset.contribution( L, bigD, model(0, 0) );
+        }
+        selector_.setOptions( k, modelInstanceLOD[ k ], cost, benefit );
+    }
+
+    // The instances get what the walls leave of the budget; the walls of
+    // the last frame stand in for this one's, drawn after the selection
+    selector_.select( std::max( 0.0, budget_.budget() - walls_.drawnTriangles() ) );
+
+    for ( int k = 0 ; k < n ; ++k )
+        modelInstanceLOD[ k ] = selector_.level( k );
+
+    // Every level may have changed under the incremental scheduler
+    schedule_dirty_ = true;
+}
+
+
+
 void GLWidget::calculateLevelPerModelInstance( bool hyst, Eigen::Matrix4f& model, Eigen::Matrix4f& view, int myFrame ) {
 
-    std::pair<int, int> Pos;
-    if ( MAX_TRI_PER_FRAME <= triSum_ ) // we must INCREASE some maximum LOD position (less poly)
-        Pos = getMaxPosition( model, view );
-    else if ( triSum_ <= MAX_TRI_PER_FRAME )// we could DECREASE some minimum LOD position (more poly)
-        Pos = getMinPosition( model, view );
+    double maxTri = budget_.budget();
+    updateSchedule( model, view );
+
+    int k = -1;
+    if ( maxTri <= triSum_ ) { // we must INCREASE some maximum LOD position (less poly)
+        if ( not downgrades_.empty() ) k = downgrades_.top();
+    }
+    else if ( triSum_ <= maxTri ) { // we could DECREASE some minimum LOD position (more poly)
+        if ( not upgrades_.empty() ) k = upgrades_.top();
+    }
     else return;
 
-    if ( Pos.first < 0 or Pos.second < 0) return;
+    if ( k < 0 ) return;
+    const VertexClustering& LOD = assetOf( k ).lod;
 
 
     if ( not hyst ) {
-        if ( MAX_TRI_PER_FRAME <= triSum_ and 0 < modelInstanceLOD[ Pos.first ][ Pos.second ]  ) {
-            triSum_ -= LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // subtract old LOD data
-            --modelInstanceLOD[ Pos.first ][ Pos.second ];
-            triSum_ += LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // sum new LOD data
+        if ( maxTri <= triSum_ and 0 < modelInstanceLOD[ k ]  ) {
+            triSum_ -= LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // subtract old LOD data
+            --modelInstanceLOD[ k ];
+            triSum_ += LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // sum new LOD data
         }
-        else if (  triSum_ < MAX_TRI_PER_FRAME and modelInstanceLOD[ Pos.first ][ Pos.second ] < 5 ) {
-            triSum_ -= LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // subtract old LOD data
-            ++modelInstanceLOD[ Pos.first ][ Pos.second ];
-            triSum_ += LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // sum new LOD data
+        else if (  triSum_ < maxTri and modelInstanceLOD[ k ] < 5 ) {
+            triSum_ -= LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // subtract old LOD data
+            ++modelInstanceLOD[ k ];
+            triSum_ += LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // sum new LOD data
         }
     }
     else {
-        if ( MAX_TRI_PER_FRAME <= triSum_ and 0 < modelInstanceLOD[ Pos.first ][ Pos.second ] and myFrame - modelFrameLOD[ Pos.first ][ Pos.second ] >= 15 ) {
-            triSum_ -= LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // subtract old LOD data
-            --modelInstanceLOD[ Pos.first ][ Pos.second ];
-            triSum_ += LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // sum new LOD data
+        if ( maxTri <= triSum_ and 0 < modelInstanceLOD[ k ] and myFrame - modelFrameLOD[ k ] >= 15 ) {
+            triSum_ -= LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // subtract old LOD data
+            --modelInstanceLOD[ k ];
+            triSum_ += LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // sum new LOD data
 
-            modelFrameLOD[ Pos.first ][ Pos.second ] = myFrame;    // hysteriesis for MAX
+            modelFrameLOD[ k ] = myFrame;    // hysteriesis for MAX
 
         }
-        else if ( triSum_ < MAX_TRI_PER_FRAME and modelInstanceLOD[ Pos.first ][ Pos.second ] < 5 and myFrame - modelFrameLOD[ Pos.first ][ Pos.second ] >= 15 ) {
-            triSum_ -= LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // subtract old LOD data
-            ++modelInstanceLOD[ Pos.first ][ Pos.second ];
-            triSum_ += LOD.facesPerLOD[ modelInstanceLOD[ Pos.first ][ Pos.second ] ].size() / 3; // sum new LOD data
+        else if ( triSum_ < maxTri and modelInstanceLOD[ k ] < 5 and myFrame - modelFrameLOD[ k ] >= 15 ) {
+            triSum_ -= LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // subtract old LOD data
+            ++modelInstanceLOD[ k ];
+            triSum_ += LOD.infoPerLOD[ modelInstanceLOD[ k ] ].numFaces; // sum new LOD data
 
-            modelFrameLOD[ Pos.first ][ Pos.second ] = myFrame;    // hysteriesis for MIN
+            modelFrameLOD[ k ] = myFrame;    // hysteriesis for MIN
         }
     }
 
+    // New keys for the next step, O(log n)
+    rescheduleInstance( k, model(0, 0) );
+
 }
 
 
@@ -508,20 +887,54 @@ void GLWidget::calculateLevelPerModelInstance( bool hyst, Eigen::Matrix4f& model
 
 
 
-void GLWidget::SetNumInstances(int numInst) {
-    num_instances = numInst;
-    for (int i = num_instances; i < 50; ++i) {
-        for (int j = num_instances; j < 50; ++j) {
-            modelInstanceLOD[i][j] = 0;
-            modelFrameLOD[i][j]    = 0;
+void GLWidget::ResetSelection() {
+    modelInstanceLOD.assign( instances_.size(), 0 );
+    modelFrameLOD.assign( instances_.size(), 0 );
+    selector_.resize( 0, MAX_INSTANCE_LOD + 1 );
+    last_levels_.clear();
+    schedule_dirty_ = true;
+    triSum_ = 0;
+    totalFrames = 0;
+}
+
+void GLWidget::PlaceInstances() {
+    instances_.clear();
+    if ( not map_.instances().empty() ) instances_ = map_.instances();
+    else {
+        // Grid of num_instances^2, instance (i, j) on cell (j, i); the slots
+        // repeat over it
+        instances_.reserve( num_instances * num_instances );
+        for ( int i = 0 ; i < (int) num_instances ; ++i ) {
+            for ( int j = 0 ; j < (int) num_instances ; ++j ) {
+                MapInstance instance;
+                instance.row = j;
+                instance.col = i;
+                instance.slot = ( num_instances * i + j ) % kMaxSlots;
+                instances_.push_back( instance );
+            }
         }
     }
+    for ( MapInstance& instance : instances_ ) instance.place( dist_offset );
+
+    ResetSelection();
+    if ( occlusion_queries_ ) occlusion_.resize( instances_.size() );
+}
+
+void GLWidget::SetNumInstances(int numInst) {
+    num_instances = numInst;
+    if ( map_.instances().empty() ) PlaceInstances();
 
     updateGL();
 }
 
 void GLWidget::SetDistanceOffset(double offset){
     dist_offset = (float) offset;
+    for ( MapInstance& instance : instances_ ) instance.place( dist_offset );
+    schedule_dirty_ = true;     // instance distances moved
+    if ( not map_.empty() ) {
+        makeCurrent();
+        walls_.build( map_, dist_offset );
+    }
     updateGL();
 }
 
@@ -533,7 +946,7 @@ void GLWidget::SetLevelOfDetail(int lod) {
 
 void GLWidget::SetMethod(QString method) {
     my_method = method.toUtf8().constData();
-    LoadModel( QString::fromUtf8(file.c_str()) );
+    ReloadModels();
     updateGL();
 }
 
@@ -545,3 +958,47 @@ void GLWidget::SetHysteriesis(bool checked) {
 }
 
 
+
+void GLWidget::SetTargetFrameTime(double ms) {
+    budget_.setTarget( ms );
+    updateGL();
+}
+
+
+
+void GLWidget::SetSelector(QString selector) {
+    knapsack_ = std::string( selector.toUtf8().constData() ) == "Knapsack";
+    updateGL();
+}
+
+
+
+void GLWidget::SetOcclusion(QString mode) {
+    std::string m = mode.toUtf8().constData();
+    occlusion_queries_ = m == "Hardware Queries";
+    hiz_culling_ = m == "CPU Hi-Z";
+    // Start over: every instance visible until queried again
+    if ( occlusion_queries_ ) occlusion_.resize( instances_.size() );
+    updateGL();
+}
+
+
+
+void GLWidget::SetImpostors(bool enabled) {
+  impostors_enabled_ = enabled;
+  updateGL();
+}
+
+void GLWidget::SetPortalCulling(bool enabled) {
+  portal_culling_ = enabled;
+  updateGL();
+}
+
+void GLWidget::SetResidency(bool freeCPU) {
+    free_cpu_lods_ = freeCPU;
+    // Reload so the CPU copies come back (or go away) for the loaded models
+    ReloadModels();
+    updateGL();
+}
+
+
@@ -10,11 +10,27 @@
 #include <QOpenGLShaderProgram>
 #include <QString>
 
+#include <atomic>
 #include <memory>
+#include <thread>
 
 #include "./camera.h"
 #include "./triangle_mesh.h"
 #include "./mapmanager.h"
+#include "./clusterstats.h"
+#include "./lodassetmanager.h"
+#include "./frustumculler.h"
+#include "./pvs.h"
+#include "./portals.h"
+#include "./occlusionculler.h"
+#include "./hizculler.h"
+#include "./lodselector.h"
+#include "./budgetcontroller.h"
+#include "./indexedheap.h"
+#include "./frameprofiler.h"
+#include "./instancebatcher.h"
+#include "./impostor.h"
+#include "./wallgeometry.h"
 
 class GLWidget : public QGLWidget {
   Q_OBJECT
@@ -24,13 +40,66 @@ class GLWidget : public QGLWidget {
   ~GLWidget();
 
   /**
-   * @brief LoadModel Loads a PLY model at the filename path into the mesh_ data
-   * structure.
+   * @brief kMaxSlots Number of model slots. Instances cycle through the
+   * loaded slots.
+   */
+  static const int kMaxSlots = 3;
+
+  /**
+   * @brief LoadModel Loads a PLY model at the filename path into a model slot.
+   * A file already loaded (in any slot) with the current method is shared.
    * @param filename Path to the PLY model.
+   * @param slot Model slot, in [0, kMaxSlots).
    * @return Whether it was able to load the model.
    */
   bool LoadModel(const QString &filename, int slot = 0);
 
+  /**
+   * @brief LoadMap Loads a text map and its potentially visible set (computed
+   * and saved as <filename>.pvs the first time). Instances whose map cell is
+   * not visible from the camera cell are culled. If the map has model cells
+   * ('0'-'2') the instances are placed on them instead of the full grid.
+   * @param filename Path to the map.
+   * @return Whether it was able to load the map.
+   */
+  bool LoadMap(const QString &filename);
+
+  /**
+   * @brief ExportFrameTimes Writes the per-phase timings of the last frames
+   * as CSV.
+   * @return Whether it was able to write the file.
+   */
+  bool ExportFrameTimes(const QString &filename);
+
+  /**
+   * @brief StartRecording Starts logging the camera state of every frame,
+   * stamped with the time since the recording started.
+   */
+  void StartRecording();
+
+  /**
+   * @brief StopRecording Stops logging and writes the recorded camera path.
+   * @param filename Path of the recording; empty discards it.
+   * @return Whether it was able to write the file.
+   */
+  bool StopRecording(const QString &filename);
+
+  /**
+   * @brief ReplayCameraPath Drives the camera from a recorded (or text)
+   * camera path, advancing a fixed time step per frame regardless of the real
+   * frame time, so every replay renders the same sequence of views. The LOD
+   * selection restarts and the triangle budget stays at its initial value
+   * while replaying, so the levels drawn are the same every time too.
+   * @param filename Path to the camera path.
+   * @return Whether it was able to read the file.
+   */
+  bool ReplayCameraPath(const QString &filename);
+
+  /**
+   * @brief GetClusterStats Stats of the last LOD build (see ClusterStats).
+   */
+  const ClusterStats &GetClusterStats() const { return cluster_stats_; }
+
  protected:
   /**
    * @brief initializeGL Initializes OpenGL variables and loads, compiles and
@@ -57,33 +126,88 @@ class GLWidget : public QGLWidget {
   std::unique_ptr<QOpenGLShaderProgram> phong_program_;
 
   /**
-   * @brief camera_ Class that computes the multiple camera transform matrices.
+   * @brief CacheUniforms Looks up the uniform locations of the programs and
+   * sets the atlas texture units of impostor_program_. Called whenever a
+   * program is (re)linked.
    */
-  data_visualization::Camera camera_;
+  void CacheUniforms();
+
+  // Uniform locations of phong_program_
+  GLint projection_location_;
+  GLint view_location_;
+  GLint model_location_;
+  GLint normal_matrix_location_;
+  GLint mesh_position_location_;
 
   /**
-   * @brief mesh_ Data structure representing a triangle mesh.
+   * @brief box_program_ Draws the instance boxes of the occlusion queries.
    */
-  std::unique_ptr<data_representation::TriangleMesh> mesh_;
+  std::unique_ptr<QOpenGLShaderProgram> box_program_;
+  GLint box_projection_location_;
+  GLint box_view_location_;
+  GLint box_model_location_;
 
   /**
-   * @brief VAO Vertex Array Object id.
+   * @brief batcher_ Sorts the visible instances into (slot, LOD) buckets and
+   * draws them from the arena.
    */
-  std::vector< GLuint > VAO;
+  InstanceBatcher batcher_;
 
   /**
-   * @brief vbo_v_id Vertex Buffer id for vertices.
+   * @brief impostor_program_ Draws the impostor quads; impostor_bake_program_
+   * renders the atlas views.
    */
-  std::vector< GLuint > vbo_v_id;
+  std::unique_ptr<QOpenGLShaderProgram> impostor_program_;
+  std::unique_ptr<QOpenGLShaderProgram> impostor_bake_program_;
+  GLint impostor_projection_location_;
+  GLint impostor_view_location_;
+  GLint impostor_model_location_;
+  GLint impostor_normal_matrix_location_;
+  GLint impostor_center_location_;
+  GLint impostor_radius_location_;
+  GLint impostor_right_location_;
+  GLint impostor_up_location_;
+  GLint impostor_eye_location_;
+  GLint impostor_color_atlas_location_;
+  GLint impostor_normal_depth_atlas_location_;
+
   /**
-  * @brief vbo_n_id Vertex Buffer id for normals.
-  */
-  std::vector< GLuint > vbo_n_id;
+   * @brief impostors_ Instances under IMPOSTOR_SCREEN_RADIUS drawn as
+   * octahedral impostors, when impostors_enabled_.
+   */
+  ImpostorRenderer impostors_;
+  bool impostors_enabled_;
 
   /**
-  * @brief faces_id Vertex Buffer id for faces.
-  */
-  std::vector< GLuint > faces_id;
+   * @brief walls_ Greedy-meshed walls of the loaded map, rebuilt when the map
+   * or the distance between instances changes.
+   */
+  WallGeometry walls_;
+
+  /**
+   * @brief DrawImpostors Bakes the missing atlases and draws the impostors.
+   */
+  void DrawImpostors( const Eigen::Matrix4f& projection, const Eigen::Matrix4f& view, const Eigen::Matrix4f& model, const Eigen::Matrix3f& normal );
+
+  /**
+   * @brief camera_ Class that computes the multiple camera transform matrices.
+   */
+  data_visualization::Camera camera_;
+
+  /**
+   * @brief assets_ Owner of the loaded meshes, their LODs and GPU buffers.
+   */
+  LODAssetManager assets_;
+
+  /**
+   * @brief models_ Asset of each model slot (nullptr if empty).
+   */
+  std::vector< std::shared_ptr<LODAsset> > models_;
+
+  /**
+   * @brief active_ Non-empty slots, in slot order.
+   */
+  std::vector< LODAsset* > active_;
 
 
   /**
@@ -92,7 +216,8 @@ class GLWidget : public QGLWidget {
   int myLod;
 
   /**
-  * @brief num_instances Number of instances of the model.
+  * @brief num_instances Instances per side of the grid drawn when the map
+  * places no models.
   */
   GLuint num_instances;
 
@@ -103,9 +228,9 @@ class GLWidget : public QGLWidget {
 
 
   /**
-  * @brief file Model filename.
+  * @brief files_ Model filename of each slot.
   */
-  std::string file;
+  std::vector< std::string > files_;
 
   /**
   * @brief num_instances Number of instances of the model.
@@ -130,15 +255,218 @@ class GLWidget : public QGLWidget {
 
  // NEW FUNCTIONS
 
-  int getContribution( Eigen::Matrix4f& model, Eigen::Matrix4f& view, int& i, int& j, int OFFSET=0 );
   void calculateLevelPerModelInstance( bool hyst, Eigen::Matrix4f& model, Eigen::Matrix4f& view, int myFrame );
 
-  std::pair<int, int> getMinPosition( Eigen::Matrix4f& model, Eigen::Matrix4f& view );
-  std::pair<int, int> getMaxPosition( Eigen::Matrix4f& model, Eigen::Matrix4f& view );
+  /**
+  * @brief updateSchedule Keeps upgrades_ and downgrades_ current: every key
+  * is recomputed when the model scale, the instances or the assets changed.
+  * Otherwise only the instances whose visibility changed, or whose view
+  * distance moved by more than kScheduleDistanceTolerance since their keys
+  * were computed, are re-keyed; checking that is still a pass over all the
+  * instances, but without heap updates for the others.
+  */
+  void updateSchedule( Eigen::Matrix4f& model, Eigen::Matrix4f& view );
+
+  /**
+  * @brief rescheduleInstance Updates the keys of instance k for its current
+  * level, or removes it from both heaps if it is culled.
+  */
+  void rescheduleInstance( int k, float scale );
+
+  /**
+  * @brief scheduleKeys Upgrade and downgrade keys of instance k.
+  * @return Which of them apply (kScheduleUp | kScheduleDown), 0 if culled.
+  */
+  int scheduleKeys( int k, float scale, float *up, float *down );
+
+  /**
+  * @brief upgrades_ Visible instances that can take a finer level, keyed by
+  * the change of contribution; downgrades_ those that can take a coarser
+  * one, keyed by the negated change (so the largest comes first).
+  */
+  IndexedHeap upgrades_;
+  IndexedHeap downgrades_;
+  std::vector< uint8_t > schedule_visible_;
+  std::vector< float > schedule_distance_;    // distance the keys were computed at
+  std::vector< LODAsset* > schedule_assets_;
+  float schedule_scale_;
+  bool schedule_dirty_;
+
+  /**
+  * @brief selectLevelsKnapsack Picks the level of every visible instance at
+  * once, as the benefit/cost knapsack of selector_, instead of the one step
+  * per frame of calculateLevelPerModelInstance.
+  */
+  void selectLevelsKnapsack( Eigen::Matrix4f& model, Eigen::Matrix4f& view );
+
+  /**
+  * @brief ResetSelection Puts every instance back at level 0 and drops the
+  * state both selectors carry from frame to frame (selector_ warm start,
+  * hysteresis frames, schedule), as when the viewer starts.
+  */
+  void ResetSelection();
+
+  /**
+  * @brief selector_ Knapsack LOD selection, used when knapsack_ is set.
+  */
+  LODSelector selector_;
+  bool knapsack_;
+
+  /**
+  * @brief budget_ Triangle budget of both LOD selectors, adjusted every frame
+  * from the measured CPU (cpu_timer_) and GPU (gpu_timer_) frame time.
+  */
+  BudgetController budget_;
+  CpuTimer cpu_timer_;
+  GpuTimer gpu_timer_;
+  double gpu_ms_;
+
+  /**
+  * @brief profiler_ Per-phase timings of the last frames. The framerate and
+  * the frame time stats are sent to the UI every second (stats_timer_).
+  */
+  FrameProfiler profiler_;
+  CpuTimer stats_timer_;
+  int stats_frames_;
+  std::vector< int > last_levels_;
+
+  /**
+  * @brief recording_ Camera state of every frame since StartRecording,
+  * stamped with record_timer_.
+  */
+  CameraPath recording_;
+  CpuTimer record_timer_;
+  bool recording_active_;
+
+  /**
+  * @brief replay_ Path driving the camera while replaying_; frame n shows
+  * it at n * kReplayStep seconds.
+  */
+  CameraPath replay_;
+  int replay_frame_;
+  bool replaying_;
+
+  /**
+  * @brief instances_ Every instance drawn, placed dist_offset apart: the
+  * instance table of the map if it places models, otherwise a grid of
+  * num_instances^2. Culling, LOD selection and batching index instances by
+  * their position in it, as do modelInstanceLOD (level of each instance) and
+  * modelFrameLOD (frame of its last level change, for the hysteresis).
+  */
+  std::vector< MapInstance > instances_;
+  std::vector< int > modelInstanceLOD;
+  std::vector< int > modelFrameLOD;
+
+  /**
+  * @brief PlaceInstances Rebuilds instances_ from the map or the grid size
+  * and starts their LOD selection over.
+  */
+  void PlaceInstances();
 
+  /**
+  * @brief assetOf Asset drawn by instance k.
+  */
+  LODAsset &assetOf( int k ) { return *active_[ slotOf( k ) ]; }
+
+  /**
+  * @brief slotOf Index in active_ of the asset drawn by instance k: its
+  * slot, wrapped around the slots loaded.
+  */
+  int slotOf( int k ) const { return instances_[ k ].slot % active_.size(); }
+
+  /**
+  * @brief CullInstances Tests the bounding sphere of every instance against
+  * the view frustum and its projected radius against MIN_SCREEN_RADIUS, its
+  * map cell against the PVS of the camera cell (if a map is loaded), its room
+  * against the portal traversal (if portal_culling_) and, if enabled, its
+  * last occlusion query result or the CPU Hi-Z buffer. Culled instances are
+  * not drawn nor considered by the LOD scheduler.
+  */
+  void CullInstances( const Eigen::Matrix4f& projection, const Eigen::Matrix4f& view, const Eigen::Matrix4f& model );
+
+  /**
+  * @brief map_ Loaded map, and the cell-to-cell visibility computed from it.
+  */
+  mapManager map_;
+  PotentiallyVisibleSet pvs_;
+
+  /**
+  * @brief pvs_thread_ Loads or computes the PVS of a new map off the GUI
+  * thread, into pvs_pending_. CullInstances takes it over once pvs_ready_ is
+  * set; until then the map is not PVS-culled. pvs_cancel_ stops the thread.
+  */
+  std::thread pvs_thread_;
+  PotentiallyVisibleSet pvs_pending_;
+  std::atomic<bool> pvs_ready_;
+  std::atomic<bool> pvs_cancel_;
+
+  /**
+  * @brief StopPvs Cancels and joins pvs_thread_, if running.
+  */
+  void StopPvs();
+
+  /**
+  * @brief portals_ Rooms and portals of the map, traversed every frame from
+  * the camera room when portal_culling_ is set.
+  */
+  PortalGraph portals_;
+  bool portal_culling_;
+
+  /**
+  * @brief culler_ Instance bounding spheres, their visibility this frame and
+  * their view distance and projected radius (used for LOD selection).
+  */
+  FrustumCuller culler_;
+
+  /**
+  * @brief occlusion_ Hardware occlusion queries on the instance boxes, used
+  * when occlusion_queries_ is set.
+  */
+  OcclusionCuller occlusion_;
+  bool occlusion_queries_;
+
+  /**
+  * @brief hiz_ CPU hierarchical-Z culling of the instances behind the map
+  * walls and the largest instances, used when hiz_culling_ is set.
+  */
+  HiZCuller hiz_;
+  bool hiz_culling_;
+
+  /**
+  * @brief instance_boxes_ Bounding box of every instance this frame (min xyz,
+  * max xyz), padded by 1%.
+  */
+  std::vector< float > instance_boxes_;
+
+  /**
+  * @brief WallBox Box of the wall in map cell (row, col): a dist_offset cube
+  * centered on the cell, which is centered on the instance (col, row).
+  */
+  void WallBox( int row, int col, Eigen::Vector3f *lo, Eigen::Vector3f *hi ) const;
+
+  /**
+  * @brief ReloadModels Releases every slot and loads them again with the
+  * current method and residency.
+  */
+  void ReloadModels();
+
+  /**
+  * @brief triSum_ Triangles drawn in the last frame: instances, impostor
+  * quads and walls, all weighed against the budget.
+  */
   int triSum_;
   bool hyst_;
 
+  /**
+  * @brief cluster_stats_ Timings and counters of the last buildCluster call.
+  */
+  ClusterStats cluster_stats_;
+
+  /**
+  * @brief free_cpu_lods_ Whether the LOD arrays are freed from RAM after upload.
+  */
+  bool free_cpu_lods_;
+
  protected slots:
   /**
    * @brief paintGL Function that handles rendering the scene.
@@ -146,7 +474,8 @@ class GLWidget : public QGLWidget {
   void paintGL();
 
   /**
-   * @brief SetNumInstances Sets the instances of the model to be rendered.
+   * @brief SetNumInstances Sets the instances per side of the grid, used
+   * unless the map places the models.
    */
   void SetNumInstances(int numInst);
 
@@ -170,6 +499,40 @@ class GLWidget : public QGLWidget {
    */
   void SetHysteriesis(bool checked) ;
 
+  /**
+   * @brief SetResidency Sets if the CPU copies of the LODs are freed after
+   * being uploaded to the GPU (only per-level counts are kept).
+   */
+  void SetResidency(bool freeCPU);
+
+  /**
+   * @brief SetTargetFrameTime Sets the frame time the triangle budget aims at.
+   */
+  void SetTargetFrameTime(double ms);
+
+  /**
+   * @brief SetSelector Sets the LOD selection ("Incremental" or "Knapsack").
+   */
+  void SetSelector(QString selector);
+
+  /**
+   * @brief SetOcclusion Sets the occlusion culling mode ("None",
+   * "Hardware Queries" or "CPU Hi-Z").
+   */
+  void SetOcclusion(QString mode);
+
+  /**
+   * @brief SetImpostors Sets if instances far enough to cover only a few
+   * pixels are drawn as impostors instead of meshes.
+   */
+  void SetImpostors(bool enabled);
+
+  /**
+   * @brief SetPortalCulling Sets if instances of the map rooms not seen
+   * through the portals from the camera room are culled.
+   */
+  void SetPortalCulling(bool enabled);
+
 
 
  signals:
@@ -188,6 +551,27 @@ class GLWidget : public QGLWidget {
    */
   void SetFramerate(QString);
 
+  /**
+   * @brief SetBudget Signal that updates the interface label "Budget".
+   */
+  void SetBudget(QString);
+
+  /**
+   * @brief SetFrameTime Signal that updates the interface label "CPU / GPU ms".
+   */
+  void SetFrameTime(QString);
+
+  /**
+   * @brief SetFrameStats Signal that updates the frame time percentiles and
+   * histogram.
+   */
+  void SetFrameStats(QString);
+
+  /**
+   * @brief SetBuildStats Signal that updates the LOD build stats label.
+   */
+  void SetBuildStats(QString);
+
 
 
 
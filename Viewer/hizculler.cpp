@@ -0,0 +1,316 @@
+#include "hizculler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+#define HIZ_CHUNK 64            // boxes per parallelFor chunk
+#define HIZ_MIN_PARALLEL 256    // fewer boxes are tested on the calling thread
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs( Clock::time_point start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
+}  // namespace
+
+
+HiZCuller::HiZCuller( int w, int h, int threads )
+    : width( ( w + 3 ) & ~3 ), height( h ), clip( Eigen::Matrix4f::Identity() ),
+      trianglesDrawn( 0 ), rasterMs( 0.0 ), testMs( 0.0 ), numThreads( threads ),
+      job( nullptr ), jobCount( 0 ), nextChunk( 0 ), busy( 0 ), generation( 0 ), quit( false )
+{
+    depth.assign( width * height, 1.0f );
+    if ( numThreads <= 0 ) numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+
+HiZCuller::~HiZCuller()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        quit = true;
+    }
+    wake.notify_all();
+    for ( std::thread& t : workers ) t.join();
+}
+
+
+void HiZCuller::begin( const Eigen::Matrix4f& clipMatrix )
+{
+    clip = clipMatrix;
+    std::fill( depth.begin(), depth.end(), 1.0f );
+    trianglesDrawn = 0;
+    rasterMs = 0.0;
+}
+
+
+void HiZCuller::addOccluder( const std::vector<float>& vtx, const std::vector<int>& faces, const Eigen::Vector3f& offset )
+{
+    auto start = Clock::now();
+
+    std::vector<Eigen::Vector4f> projected( vtx.size() / 3 );
+    for ( size_t v = 0; v < projected.size(); ++v )
+        projected[ v ] = clip * Eigen::Vector4f( vtx[ 3*v ] + offset[0], vtx[ 3*v + 1 ] + offset[1], vtx[ 3*v + 2 ] + offset[2], 1.0f );
+
+    for ( size_t f = 0; f + 2 < faces.size(); f += 3 )
+        rasterTriangle( projected[ faces[ f ] ], projected[ faces[ f + 1 ] ], projected[ faces[ f + 2 ] ] );
+
+    rasterMs += elapsedMs( start );
+}
+
+
+void HiZCuller::addOccluderBox( const Eigen::Vector3f& min, const Eigen::Vector3f& max )
+{
+    static const int kFaces[] = {
+        0, 2, 1,  0, 3, 2,   4, 5, 6,  4, 6, 7,   0, 1, 5,  0, 5, 4,
+        3, 6, 2,  3, 7, 6,   0, 4, 7,  0, 7, 3,   1, 2, 6,  1, 6, 5
+    };
+
+    auto start = Clock::now();
+
+    Eigen::Vector4f corner[ 8 ];
+    for ( int c = 0; c < 8; ++c ) {
+        Eigen::Vector4f p( c & 1 ? max[0] : min[0], c & 2 ? max[1] : min[1], c & 4 ? max[2] : min[2], 1.0f );
+        corner[ c ] = clip * p;
+    }
+    // kFaces walks the corners of each face in the 0-1-2-3 / 4-5-6-7 order
+    static const int kOrder[] = { 0, 1, 3, 2, 4, 5, 7, 6 };
+    for ( int f = 0; f < 36; f += 3 )
+        rasterTriangle( corner[ kOrder[ kFaces[ f ] ] ], corner[ kOrder[ kFaces[ f + 1 ] ] ], corner[ kOrder[ kFaces[ f + 2 ] ] ] );
+
+    rasterMs += elapsedMs( start );
+}
+
+
+void HiZCuller::rasterTriangle( const Eigen::Vector4f& ca, const Eigen::Vector4f& cb, const Eigen::Vector4f& cc )
+{
+    // Skip triangles reaching behind the near plane instead of clipping them
+    if ( ca[2] < -ca[3] or cb[2] < -cb[3] or cc[2] < -cc[3] ) return;
+
+    float ax = ( ca[0] / ca[3] * 0.5f + 0.5f ) * width,  ay = ( ca[1] / ca[3] * 0.5f + 0.5f ) * height;
+    float bx = ( cb[0] / cb[3] * 0.5f + 0.5f ) * width,  by = ( cb[1] / cb[3] * 0.5f + 0.5f ) * height;
+    float cx = ( cc[0] / cc[3] * 0.5f + 0.5f ) * width,  cy = ( cc[1] / cc[3] * 0.5f + 0.5f ) * height;
+    float az = ca[2] / ca[3] * 0.5f + 0.5f, bz = cb[2] / cb[3] * 0.5f + 0.5f, cz = cc[2] / cc[3] * 0.5f + 0.5f;
+
+    float area = ( bx - ax ) * ( cy - ay ) - ( by - ay ) * ( cx - ax );
+    if ( std::fabs( area ) < 1e-8f ) return;
+    if ( area < 0.0f ) {
+        std::swap( bx, cx ); std::swap( by, cy ); std::swap( bz, cz );
+        area = -area;
+    }
+
+    int x0 = std::max( 0, int( std::floor( std::min( { ax, bx, cx } ) ) ) );
+    int x1 = std::min( width - 1, int( std::ceil( std::max( { ax, bx, cx } ) ) ) );
+    int y0 = std::max( 0, int( std::floor( std::min( { ay, by, cy } ) ) ) );
+    int y1 = std::min( height - 1, int( std::ceil( std::max( { ay, by, cy } ) ) ) );
+    if ( x0 > x1 or y0 > y1 ) return;
+
+    ++trianglesDrawn;
+
+    // Edge functions E = A x + B y + C, positive inside, at pixel centers
+    float A0 = -( by - ay ), B0 = bx - ax, C0 = -( A0 * ax + B0 * ay );     // a -> b
+    float A1 = -( cy - by ), B1 = cx - bx, C1 = -( A1 * bx + B1 * by );     // b -> c
+    float A2 = -( ay - cy ), B2 = ax - cx, C2 = -( A2 * cx + B2 * cy );     // c -> a
+
+    // Depth plane z = Zx x + Zy y + Z0 from the barycentrics (E1, E2, E0) / area
+    float Zx = ( A1 * az + A2 * bz + A0 * cz ) / area;
+    float Zy = ( B1 * az + B2 * bz + B0 * cz ) / area;
+    float Z0 = ( C1 * az + C2 * bz + C0 * cz ) / area;
+
+    x0 &= ~3;
+    for ( int y = y0; y <= y1; ++y ) {
+        float py = y + 0.5f;
+        float* row = &depth[ y * width ];
+
+#if defined(__SSE2__)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 lane = _mm_set_ps( 3.5f, 2.5f, 1.5f, 0.5f );
+        for ( int x = x0; x <= x1; x += 4 ) {
+            __m128 px = _mm_add_ps( _mm_set1_ps( float( x ) ), lane );
+            __m128 e0 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( A0 ), px ), _mm_set1_ps( B0 * py + C0 ) );
+            __m128 e1 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( A1 ), px ), _mm_set1_ps( B1 * py + C1 ) );
+            __m128 e2 = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( A2 ), px ), _mm_set1_ps( B2 * py + C2 ) );
+            __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( e0, zero ), _mm_cmpge_ps( e1, zero ) ), _mm_cmpge_ps( e2, zero ) );
+            if ( _mm_movemask_ps( inside ) == 0 ) continue;
+
+            __m128 z = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( Zx ), px ), _mm_set1_ps( Zy * py + Z0 ) );
+            __m128 old = _mm_loadu_ps( row + x );
+            __m128 nearer = _mm_min_ps( old, z );
+            _mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( inside, nearer ), _mm_andnot_ps( inside, old ) ) );
+        }
+#else
+        for ( int x = x0; x <= x1; ++x ) {
+            float px = x + 0.5f;
+            if ( A0 * px + B0 * py + C0 < 0.0f or A1 * px + B1 * py + C1 < 0.0f or A2 * px + B2 * py + C2 < 0.0f ) continue;
+            row[ x ] = std::min( row[ x ], Zx * px + Zy * py + Z0 );
+        }
+#endif
+    }
+}
+
+
+void HiZCuller::buildHierarchy()
+{
+    auto start = Clock::now();
+
+    levels.resize( 1 );
+    levels[0].w = width;
+    levels[0].h = height;
+    levels[0].minDepth = depth;
+    levels[0].maxDepth = depth;
+
+    while ( levels.back().w > 1 or levels.back().h > 1 ) {
+        const Level& fine = levels.back();
+        Level coarse;
+        coarse.w = ( fine.w + 1 ) / 2;
+        coarse.h = ( fine.h + 1 ) / 2;
+        coarse.minDepth.resize( coarse.w * coarse.h );
+        coarse.maxDepth.resize( coarse.w * coarse.h );
+
+        for ( int y = 0; y < coarse.h; ++y ) {
+            for ( int x = 0; x < coarse.w; ++x ) {
+                float lo = 1.0f, hi = 0.0f;
+                for ( int c = 0; c < 4; ++c ) {
+                    int fx = std::min( 2 * x + ( c & 1 ), fine.w - 1 );
+                    int fy = std::min( 2 * y + ( c >> 1 ), fine.h - 1 );
+                    lo = std::min( lo, fine.minDepth[ fy * fine.w + fx ] );
+                    hi = std::max( hi, fine.maxDepth[ fy * fine.w + fx ] );
+                }
+                coarse.minDepth[ y * coarse.w + x ] = lo;
+                coarse.maxDepth[ y * coarse.w + x ] = hi;
+            }
+        }
+        levels.push_back( std::move( coarse ) );
+    }
+
+    rasterMs += elapsedMs( start );
+}
+
+
+bool HiZCuller::visibleTexel( int level, int tx, int ty, int x0, int y0, int x1, int y1, float nearest ) const
+{
+    const Level& L = levels[ level ];
+    if ( tx >= L.w or ty >= L.h ) return false;
+
+    // Pixels covered by the texel must overlap the box rectangle
+    if ( ( ( tx + 1 ) << level ) <= x0 or ( tx << level ) > x1 ) return false;
+    if ( ( ( ty + 1 ) << level ) <= y0 or ( ty << level ) > y1 ) return false;
+
+    int t = ty * L.w + tx;
+    if ( nearest > L.maxDepth[ t ] ) return false;     // behind every occluder here
+    if ( nearest <= L.minDepth[ t ] or level == 0 ) return true;
+
+    for ( int c = 0; c < 4; ++c )
+        if ( visibleTexel( level - 1, 2 * tx + ( c & 1 ), 2 * ty + ( c >> 1 ), x0, y0, x1, y1, nearest ) )
+            return true;
+    return false;
+}
+
+
+bool HiZCuller::testBox( const float* box ) const
+{
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1.0f;
+    for ( int c = 0; c < 8; ++c ) {
+        Eigen::Vector4f p = clip * Eigen::Vector4f( box[ c & 1 ? 3 : 0 ], box[ c & 2 ? 4 : 1 ], box[ c & 4 ? 5 : 2 ], 1.0f );
+
+        // Reaching behind the near plane: can not be bounded on screen
+        if ( p[2] < -p[3] or p[3] <= 0.0f ) return true;
+
+        float x = ( p[0] / p[3] * 0.5f + 0.5f ) * width;
+        float y = ( p[1] / p[3] * 0.5f + 0.5f ) * height;
+        minX = std::min( minX, x ); maxX = std::max( maxX, x );
+        minY = std::min( minY, y ); maxY = std::max( maxY, y );
+        nearest = std::min( nearest, p[2] / p[3] * 0.5f + 0.5f );
+    }
+
+    int x0 = std::max( 0, int( std::floor( minX ) ) ), x1 = std::min( width - 1, int( std::ceil( maxX ) ) - 1 );
+    int y0 = std::max( 0, int( std::floor( minY ) ) ), y1 = std::min( height - 1, int( std::ceil( maxY ) ) - 1 );
+    if ( x0 > x1 or y0 > y1 or levels.empty() ) return true;
+
+    // Start at the level where the rectangle spans at most 2x2 texels
+    int level = 0;
+    while ( level + 1 < (int) levels.size() and ( ( ( x1 >> level ) - ( x0 >> level ) ) > 1 or ( ( y1 >> level ) - ( y0 >> level ) ) > 1 ) )
+        ++level;
+
+    for ( int ty = y0 >> level; ty <= y1 >> level; ++ty )
+        for ( int tx = x0 >> level; tx <= x1 >> level; ++tx )
+            if ( visibleTexel( level, tx, ty, x0, y0, x1, y1, nearest ) ) return true;
+    return false;
+}
+
+
+void HiZCuller::testBoxes( const float* boxes, int count, std::vector<uint8_t>& visible )
+{
+    auto start = Clock::now();
+
+    std::function<void( int, int )> test = [&]( int first, int last ) {
+        for ( int k = first; k < last; ++k )
+            if ( visible[ k ] and not testBox( boxes + 6 * k ) ) visible[ k ] = 0;
+    };
+    parallelFor( count, test );
+
+    testMs = elapsedMs( start );
+}
+
+
+void HiZCuller::parallelFor( int count, const std::function<void( int, int )>& fn )
+{
+    if ( numThreads <= 1 or count < HIZ_MIN_PARALLEL ) {
+        fn( 0, count );
+        return;
+    }
+    if ( workers.empty() )
+        for ( int t = 1; t < numThreads; ++t ) workers.emplace_back( &HiZCuller::workerLoop, this );
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        job = &fn;
+        jobCount = count;
+        nextChunk = 0;
+        busy = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    // The calling thread takes chunks too
+    int c;
+    while ( ( c = nextChunk++ * HIZ_CHUNK ) < count ) fn( c, std::min( c + HIZ_CHUNK, count ) );
+
+    std::unique_lock<std::mutex> lock( mutex );
+    finished.wait( lock, [this] { return busy == 0; } );
+    job = nullptr;
+}
+
+
+void HiZCuller::workerLoop()
+{
+    unsigned seen = 0;
+    while ( true ) {
+        const std::function<void( int, int )>* fn;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            wake.wait( lock, [&] { return quit or generation != seen; } );
+            if ( quit ) return;
+            seen = generation;
+            fn = job;
+            count = jobCount;
+        }
+
+        int c;
+        while ( ( c = nextChunk++ * HIZ_CHUNK ) < count ) ( *fn )( c, std::min( c + HIZ_CHUNK, count ) );
+
+        std::lock_guard<std::mutex> lock( mutex );
+        if ( --busy == 0 ) finished.notify_one();
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef HIZCULLER_H
+#define HIZCULLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <eigen3/Eigen/Geometry>
+
+
+/**
+ * @brief The HiZCuller class CPU occlusion culling against a low resolution
+ * depth buffer. Occluder triangles are rasterized (4 pixels at a time with
+ * SSE2) keeping the nearest depth, then a min/max depth pyramid is built.
+ * Boxes are projected to a screen rectangle and their nearest depth, and
+ * tested top-down: a texel whose max depth is nearer than the box hides it
+ * there, one whose min depth is farther shows it, otherwise its children
+ * decide. Box tests are spread over a small persistent thread pool, started
+ * by the first testBoxes with enough boxes to use it.
+ *
+ * Depths are NDC z mapped to [0, 1]; 1 is the far plane.
+ */
+class HiZCuller
+{
+public:
+    HiZCuller( int width = 256, int height = 128, int threads = 0 );
+    ~HiZCuller();
+
+    HiZCuller( const HiZCuller& ) = delete;
+    HiZCuller& operator=( const HiZCuller& ) = delete;
+
+    /**
+     * @brief begin Clears the depth buffer and sets the clip matrix used by
+     * the following calls (projection * view * model).
+     */
+    void begin( const Eigen::Matrix4f& clip );
+
+    /**
+     * @brief addOccluder Rasterizes a triangle mesh (3 floats per vertex, 3
+     * indices per triangle) moved by offset. Triangles crossing the near plane
+     * are skipped, which only loses occlusion.
+     */
+    void addOccluder( const std::vector<float>& vtx, const std::vector<int>& faces, const Eigen::Vector3f& offset );
+
+    /**
+     * @brief addOccluderBox Rasterizes the 12 triangles of an axis aligned box.
+     */
+    void addOccluderBox( const Eigen::Vector3f& min, const Eigen::Vector3f& max );
+
+    /**
+     * @brief buildHierarchy Builds the min/max pyramid; call after the
+     * occluders and before testing.
+     */
+    void buildHierarchy();
+
+    /**
+     * @brief testBoxes Tests count boxes (min xyz, max xyz each) in parallel.
+     * visible[k] is only cleared, never set, so boxes already culled stay so.
+     */
+    void testBoxes( const float* boxes, int count, std::vector<uint8_t>& visible );
+
+    /**
+     * @brief testBox Whether any part of the box may be visible.
+     */
+    bool testBox( const float* box ) const;
+
+    int numOccluderTriangles() const { return trianglesDrawn; }
+    double lastRasterMs() const { return rasterMs; }
+    double lastTestMs() const { return testMs; }
+
+private:
+    struct Level {
+        int w, h;
+        std::vector<float> minDepth, maxDepth;
+    };
+
+    void rasterTriangle( const Eigen::Vector4f& a, const Eigen::Vector4f& b, const Eigen::Vector4f& c );
+    bool visibleTexel( int level, int tx, int ty, int x0, int y0, int x1, int y1, float nearest ) const;
+
+    void parallelFor( int count, const std::function<void( int, int )>& fn );
+    void workerLoop();
+
+    int width, height;
+    std::vector<float> depth;           // width x height, row major
+    std::vector<Level> levels;
+    Eigen::Matrix4f clip;
+
+    int trianglesDrawn;
+    double rasterMs, testMs;
+
+    // Thread pool
+    int numThreads;                     // the calling thread included
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void( int, int )>* job;
+    int jobCount;
+    std::atomic<int> nextChunk;
+    int busy;
+    unsigned generation;
+    bool quit;
+};
+
+#endif // HIZCULLER_H
@@ -0,0 +1,243 @@
+#include "impostor.h"
+
+#include <cmath>
+
+
+namespace {
+
+const GLfloat quadVertices[] = { // 3D positions of the quads in NDC
+// Vtx coord in XYZ      UV texture pos
+ -1.0f, -1.0f,  0.0f,     0.0f,  0.0f,
+ -1.0f,  1.0f,  0.0f,     0.0f,  1.0f,
+  1.0f, -1.0f,  0.0f,     1.0f,  0.0f,
+  1.0f,  1.0f,  0.0f,     1.0f,  1.0f
+};
+
+
+const GLubyte quadIndices[] = { // indices per quad
+    1, 0, 2,      2, 3, 1
+};
+
+float signNotZero( float x ) { return x >= 0.0f ? 1.0f : -1.0f; }
+
+}  // namespace
+
+
+ImpostorAtlas::ImpostorAtlas()
+    : colorTex( 0 ), normalDepthTex( 0 ), sphereCenter( 0, 0, 0 ), sphereRadius( 1.0f )
+{
+}
+
+
+ImpostorAtlas::~ImpostorAtlas()
+{
+    if ( colorTex == 0 ) return;
+
+    glDeleteTextures( 1, &colorTex );
+    glDeleteTextures( 1, &normalDepthTex );
+}
+
+
+Eigen::Vector3f ImpostorAtlas::octDecode( float u, float v )
+{
+    // Upper half of the octahedron (y >= 0) in the middle diamond, the lower
+    // half folded over the corners
+    Eigen::Vector3f d( u, 1.0f - std::abs( u ) - std::abs( v ), v );
+    if ( d[1] < 0.0f ) {
+        d[0] = ( 1.0f - std::abs( v ) ) * signNotZero( u );
+        d[2] = ( 1.0f - std::abs( u ) ) * signNotZero( v );
+    }
+    return d.normalized();
+}
+
+
+void ImpostorAtlas::frameBasis( const Eigen::Vector3f& dir, Eigen::Vector3f* right, Eigen::Vector3f* up )
+{
+    Eigen::Vector3f reference = std::abs( dir[1] ) > 0.99f ? Eigen::Vector3f( 0, 0, 1 ) : Eigen::Vector3f( 0, 1, 0 );
+    *right = reference.cross( dir ).normalized();
+    *up = dir.cross( *right );
+}
+
+
+void ImpostorAtlas::bake( const GeometryArena& arena, const ArenaRange& range,
+                          const Eigen::Vector3f& center, float radius, GLuint bakeProgram )
+{
+    sphereCenter = center;
+    sphereRadius = radius;
+    const int size = IMPOSTOR_FRAMES * IMPOSTOR_FRAME_SIZE;
+
+    if ( colorTex == 0 ) {
+        glGenTextures( 1, &colorTex );
+        glGenTextures( 1, &normalDepthTex );
+    }
+    glBindTexture( GL_TEXTURE_2D, colorTex );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glBindTexture( GL_TEXTURE_2D, normalDepthTex );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_FLOAT, nullptr );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    // Render target, only for the bake
+    GLint previousFbo, previousViewport[ 4 ];
+    glGetIntegerv( GL_FRAMEBUFFER_BINDING, &previousFbo );
+    glGetIntegerv( GL_VIEWPORT, previousViewport );
+    GLboolean depthTest = glIsEnabled( GL_DEPTH_TEST );
+    glEnable( GL_DEPTH_TEST );
+
+    GLuint fbo, depth;
+    glGenFramebuffers( 1, &fbo );
+    glGenRenderbuffers( 1, &depth );
+    glBindRenderbuffer( GL_RENDERBUFFER, depth );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size );
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0 );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepthTex, 0 );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth );
+    const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers( 2, buffers );
+
+    const GLfloat noColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const GLfloat noNormal[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    glClearBufferfv( GL_COLOR, 0, noColor );
+    glClearBufferfv( GL_COLOR, 1, noNormal );
+    glClear( GL_DEPTH_BUFFER_BIT );
+
+    GLint centerLocation = glGetUniformLocation( bakeProgram, "center" );
+    GLint radiusLocation = glGetUniformLocation( bakeProgram, "radius" );
+    GLint rightLocation = glGetUniformLocation( bakeProgram, "right" );
+    GLint upLocation = glGetUniformLocation( bakeProgram, "up" );
+    GLint dirLocation = glGetUniformLocation( bakeProgram, "dir" );
+    glUniform3fv( centerLocation, 1, center.data() );
+    glUniform1f( radiusLocation, radius );
+
+    glBindVertexArray( arena.vao() );
+    for ( int i = 0; i < IMPOSTOR_FRAMES; ++i ) {
+        for ( int j = 0; j < IMPOSTOR_FRAMES; ++j ) {
+            Eigen::Vector3f dir = octDecode( ( i + 0.5f ) / IMPOSTOR_FRAMES * 2.0f - 1.0f,
+                                             ( j + 0.5f ) / IMPOSTOR_FRAMES * 2.0f - 1.0f );
+            Eigen::Vector3f right, up;
+            frameBasis( dir, &right, &up );
+            glUniform3fv( rightLocation, 1, right.data() );
+            glUniform3fv( upLocation, 1, up.data() );
+            glUniform3fv( dirLocation, 1, dir.data() );
+
+            glViewport( i * IMPOSTOR_FRAME_SIZE, j * IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE );
+            glDrawElementsBaseVertex( GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                                      (const GLvoid*) ( range.firstIndex * sizeof( GLuint ) ), range.baseVertex );
+        }
+    }
+    glBindVertexArray( 0 );
+
+    if ( not depthTest ) glDisable( GL_DEPTH_TEST );
+    glBindFramebuffer( GL_FRAMEBUFFER, previousFbo );
+    glViewport( previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3] );
+    glDeleteRenderbuffers( 1, &depth );
+    glDeleteFramebuffers( 1, &fbo );
+}
+
+
+ImpostorRenderer::ImpostorRenderer( GLuint corner, GLuint instance )
+    : cornerAttrib( corner ), instanceAttrib( instance ), vao( 0 ), quadVbo( 0 ), quadIbo( 0 ), instanceVbo( 0 ),
+      instanceCount( 0 ), calls( 0 )
+{
+}
+
+
+ImpostorRenderer::~ImpostorRenderer()
+{
+    if ( vao == 0 ) return;
+
+    glDeleteBuffers( 1, &quadVbo );
+    glDeleteBuffers( 1, &quadIbo );
+    glDeleteBuffers( 1, &instanceVbo );
+    glDeleteVertexArrays( 1, &vao );
+}
+
+
+void ImpostorRenderer::init()
+{
+    glGenVertexArrays( 1, &vao );
+    glGenBuffers( 1, &quadVbo );
+    glGenBuffers( 1, &quadIbo );
+    glGenBuffers( 1, &instanceVbo );
+
+    glBindVertexArray( vao );
+    glBindBuffer( GL_ARRAY_BUFFER, quadVbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( quadVertices ), quadVertices, GL_STATIC_DRAW );
+    glVertexAttribPointer( cornerAttrib, 3, GL_FLOAT, GL_FALSE, 5 * sizeof( GLfloat ), 0 );
+    glEnableVertexAttribArray( cornerAttrib );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, quadIbo );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( quadIndices ), quadIndices, GL_STATIC_DRAW );
+
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVbo );
+    glVertexAttribDivisor( instanceAttrib, 1 );
+    glEnableVertexAttribArray( instanceAttrib );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+
+void ImpostorRenderer::clear( int numSlots )
+{
+    perSlot.resize( numSlots );
+    for ( std::vector< float >& slot : perSlot ) slot.clear();
+    instanceCount = 0;
+    calls = 0;
+}
+
+
+void ImpostorRenderer::add( int slot, float x, float y, float z )
+{
+    std::vector< float >& d = perSlot[ slot ];
+    d.push_back( x );
+    d.push_back( y );
+    d.push_back( z );
+    d.push_back( 0.0f );
+}
+
+
+void ImpostorRenderer::draw( const std::vector< const ImpostorAtlas* >& atlases, GLint centerLocation, GLint radiusLocation )
+{
+    if ( vao == 0 ) init();
+
+    // Slots one after the other in one buffer
+    instanceData.clear();
+    for ( const std::vector< float >& slot : perSlot ) instanceData.insert( instanceData.end(), slot.begin(), slot.end() );
+    instanceCount = instanceData.size() / 4;
+    calls = 0;
+    if ( instanceCount == 0 ) return;
+
+    glBindVertexArray( vao );
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVbo );
+    glBufferData( GL_ARRAY_BUFFER, instanceData.size() * sizeof( float ), nullptr, GL_STREAM_DRAW );
+    glBufferSubData( GL_ARRAY_BUFFER, 0, instanceData.size() * sizeof( float ), instanceData.data() );
+
+    size_t first = 0;
+    for ( size_t s = 0; s < perSlot.size(); ++s ) {
+        int count = perSlot[ s ].size() / 4;
+        const ImpostorAtlas& atlas = *atlases[ s ];
+        if ( count > 0 and atlas.baked() ) {
+            glUniform3fv( centerLocation, 1, atlas.center().data() );
+            glUniform1f( radiusLocation, atlas.radius() );
+            glActiveTexture( GL_TEXTURE0 );
+            glBindTexture( GL_TEXTURE_2D, atlas.colorTexture() );
+            glActiveTexture( GL_TEXTURE1 );
+            glBindTexture( GL_TEXTURE_2D, atlas.normalDepthTexture() );
+
+            glVertexAttribPointer( instanceAttrib, 4, GL_FLOAT, GL_FALSE, 0, (const GLvoid*) ( first * 4 * sizeof( float ) ) );
+            glDrawElementsInstanced( GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0, count );
+            ++calls;
+        }
+        first += count;
+    }
+
+    glActiveTexture( GL_TEXTURE1 );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glActiveTexture( GL_TEXTURE0 );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindVertexArray( 0 );
+}
@@ -0,0 +1,119 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <eigen3/Eigen/Geometry>
+
+#include "./geometryarena.h"
+
+
+#define IMPOSTOR_FRAMES 8           // views per side of the octahedral atlas
+#define IMPOSTOR_FRAME_SIZE 64      // pixels per side of one view
+
+
+/**
+ * @brief The ImpostorAtlas class A model seen from IMPOSTOR_FRAMES^2
+ * directions spread over the sphere with an octahedral map, each view an
+ * orthographic render of the bounding sphere. Two textures hold the views
+ * side by side: color with coverage in alpha, and the object-space normal
+ * with the depth along the view direction in alpha.
+ *
+ * View (i, j) looks at the model from octDecode( ( (i, j) + 0.5 ) / N * 2 - 1 ),
+ * with the image basis given by frameBasis; impostor.vert / impostor.frag
+ * must use the same conventions.
+ */
+class ImpostorAtlas
+{
+public:
+    ImpostorAtlas();
+    ~ImpostorAtlas();
+
+    ImpostorAtlas( const ImpostorAtlas& ) = delete;
+    ImpostorAtlas& operator=( const ImpostorAtlas& ) = delete;
+
+    /**
+     * @brief bake Renders every view of the mesh stored at range in arena with
+     * bakeProgram (impostor_bake.vert/frag, already bound), framing the sphere
+     * (center, radius). Restores the framebuffer and viewport it found.
+     */
+    void bake( const GeometryArena& arena, const ArenaRange& range,
+               const Eigen::Vector3f& center, float radius, GLuint bakeProgram );
+
+    bool baked() const { return colorTex != 0; }
+
+    GLuint colorTexture() const { return colorTex; }
+    GLuint normalDepthTexture() const { return normalDepthTex; }
+
+    const Eigen::Vector3f& center() const { return sphereCenter; }
+    float radius() const { return sphereRadius; }
+
+    /**
+     * @brief octDecode Unit direction of a point of the octahedral square
+     * [-1, 1]^2.
+     */
+    static Eigen::Vector3f octDecode( float u, float v );
+
+    /**
+     * @brief frameBasis Image axes of the view looking from direction dir.
+     */
+    static void frameBasis( const Eigen::Vector3f& dir, Eigen::Vector3f* right, Eigen::Vector3f* up );
+
+private:
+    GLuint colorTex, normalDepthTex;
+    Eigen::Vector3f sphereCenter;
+    float sphereRadius;
+};
+
+
+/**
+ * @brief The ImpostorRenderer class Draws instances as camera-facing quads
+ * textured from the atlas of their slot, one instanced draw per slot. The
+ * per-instance attribute is a vec4 like the mesh instances: xyz offset.
+ */
+class ImpostorRenderer
+{
+public:
+    ImpostorRenderer( GLuint cornerAttrib, GLuint instanceAttrib );
+    ~ImpostorRenderer();
+
+    ImpostorRenderer( const ImpostorRenderer& ) = delete;
+    ImpostorRenderer& operator=( const ImpostorRenderer& ) = delete;
+
+    /**
+     * @brief clear Starts a frame drawing with the given number of slots.
+     */
+    void clear( int numSlots );
+
+    void add( int slot, float x, float y, float z );
+
+    /**
+     * @brief draw Draws the quads added since clear. The impostor program
+     * must be bound with its view uniforms set; the uniforms of each atlas
+     * (center, radius) are set here at the given locations, its textures go
+     * to units 0 (color) and 1 (normal and depth). Quads of atlases not
+     * baked are skipped.
+     */
+    void draw( const std::vector< const ImpostorAtlas* >& atlases, GLint centerLocation, GLint radiusLocation );
+
+    /**
+     * @brief instances Impostors drawn by the last draw.
+     */
+    int instances() const { return instanceCount; }
+    int drawCalls() const { return calls; }
+
+private:
+    void init();
+
+    GLuint cornerAttrib, instanceAttrib;
+    GLuint vao, quadVbo, quadIbo, instanceVbo;
+
+    std::vector< std::vector< float > > perSlot;
+    std::vector< float > instanceData;
+
+    int instanceCount, calls;
+};
+
+#endif // IMPOSTOR_H
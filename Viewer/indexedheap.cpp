@@ -0,0 +1,82 @@
+#include "indexedheap.h"
+
+#include <cstddef>
+
+
+void IndexedHeap::reset( int n )
+{
+    heap.clear();
+    pos.assign( n, -1 );
+}
+
+
+void IndexedHeap::build( const std::vector< int >& ids, const std::vector< float >& keys )
+{
+    for ( const Entry& e : heap ) pos[ e.id ] = -1;
+    heap.resize( ids.size() );
+    for ( size_t i = 0; i < ids.size(); ++i ) place( i, Entry{ keys[ i ], ids[ i ] } );
+    for ( int i = (int) heap.size() / 2 - 1; i >= 0; --i ) siftDown( i );
+}
+
+
+void IndexedHeap::set( int id, float key )
+{
+    int i = pos[ id ];
+    if ( i < 0 ) {
+        heap.push_back( Entry{ key, id } );
+        pos[ id ] = heap.size() - 1;
+        siftUp( heap.size() - 1 );
+        return;
+    }
+
+    float old = heap[ i ].key;
+    heap[ i ].key = key;
+    if ( key < old ) siftUp( i );
+    else siftDown( i );
+}
+
+
+void IndexedHeap::erase( int id )
+{
+    int i = pos[ id ];
+    if ( i < 0 ) return;
+
+    pos[ id ] = -1;
+    Entry last = heap.back();
+    heap.pop_back();
+    if ( i == (int) heap.size() ) return;
+
+    float old = heap[ i ].key;
+    place( i, last );
+    if ( last.key < old ) siftUp( i );
+    else siftDown( i );
+}
+
+
+void IndexedHeap::siftUp( int i )
+{
+    Entry e = heap[ i ];
+    while ( i > 0 ) {
+        int parent = ( i - 1 ) / 2;
+        if ( not ( e.key < heap[ parent ].key ) ) break;
+        place( i, heap[ parent ] );
+        i = parent;
+    }
+    place( i, e );
+}
+
+
+void IndexedHeap::siftDown( int i )
+{
+    Entry e = heap[ i ];
+    int n = heap.size();
+    while ( true ) {
+        int child = 2 * i + 1;
+        if ( child >= n ) break;
+        if ( child + 1 < n and heap[ child + 1 ].key < heap[ child ].key ) ++child;
+        if ( not ( heap[ child ].key < e.key ) ) break;
+        place( i, heap[ child ] );
+        i = child;
+    }
+    place( i, e );
+}
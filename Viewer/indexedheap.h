@@ -0,0 +1,52 @@
+#ifndef INDEXEDHEAP_H
+#define INDEXEDHEAP_H
+
+#include <vector>
+
+
+/**
+ * @brief The IndexedHeap class Binary min heap of ids in [0, n) keyed by a
+ * float, which also knows where each id sits so the key of any id can be
+ * changed, or the id removed, in O(log n). Use negated keys for a max heap.
+ */
+class IndexedHeap
+{
+public:
+    /**
+     * @brief reset Empties the heap and sets the range of the ids.
+     */
+    void reset( int n );
+
+    /**
+     * @brief build Replaces the content with ids[i] keyed by keys[i], in O(n).
+     */
+    void build( const std::vector< int >& ids, const std::vector< float >& keys );
+
+    /**
+     * @brief set Inserts id, or changes its key if already in.
+     */
+    void set( int id, float key );
+    void erase( int id );
+
+    bool contains( int id ) const { return pos[ id ] >= 0; }
+    bool empty() const { return heap.empty(); }
+    int size() const { return heap.size(); }
+
+    int top() const { return heap[ 0 ].id; }
+    float topKey() const { return heap[ 0 ].key; }
+
+private:
+    struct Entry {
+        float key;
+        int id;
+    };
+
+    void place( int i, const Entry& e ) { heap[ i ] = e; pos[ e.id ] = i; }
+    void siftUp( int i );
+    void siftDown( int i );
+
+    std::vector< Entry > heap;
+    std::vector< int > pos;         // index in heap of each id, -1 if not in
+};
+
+#endif // INDEXEDHEAP_H
@@ -0,0 +1,123 @@
+#include "instancebatcher.h"
+
+
+InstanceBatcher::InstanceBatcher( GLuint attrib )
+    : instanceAttrib( attrib ), instanceVbo( 0 ), indirectBuffer( 0 ),
+      numLevels( 0 ), numBuckets( 0 ), triangleCount( 0 ), vertexCount( 0 ), calls( 0 )
+{
+}
+
+
+InstanceBatcher::~InstanceBatcher()
+{
+    if ( instanceVbo == 0 ) return;
+
+    glDeleteBuffers( 1, &instanceVbo );
+    glDeleteBuffers( 1, &indirectBuffer );
+}
+
+
+void InstanceBatcher::init()
+{
+    glGenBuffers( 1, &instanceVbo );
+    glGenBuffers( 1, &indirectBuffer );
+}
+
+
+void InstanceBatcher::clear( int slots, int levels )
+{
+    numLevels = levels;
+    numBuckets = slots * levels;
+    pending.clear();
+}
+
+
+void InstanceBatcher::add( int slot, int level, float x, float y, float z )
+{
+    pending.push_back( Pending{ slot * numLevels + level, { x, y, z } } );
+}
+
+
+void InstanceBatcher::draw( const std::vector< LODAsset* >& slots, const GeometryArena& arena )
+{
+    if ( instanceVbo == 0 ) init();
+
+    // Count, prefix sum, then scatter the offsets so every bucket is
+    // contiguous in the instance buffer
+    bucketStart.assign( numBuckets + 1, 0 );
+    for ( const Pending& p : pending ) ++bucketStart[ p.bucket + 1 ];
+    for ( int b = 0; b < numBuckets; ++b ) bucketStart[ b + 1 ] += bucketStart[ b ];
+
+    std::vector< int > cursor( bucketStart.begin(), bucketStart.end() - 1 );
+    instanceData.resize( 4 * pending.size() );
+    for ( const Pending& p : pending ) {
+        float* d = &instanceData[ 4 * cursor[ p.bucket ]++ ];
+        d[0] = p.offset[0];
+        d[1] = p.offset[1];
+        d[2] = p.offset[2];
+        d[3] = p.bucket % numLevels;
+    }
+
+    // Orphan the previous frame's storage instead of waiting for it
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVbo );
+    glBufferData( GL_ARRAY_BUFFER, instanceData.size() * sizeof( float ), nullptr, GL_STREAM_DRAW );
+    glBufferSubData( GL_ARRAY_BUFFER, 0, instanceData.size() * sizeof( float ), instanceData.data() );
+
+    // One indirect command per non-empty bucket, all from the shared arena
+    triangleCount = 0;
+    vertexCount = 0;
+    perLevel.assign( numLevels, 0 );
+    commandList.clear();
+    for ( int b = 0; b < numBuckets; ++b ) {
+        int count = bucketStart[ b + 1 ] - bucketStart[ b ];
+        if ( count == 0 ) continue;
+
+        const LODAsset& asset = *slots[ b / numLevels ];
+        const ArenaRange& range = asset.ranges[ b % numLevels ];
+        if ( range.indexCount == 0 ) continue;
+
+        DrawElementsIndirectCommand cmd;
+        cmd.count = range.indexCount;
+        cmd.instanceCount = count;
+        cmd.firstIndex = range.firstIndex;
+        cmd.baseVertex = range.baseVertex;
+        cmd.baseInstance = bucketStart[ b ];
+        commandList.push_back( cmd );
+
+        triangleCount += count * asset.lod.infoPerLOD[ b % numLevels ].numFaces;
+        vertexCount += count * asset.lod.infoPerLOD[ b % numLevels ].numVertices;
+        perLevel[ b % numLevels ] += count;
+    }
+
+    glBindVertexArray( arena.vao() );
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVbo );
+    glVertexAttribDivisor( instanceAttrib, 1 );
+    glEnableVertexAttribArray( instanceAttrib );
+
+    if ( commandList.empty() ) {
+        calls = 0;
+    }
+    else if ( GLEW_ARB_multi_draw_indirect ) {
+        // baseInstance selects each bucket's instances
+        glVertexAttribPointer( instanceAttrib, 4, GL_FLOAT, GL_FALSE, 0, 0 );
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+        glBufferData( GL_DRAW_INDIRECT_BUFFER, commandList.size() * sizeof( DrawElementsIndirectCommand ), commandList.data(), GL_STREAM_DRAW );
+        glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, 0, commandList.size(), 0 );
+        glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+        calls = 1;
+    }
+    else {
+        // No base instance before GL 4.2: point the per-instance attribute at
+        // the bucket's first entry instead
+        for ( const DrawElementsIndirectCommand& cmd : commandList ) {
+            glVertexAttribPointer( instanceAttrib, 4, GL_FLOAT, GL_FALSE, 0,
+                                   (const GLvoid*) ( cmd.baseInstance * 4 * sizeof( float ) ) );
+            glDrawElementsInstancedBaseVertex( GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+                                               (const GLvoid*) ( cmd.firstIndex * sizeof( GLuint ) ),
+                                               cmd.instanceCount, cmd.baseVertex );
+        }
+        calls = commandList.size();
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindVertexArray( 0 );
+}
@@ -0,0 +1,77 @@
+#ifndef INSTANCEBATCHER_H
+#define INSTANCEBATCHER_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "./geometryarena.h"
+#include "./lodassetmanager.h"
+
+
+/**
+ * @brief The InstanceBatcher class Draws the instances of a frame grouped by
+ * (slot, LOD): a counting sort makes every bucket contiguous in one instance
+ * buffer, then each non-empty bucket becomes one indirect command on the
+ * shared arena, all issued with a single glMultiDrawElementsIndirect (or one
+ * instanced draw per bucket before GL 4.2).
+ *
+ * The per-instance attribute is a vec4: xyz offset, w LOD.
+ */
+class InstanceBatcher
+{
+public:
+    explicit InstanceBatcher( GLuint instanceAttrib );
+    ~InstanceBatcher();
+
+    InstanceBatcher( const InstanceBatcher& ) = delete;
+    InstanceBatcher& operator=( const InstanceBatcher& ) = delete;
+
+    /**
+     * @brief clear Starts a frame drawing with the given slots.
+     */
+    void clear( int numSlots, int numLevels );
+
+    void add( int slot, int level, float x, float y, float z );
+
+    /**
+     * @brief draw Sorts, uploads and draws the instances added since clear.
+     * The program must be bound with its uniforms set.
+     */
+    void draw( const std::vector< LODAsset* >& slots, const GeometryArena& arena );
+
+    /**
+     * @brief Stats of the last draw.
+     */
+    int triangles() const { return triangleCount; }
+    int vertices() const { return vertexCount; }
+    int commands() const { return commandList.size(); }
+    int drawCalls() const { return calls; }
+
+    /**
+     * @brief instancesPerLevel Instances drawn at each level, all slots.
+     */
+    const std::vector< int >& instancesPerLevel() const { return perLevel; }
+
+private:
+    struct Pending {
+        int bucket;
+        float offset[ 3 ];
+    };
+
+    void init();
+
+    GLuint instanceAttrib;
+    GLuint instanceVbo, indirectBuffer;
+
+    int numLevels, numBuckets;
+    std::vector< Pending > pending;
+    std::vector< int > bucketStart;
+    std::vector< float > instanceData;
+    std::vector< DrawElementsIndirectCommand > commandList;
+
+    int triangleCount, vertexCount, calls;
+    std::vector< int > perLevel;
+};
+
+#endif // INSTANCEBATCHER_H
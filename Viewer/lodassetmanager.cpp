@@ -0,0 +1,120 @@
+#include "lodassetmanager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "./mesh_io.h"
+
+
+LODAsset::LODAsset() : numLevels( 0 ), arena( nullptr )
+{
+}
+
+
+LODAsset::~LODAsset()
+{
+    for ( const ArenaRange& r : ranges ) arena->release( r );
+}
+
+
+float LODAsset::contribution( int L, float distance, float scale ) const
+{
+    // Measured error, scaled like the model (view space) so it is
+    // proportional to the screen-space error
+    if ( 0 <= L and L < (int) lod.errorPerLOD.size() )
+        return lod.errorPerLOD[ L ].hausdorff * scale / distance;
+
+    // Geometry size is implicit
+    float d = ( mesh->max_ - mesh->min_ ).norm();
+    return d / ( std::pow( 2.0f, L ) * distance );
+}
+
+
+const ImpostorAtlas& LODAsset::bakeImpostor( GLuint bakeProgram )
+{
+    if ( impostor ) return *impostor;
+
+    // Without levels there is nothing to bake: an empty atlas
+    impostor = std::make_unique<ImpostorAtlas>();
+    if ( numLevels == 0 ) return *impostor;
+
+    int finest = numLevels - 1;
+    while ( finest > 0 and ranges[ finest ].indexCount == 0 ) --finest;
+
+    impostor->bake( *arena, ranges[ finest ], ( mesh->min_ + mesh->max_ ) / 2,
+                    ( mesh->max_ - mesh->min_ ).norm() / 2, bakeProgram );
+    return *impostor;
+}
+
+
+LODAssetManager::LODAssetManager( GLuint vertexAttrib, GLuint normalAttrib )
+    : arena_( vertexAttrib, normalAttrib ), freeCPU_( true ), loads_( 0 )
+{
+}
+
+
+std::shared_ptr<LODAsset> LODAssetManager::acquire( const std::string& file, const std::string& method )
+{
+    Key key( file, method );
+    auto it = cache_.find( key );
+    if ( it != cache_.end() ) {
+        std::shared_ptr<LODAsset> asset = it->second.lock();
+        if ( asset ) return asset;
+        cache_.erase( it );
+    }
+
+    size_t pos = file.find_last_of( "." );
+    if ( pos == std::string::npos or file.substr( pos + 1 ) != "ply" ) return nullptr;
+
+    std::shared_ptr<LODAsset> asset = std::make_shared<LODAsset>();
+    asset->file = file;
+    asset->method = method;
+    asset->mesh = std::make_unique<data_representation::TriangleMesh>();
+    if ( not data_representation::ReadFromPly( file, asset->mesh.get() ) ) return nullptr;
+
+    data_representation::TriangleMesh& mesh = *asset->mesh;
+    asset->numLevels = asset->lod.buildCluster( mesh.vertices_, mesh.faces_, mesh.normals_,
+                                                mesh.min_, mesh.max_, method, &asset->stats );
+    std::cout << asset->stats.toJson() << std::endl;
+    asset->lod.measureErrors( mesh.vertices_, mesh.faces_, asset->numLevels - 2 );
+
+    upload( *asset );
+
+    int occluderLevel = std::min( OCCLUDER_LOD, asset->numLevels - 1 );
+    asset->occluderVtx = asset->lod.vtxPerLOD[ occluderLevel ];
+    asset->occluderFaces = asset->lod.facesPerLOD[ occluderLevel ];
+
+    // The levels live on the GPU now; optionally drop the RAM copies
+    if ( freeCPU_ ) {
+        asset->lod.releaseCPUData();
+        std::vector<float>().swap( mesh.vertices_ );
+        std::vector<int>().swap( mesh.faces_ );
+        std::vector<float>().swap( mesh.normals_ );
+    }
+    std::cout << asset->lod.memoryReport();
+    std::cout << "Arena: " << arena_.usedBytes() << " of " << arena_.gpuBytes() << " GPU bytes used" << std::endl;
+
+    ++loads_;
+    cache_[ key ] = asset;
+    return asset;
+}
+
+
+int LODAssetManager::alive()
+{
+    int n = 0;
+    for ( auto it = cache_.begin(); it != cache_.end(); ) {
+        if ( it->second.expired() ) it = cache_.erase( it );
+        else { ++n; ++it; }
+    }
+    return n;
+}
+
+
+void LODAssetManager::upload( LODAsset& asset )
+{
+    asset.arena = &arena_;
+    for ( int i = 0; i < asset.numLevels; ++i )
+        asset.ranges.push_back( arena_.upload( asset.lod.vtxPerLOD[i], asset.lod.normPerLOD[i], asset.lod.facesPerLOD[i] ) );
+}
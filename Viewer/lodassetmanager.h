@@ -0,0 +1,146 @@
+#ifndef LODASSETMANAGER_H
+#define LODASSETMANAGER_H
+
+#include <GL/glew.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./triangle_mesh.h"
+#include "./vertexclustering.h"
+#include "./clusterstats.h"
+#include "./geometryarena.h"
+#include "./impostor.h"
+
+
+#define OCCLUDER_LOD 1      // level kept as occluder mesh (0 is the coarsest)
+
+
+/**
+ * @brief The LODAsset struct One model file simplified with one method: the
+ * mesh, its LOD set and the arena ranges of every level. The ranges are given
+ * back to the arena with the asset.
+ */
+struct LODAsset
+{
+    std::string file;
+    std::string method;
+
+    /**
+     * @brief mesh Source mesh. Only the bounding box is kept when the CPU
+     * copies are released.
+     */
+    std::unique_ptr<data_representation::TriangleMesh> mesh;
+
+    /**
+     * @brief lod Simplified levels, their counts and measured errors.
+     */
+    VertexClustering lod;
+
+    /**
+     * @brief stats Timings and counters of the buildCluster call.
+     */
+    ClusterStats stats;
+
+    /**
+     * @brief numLevels Levels returned by buildCluster (with GPU buffers).
+     */
+    int numLevels;
+
+    /**
+     * @brief occluderVtx / occluderFaces Copy of a coarse level kept on the
+     * CPU for software occlusion culling, even when the CPU copies are freed.
+     */
+    std::vector< float > occluderVtx;
+    std::vector< int > occluderFaces;
+
+    /**
+     * @brief ranges Where each level lives in arena.
+     */
+    std::vector< ArenaRange > ranges;
+    GeometryArena* arena;
+
+    /**
+     * @brief impostor Octahedral views of the finest level, baked on first use.
+     */
+    std::unique_ptr<ImpostorAtlas> impostor;
+
+    LODAsset();
+    ~LODAsset();
+
+    /**
+     * @brief contribution Screen-space error of level L seen at the given
+     * view-space distance, with the model scaled by scale: the measured
+     * Hausdorff distance of the level if there is one, else the diagonal
+     * halved per level.
+     */
+    float contribution( int L, float distance, float scale ) const;
+
+    /**
+     * @brief bakeImpostor Returns the impostor, baking it from the finest
+     * level with bakeProgram (bound, see ImpostorAtlas::bake) the first time.
+     * An asset without levels gets an atlas that is never baked.
+     */
+    const ImpostorAtlas& bakeImpostor( GLuint bakeProgram );
+
+    LODAsset( const LODAsset& ) = delete;
+    LODAsset& operator=( const LODAsset& ) = delete;
+};
+
+
+/**
+ * @brief The LODAssetManager class Loads each (file, method) pair once and
+ * hands out shared references to it. The manager only keeps weak references,
+ * so an asset (and its arena ranges) is released as soon as no slot or
+ * instance uses it anymore. Every asset is stored in the manager's arena, which
+ * must outlive them.
+ */
+class LODAssetManager
+{
+public:
+    LODAssetManager( GLuint vertexAttrib, GLuint normalAttrib );
+
+    /**
+     * @brief acquire Returns the asset of file simplified with method, loading,
+     * simplifying and uploading it if nobody holds it yet. Needs a current GL
+     * context. Returns nullptr if the file could not be read.
+     */
+    std::shared_ptr<LODAsset> acquire( const std::string& file, const std::string& method );
+
+    /**
+     * @brief setFreeCPU Whether newly loaded assets drop their CPU copies
+     * after the upload. Assets already loaded are not affected.
+     */
+    void setFreeCPU( bool freeCPU ) { freeCPU_ = freeCPU; }
+
+    /**
+     * @brief loads Number of files actually loaded (cache misses) so far.
+     */
+    int loads() const { return loads_; }
+
+    /**
+     * @brief alive Number of assets currently held by someone.
+     */
+    int alive();
+
+    /**
+     * @brief arena Shared vertex / index buffers of every asset.
+     */
+    GeometryArena& arena() { return arena_; }
+
+private:
+    void upload( LODAsset& asset );
+
+    GeometryArena arena_;
+
+    typedef std::pair< std::string, std::string > Key;
+    std::map< Key, std::weak_ptr<LODAsset> > cache_;
+
+    bool freeCPU_;
+    int loads_;
+};
+
+#endif // LODASSETMANAGER_H
@@ -0,0 +1,38 @@
+# Headless LOD baker: builds the vertex clustering levels without the GUI.
+#   qmake lodbake.pro && make
+#   ./release/lodbake -m "Error Quadrics" -o baked ../models
+
+TARGET = lodbake
+TEMPLATE = app
+
+CONFIG += console c++14 thread
+CONFIG -= qt app_bundle
+CONFIG(release, release|debug):QMAKE_CXXFLAGS += -Wall -O2
+
+# qmake CONFIG+=avx2 enables the AVX2 paths (normalkernel.cpp)
+avx2:QMAKE_CXXFLAGS += -mavx2 -mfma
+
+CONFIG(release, release|debug):DESTDIR = release/
+CONFIG(release, release|debug):OBJECTS_DIR = release/
+
+CONFIG(debug, release|debug):DESTDIR = debug/
+CONFIG(debug, release|debug):OBJECTS_DIR = debug/
+
+INCLUDEPATH += .. /usr/include/eigen3/
+
+SOURCES += \
+    main.cc \
+    ../triangle_mesh.cc \
+    ../mesh_io.cc \
+    ../vertexclustering.cpp \
+    ../lodmetrics.cpp \
+    ../normalkernel.cpp \
+    ../clusterstats.cpp
+
+HEADERS  += \
+    ../triangle_mesh.h \
+    ../mesh_io.h \
+    ../vertexclustering.h \
+    ../lodmetrics.h \
+    ../normalkernel.h \
+    ../clusterstats.h
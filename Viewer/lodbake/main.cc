@@ -0,0 +1,270 @@
+// Headless batch LOD baking.
+//
+// Usage: lodbake [-m method]... [-o outdir] [-j threads] [-e] [-n] input...
+//   input    PLY files or directories (every *.ply inside is baked)
+//   -m       Clustering method, may be repeated (default "Mean")
+//   -o       Output directory (default ".")
+//   -j       Worker threads (default hardware concurrency): models are baked
+//            concurrently, the methods of each model split the threads left
+//            over, and the error sampling of each method what is left then
+//   -e       Also measure the Hausdorff/RMS error of each level
+//   -n       Do not weld duplicated vertices after loading
+//
+// For every model and method it writes <outdir>/<model>_<method>_lod<k>.ply,
+// appends one line per level to <outdir>/bake_stats.csv and the per-stage
+// buildCluster stats to <outdir>/bake_stats.json.
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./mesh_io.h"
+#include "./triangle_mesh.h"
+#include "./vertexclustering.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+  std::vector<std::string> methods;
+  std::vector<std::string> inputs;
+  std::string outdir = ".";
+  int threads = 0;
+  bool errors = false;
+  bool weld = true;
+};
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+bool EndsWith(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string BaseName(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  return name.substr(0, name.find_last_of('.'));
+}
+
+std::string FileSafe(std::string s) {
+  std::replace(s.begin(), s.end(), ' ', '_');
+  return s;
+}
+
+// Expands directories into the PLY files they contain.
+void CollectInputs(const std::string &path, std::vector<std::string> *files) {
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    files->push_back(path);
+    return;
+  }
+
+  std::vector<std::string> found;
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (EndsWith(name, ".ply")) found.push_back(path + "/" + name);
+  }
+  closedir(dir);
+
+  std::sort(found.begin(), found.end());
+  files->insert(files->end(), found.begin(), found.end());
+}
+
+bool ParseArguments(int argc, char *argv[], Options *options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "-m" && has_value) {
+      options->methods.push_back(argv[++i]);
+    } else if (arg == "-o" && has_value) {
+      options->outdir = argv[++i];
+    } else if (arg == "-j" && has_value) {
+      options->threads = atoi(argv[++i]);
+    } else if (arg == "-e") {
+      options->errors = true;
+    } else if (arg == "-n") {
+      options->weld = false;
+    } else if (!arg.empty() && arg[0] == '-') {
+      return false;
+    } else {
+      CollectInputs(arg, &options->inputs);
+    }
+  }
+
+  if (options->methods.empty()) options->methods.push_back("Mean");
+  if (options->threads <= 0)
+    options->threads = std::max(1u, std::thread::hardware_concurrency());
+  return !options->inputs.empty();
+}
+
+// Bakes every requested method of one model on up to threads threads (this
+// pool worker's share of -j). Each method gets its own VertexClustering,
+// output slots and written flag, and the mesh is only read, so the method
+// threads share nothing they write; the threads left over go to
+// measureErrors.
+bool BakeModel(const std::string &file, const Options &options, int threads,
+               std::string *report, std::string *json) {
+  std::ostringstream out;
+
+  Clock::time_point start = Clock::now();
+  data_representation::TriangleMesh mesh;
+  if (!data_representation::ReadFromPly(file, &mesh)) {
+    std::cerr << "Error " + file + " could not be read." << std::endl;
+    return false;
+  }
+  double load_ms = ElapsedMs(start);
+
+  start = Clock::now();
+  int welded = options.weld ? data_representation::WeldVertices(&mesh) : 0;
+  double weld_ms = ElapsedMs(start);
+
+  const std::string kName = BaseName(file);
+  std::vector<std::string> lines(options.methods.size());
+  std::vector<std::string> stats_json(options.methods.size());
+  std::vector<char> written(options.methods.size(), 1);
+
+  int method_threads =
+      std::min<int>(threads, static_cast<int>(options.methods.size()));
+  int error_threads = std::max(1, threads / method_threads);
+  std::atomic<size_t> next(0);
+  auto bake_methods = [&]() {
+    for (size_t m = next++; m < options.methods.size(); m = next++) {
+      const std::string &method = options.methods[m];
+      std::ostringstream csv;
+      VertexClustering lod;
+      ClusterStats stats;
+
+      Clock::time_point t = Clock::now();
+      int levels = lod.buildCluster(mesh.vertices_, mesh.faces_, mesh.normals_,
+                                    mesh.min_, mesh.max_, method, &stats);
+      double cluster_ms = ElapsedMs(t);
+      stats_json[m] = "{\"model\": \"" + kName + "\", \"stats\": " +
+                      stats.toJson() + "}";
+
+      double error_ms = 0.0;
+      if (options.errors) {
+        t = Clock::now();
+        lod.measureErrors(mesh.vertices_, mesh.faces_, levels - 2, 50000,
+                          error_threads);
+        error_ms = ElapsedMs(t);
+      }
+
+      // The last buffer returned by buildCluster is always empty. Levels that
+      // collapsed to nothing are not written: a PLY without vertices cannot be
+      // read back.
+      for (int i = 0; i < levels - 1; ++i) {
+        data_representation::TriangleMesh level;
+        level.vertices_ = lod.vtxPerLOD[i];
+        level.faces_ = lod.facesPerLOD[i];
+        if (level.vertices_.empty()) continue;
+
+        std::string path = options.outdir + "/" + kName + "_" +
+                           FileSafe(method) + "_lod" + std::to_string(i) +
+                           ".ply";
+        t = Clock::now();
+        if (!data_representation::WriteToPly(path, level)) written[m] = 0;
+        double write_ms = ElapsedMs(t);
+
+        csv << kName << ",\"" << method << "\"," << i << ","
+            << level.vertices_.size() / 3 << "," << level.faces_.size() / 3
+            << "," << load_ms << "," << weld_ms << "," << cluster_ms << ","
+            << error_ms << "," << write_ms;
+        if (options.errors && i < static_cast<int>(lod.errorPerLOD.size()))
+          csv << "," << lod.errorPerLOD[i].hausdorff << ","
+              << lod.errorPerLOD[i].rms;
+        else
+          csv << ",,";
+        csv << "\n";
+      }
+      lines[m] = csv.str();
+    }
+  };
+  std::vector<std::thread> method_pool;
+  for (int t = 1; t < method_threads; ++t)
+    method_pool.push_back(std::thread(bake_methods));
+  bake_methods();
+  for (std::thread &worker : method_pool) worker.join();
+
+  for (const std::string &line : lines) out << line;
+  *report = out.str();
+
+  for (size_t m = 0; m < stats_json.size(); ++m)
+    *json += (m > 0 ? ",\n  " : "") + stats_json[m];
+
+  std::cout << kName << ": " << mesh.vertices_.size() / 3 << " vertices ("
+            << welded << " welded), " << options.methods.size()
+            << " method(s) in " << ElapsedMs(start) + load_ms << " ms"
+            << std::endl;
+
+  return std::find(written.begin(), written.end(), 0) == written.end();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!ParseArguments(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [-m method]... [-o outdir] [-j threads] [-e] [-n] input..."
+              << std::endl;
+    return 1;
+  }
+
+  Clock::time_point start = Clock::now();
+
+  // Thread pool: each worker takes the next model until none is left.
+  std::atomic<size_t> next(0);
+  std::atomic<int> failed(0);
+  std::vector<std::string> reports(options.inputs.size());
+  std::vector<std::string> jsons(options.inputs.size());
+  std::vector<std::thread> pool;
+  int workers = std::min<int>(options.threads, options.inputs.size());
+  int model_threads = std::max(1, options.threads / workers);
+  for (int w = 0; w < workers; ++w) {
+    pool.push_back(std::thread([&]() {
+      for (size_t i = next++; i < options.inputs.size(); i = next++) {
+        if (!BakeModel(options.inputs[i], options, model_threads, &reports[i],
+                       &jsons[i]))
+          ++failed;
+      }
+    }));
+  }
+  for (std::thread &worker : pool) worker.join();
+
+  std::ofstream stats((options.outdir + "/bake_stats.csv").c_str());
+  stats << "model,method,lod,vertices,faces,load_ms,weld_ms,cluster_ms,"
+           "error_ms,write_ms,hausdorff,rms\n";
+  for (const std::string &report : reports) stats << report;
+
+  std::ofstream json((options.outdir + "/bake_stats.json").c_str());
+  json << "[";
+  bool first = true;
+  for (const std::string &entry : jsons) {
+    if (entry.empty()) continue;
+    json << (first ? "\n  " : ",\n  ") << entry;
+    first = false;
+  }
+  json << "\n]\n";
+
+  std::cout << "Baked " << options.inputs.size() - failed << "/"
+            << options.inputs.size() << " models in " << ElapsedMs(start)
+            << " ms" << std::endl;
+
+  return failed == 0 ? 0 : 1;
+}
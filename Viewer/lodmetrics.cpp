@@ -0,0 +1,239 @@
+#include "lodmetrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+
+const int kLeafSize = 4;
+
+Eigen::Vector3f getVertex( const std::vector<float>& vtx, int i ) {
+    return Eigen::Vector3f( vtx[ 3*i + 0 ], vtx[ 3*i + 1 ], vtx[ 3*i + 2 ] );
+}
+
+// Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+Eigen::Vector3f closestPointTriangle( const Eigen::Vector3f& p, const Eigen::Vector3f& a,
+                                      const Eigen::Vector3f& b, const Eigen::Vector3f& c ) {
+    Eigen::Vector3f ab = b - a, ac = c - a, ap = p - a;
+    float d1 = ab.dot( ap ), d2 = ac.dot( ap );
+    if ( d1 <= 0.0f and d2 <= 0.0f ) return a;
+
+    Eigen::Vector3f bp = p - b;
+    float d3 = ab.dot( bp ), d4 = ac.dot( bp );
+    if ( d3 >= 0.0f and d4 <= d3 ) return b;
+
+    float vc = d1*d4 - d3*d2;
+    if ( vc <= 0.0f and d1 >= 0.0f and d3 <= 0.0f ) return a + ab * ( d1 / ( d1 - d3 ) );
+
+    Eigen::Vector3f cp = p - c;
+    float d5 = ab.dot( cp ), d6 = ac.dot( cp );
+    if ( d6 >= 0.0f and d5 <= d6 ) return c;
+
+    float vb = d5*d2 - d1*d6;
+    if ( vb <= 0.0f and d2 >= 0.0f and d6 <= 0.0f ) return a + ac * ( d2 / ( d2 - d6 ) );
+
+    float va = d3*d6 - d5*d4;
+    if ( va <= 0.0f and ( d4 - d3 ) >= 0.0f and ( d5 - d6 ) >= 0.0f )
+        return b + ( c - b ) * ( ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) ) );
+
+    float denom = 1.0f / ( va + vb + vc );
+    return a + ab * ( vb * denom ) + ac * ( vc * denom );
+}
+
+// Radical inverse in base b, used for the (deterministic) Halton samples
+float radicalInverse( int i, int base ) {
+    float inv = 1.0f / base, f = inv, r = 0.0f;
+    while ( i > 0 ) {
+        r += f * ( i % base );
+        i /= base;
+        f *= inv;
+    }
+    return r;
+}
+
+struct SideResult {
+    float maxDist;
+    double sumSq;
+    long long count;
+};
+
+// Samples the surface (from vtx/faces) and measures the distance of every
+// sample to the surface in target. Samples are split among numThreads workers.
+SideResult sampleSide( const std::vector<float>& vtx, const std::vector<int>& faces,
+                       const TriangleBVH& target, int numSamples, int numThreads ) {
+    int NumFaces = faces.size() / 3;
+
+    // Cumulative area table to pick triangles proportionally to their area
+    std::vector< double > cumArea( NumFaces, 0.0 );
+    double total = 0.0;
+    for (int i = 0 ; i < NumFaces ; ++i) {
+        Eigen::Vector3f a = getVertex( vtx, faces[ 3*i + 0 ] );
+        Eigen::Vector3f b = getVertex( vtx, faces[ 3*i + 1 ] );
+        Eigen::Vector3f c = getVertex( vtx, faces[ 3*i + 2 ] );
+        total += 0.5 * ( b - a ).cross( c - a ).norm();
+        cumArea[ i ] = total;
+    }
+
+    // Corners first (where the error usually peaks), then area samples
+    int NumCorners = faces.size();
+    int NumItems = NumCorners + ( total > 0.0 ? numSamples : 0 );
+
+    std::vector< SideResult > partial( numThreads, SideResult{ 0.0f, 0.0, 0 } );
+    std::vector< std::thread > workers;
+    for (int t = 0 ; t < numThreads ; ++t) {
+        workers.push_back( std::thread( [&, t]() {
+            SideResult& res = partial[ t ];
+            int begin = (long long) NumItems * t / numThreads;
+            int end   = (long long) NumItems * (t + 1) / numThreads;
+            for (int k = begin ; k < end ; ++k) {
+                Eigen::Vector3f p;
+                if ( k < NumCorners ) {
+                    p = getVertex( vtx, faces[ k ] );
+                }
+                else {
+                    int s = k - NumCorners;
+                    double u = ( s + 0.5 ) / numSamples * total;
+                    int tri = std::lower_bound( cumArea.begin(), cumArea.end(), u ) - cumArea.begin();
+                    tri = std::min( tri, NumFaces - 1 );
+
+                    float r1 = radicalInverse( s + 1, 2 ), r2 = radicalInverse( s + 1, 3 );
+                    if ( r1 + r2 > 1.0f ) { r1 = 1.0f - r1; r2 = 1.0f - r2; }
+                    Eigen::Vector3f a = getVertex( vtx, faces[ 3*tri + 0 ] );
+                    Eigen::Vector3f b = getVertex( vtx, faces[ 3*tri + 1 ] );
+                    Eigen::Vector3f c = getVertex( vtx, faces[ 3*tri + 2 ] );
+                    p = a + r1 * ( b - a ) + r2 * ( c - a );
+                }
+                float d = target.closestDistance( p );
+                res.maxDist = std::max( res.maxDist, d );
+                res.sumSq += double( d ) * d;
+                ++res.count;
+            }
+        }));
+    }
+    for (auto& w : workers) w.join();
+
+    SideResult res{ 0.0f, 0.0, 0 };
+    for (const SideResult& r : partial) {
+        res.maxDist = std::max( res.maxDist, r.maxDist );
+        res.sumSq += r.sumSq;
+        res.count += r.count;
+    }
+    return res;
+}
+
+}  // namespace
+
+
+void TriangleBVH::build( const std::vector<float>& vtx, const std::vector<int>& faces ) {
+    int NumFaces = faces.size() / 3;
+    nodes.clear();
+    triOrder.resize( NumFaces );
+    triA.resize( NumFaces ); triB.resize( NumFaces ); triC.resize( NumFaces );
+    centroids.resize( NumFaces );
+
+    for (int i = 0 ; i < NumFaces ; ++i) {
+        triOrder[ i ] = i;
+        triA[ i ] = getVertex( vtx, faces[ 3*i + 0 ] );
+        triB[ i ] = getVertex( vtx, faces[ 3*i + 1 ] );
+        triC[ i ] = getVertex( vtx, faces[ 3*i + 2 ] );
+        centroids[ i ] = ( triA[ i ] + triB[ i ] + triC[ i ] ) / 3.0f;
+    }
+    if ( NumFaces == 0 ) return;
+
+    nodes.reserve( 2 * ( NumFaces / kLeafSize + 1 ) );
+    buildNode( 0, NumFaces );
+}
+
+int TriangleBVH::buildNode( int first, int count ) {
+    int idx = nodes.size();
+    nodes.push_back( Node() );
+
+    Eigen::AlignedBox3f box, centerBox;
+    for (int i = first ; i < first + count ; ++i) {
+        int t = triOrder[ i ];
+        box.extend( triA[ t ] ); box.extend( triB[ t ] ); box.extend( triC[ t ] );
+        centerBox.extend( centroids[ t ] );
+    }
+    nodes[ idx ].box = box;
+
+    if ( count <= kLeafSize ) {
+        nodes[ idx ].first = first;
+        nodes[ idx ].count = count;
+        return idx;
+    }
+
+    // Median split along the longest axis of the centroid bounds
+    int axis;
+    centerBox.sizes().maxCoeff( &axis );
+    int mid = first + count / 2;
+    std::nth_element( triOrder.begin() + first, triOrder.begin() + mid, triOrder.begin() + first + count,
+                      [&]( int a, int b ) { return centroids[ a ][ axis ] < centroids[ b ][ axis ]; } );
+
+    buildNode( first, mid - first );                  // left child is always idx + 1
+    int right = buildNode( mid, first + count - mid );
+    nodes[ idx ].first = right;
+    nodes[ idx ].count = 0;
+    return idx;
+}
+
+float TriangleBVH::closestDistance( const Eigen::Vector3f& p ) const {
+    float bestSq = std::numeric_limits<float>::infinity();
+    if ( nodes.empty() ) return bestSq;
+
+    int stack[ 64 ];
+    int top = 0;
+    stack[ top++ ] = 0;
+    while ( top > 0 ) {
+        const Node& node = nodes[ stack[ --top ] ];
+        if ( node.box.squaredExteriorDistance( p ) >= bestSq ) continue;
+
+        if ( node.count > 0 ) {
+            for (int i = node.first ; i < node.first + node.count ; ++i) {
+                int t = triOrder[ i ];
+                float dSq = ( closestPointTriangle( p, triA[ t ], triB[ t ], triC[ t ] ) - p ).squaredNorm();
+                bestSq = std::min( bestSq, dSq );
+            }
+        }
+        else {
+            // Visit the closest child first so the other one is more likely pruned
+            int left = &node - &nodes[ 0 ] + 1, right = node.first;
+            float dl = nodes[ left ].box.squaredExteriorDistance( p );
+            float dr = nodes[ right ].box.squaredExteriorDistance( p );
+            if ( dl < dr ) std::swap( left, right );
+            stack[ top++ ] = left;
+            stack[ top++ ] = right;
+        }
+    }
+    return std::sqrt( bestSq );
+}
+
+
+LODError measureError( const std::vector<float>& vtx, const std::vector<int>& faces, const TriangleBVH& originalBVH,
+                       const std::vector<float>& lodVtx, const std::vector<int>& lodFaces,
+                       int numSamples, int numThreads ) {
+    if ( numThreads <= 0 ) numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    LODError err;
+    if ( lodFaces.empty() ) {
+        // Nothing left of the surface: report the whole model size
+        Eigen::AlignedBox3f box;
+        for (int i = 0 ; i < (int) vtx.size() / 3 ; ++i) box.extend( getVertex( vtx, i ) );
+        err.forward = err.backward = err.hausdorff = err.rms = box.diagonal().norm();
+        return err;
+    }
+
+    TriangleBVH lodBVH;
+    lodBVH.build( lodVtx, lodFaces );
+
+    SideResult fwd = sampleSide( lodVtx, lodFaces, originalBVH, numSamples, numThreads );
+    SideResult bwd = sampleSide( vtx, faces, lodBVH, numSamples, numThreads );
+
+    err.forward   = fwd.maxDist;
+    err.backward  = bwd.maxDist;
+    err.hausdorff = std::max( fwd.maxDist, bwd.maxDist );
+    long long count = fwd.count + bwd.count;
+    err.rms = count > 0 ? std::sqrt( ( fwd.sumSq + bwd.sumSq ) / count ) : 0.0f;
+    return err;
+}
@@ -0,0 +1,94 @@
+#ifndef LODMETRICS_H
+#define LODMETRICS_H
+
+#include <vector>
+#include <eigen3/Eigen/Geometry>
+
+
+/**
+ * @brief The LODError struct Geometric error of one simplified level against
+ * the full-resolution mesh, in model (mesh) units.
+ */
+struct LODError
+{
+    /**
+     * @brief forward One-sided Hausdorff distance, level -> original.
+     */
+    float forward;
+
+    /**
+     * @brief backward One-sided Hausdorff distance, original -> level.
+     */
+    float backward;
+
+    /**
+     * @brief hausdorff Two-sided Hausdorff distance, max(forward, backward).
+     */
+    float hausdorff;
+
+    /**
+     * @brief rms Root mean square distance over the samples of both sides.
+     */
+    float rms;
+
+    LODError() : forward(0.0f), backward(0.0f), hausdorff(0.0f), rms(0.0f) {}
+};
+
+
+/**
+ * @brief The TriangleBVH class Bounding volume hierarchy over the triangles of
+ * a mesh, answering closest-point distance queries.
+ */
+class TriangleBVH
+{
+public:
+    /**
+     * @brief build Builds the hierarchy (median split on the longest axis).
+     * @param vtx Vertex positions, 3 floats per vertex.
+     * @param faces Triangle indices, 3 ints per face.
+     */
+    void build( const std::vector<float>& vtx, const std::vector<int>& faces );
+
+    /**
+     * @brief closestDistance Distance from p to the closest triangle.
+     * @param p Query point.
+     * @return The distance, or infinity if the BVH is empty.
+     */
+    float closestDistance( const Eigen::Vector3f& p ) const;
+
+    bool empty() const { return nodes.empty(); }
+
+private:
+    struct Node {
+        Eigen::AlignedBox3f box;
+        int first;      // first triangle (leaf) or right child (inner)
+        int count;      // number of triangles, 0 for inner nodes
+    };
+
+    int buildNode( int first, int count );
+
+    std::vector< Node > nodes;
+    std::vector< int > triOrder;
+    std::vector< Eigen::Vector3f > triA, triB, triC;
+    std::vector< Eigen::Vector3f > centroids;
+};
+
+
+/**
+ * @brief measureError Measures the distance between a simplified level and the
+ * original mesh by sampling both surfaces (in parallel) and querying a BVH
+ * over the other one.
+ * @param vtx Original vertices.
+ * @param faces Original faces.
+ * @param originalBVH BVH built over vtx/faces, shared between levels.
+ * @param lodVtx Level vertices.
+ * @param lodFaces Level faces.
+ * @param numSamples Number of surface samples per side.
+ * @param numThreads Worker threads, 0 means hardware concurrency.
+ * @return The measured error.
+ */
+LODError measureError( const std::vector<float>& vtx, const std::vector<int>& faces, const TriangleBVH& originalBVH,
+                       const std::vector<float>& lodVtx, const std::vector<int>& lodFaces,
+                       int numSamples, int numThreads = 0 );
+
+#endif // LODMETRICS_H
@@ -0,0 +1,165 @@
+#include "lodselector.h"
+
+#include <algorithm>
+
+
+#define LODSELECTOR_MIN_COST 1e-6f       // cost step used when two levels cost the same
+
+
+namespace {
+
+struct ByRatioLess {
+    template< class S > bool operator()( const S& a, const S& b ) const { return a.ratio < b.ratio; }
+};
+
+struct ByRatioGreater {
+    template< class S > bool operator()( const S& a, const S& b ) const { return a.ratio > b.ratio; }
+};
+
+}  // namespace
+
+
+LODSelector::LODSelector()
+    : numLevels( 0 ), steps( 0 )
+{
+}
+
+
+void LODSelector::resize( int instances, int levelsPerInstance )
+{
+    numLevels = levelsPerInstance;
+    levels.assign( instances, 0 );
+    active.assign( instances, 0 );
+    cost.assign( instances * numLevels, 0.0f );
+    benefit.assign( instances * numLevels, 0.0f );
+}
+
+
+void LODSelector::setOptions( int k, int level, const float* c, const float* b )
+{
+    levels[ k ] = std::max( 0, std::min( level, numLevels - 1 ) );
+    active[ k ] = 1;
+    std::copy( c, c + numLevels, &cost[ k * numLevels ] );
+    std::copy( b, b + numLevels, &benefit[ k * numLevels ] );
+}
+
+
+// Benefit gained per unit of cost going from level l to l + 1
+float LODSelector::upRatio( int k, int l ) const
+{
+    const float* c = &cost[ k * numLevels ];
+    const float* b = &benefit[ k * numLevels ];
+    return ( b[ l + 1 ] - b[ l ] ) / std::max( c[ l + 1 ] - c[ l ], LODSELECTOR_MIN_COST );
+}
+
+
+// Benefit lost per unit of cost saved going from level l to l - 1
+float LODSelector::downRatio( int k, int l ) const
+{
+    const float* c = &cost[ k * numLevels ];
+    const float* b = &benefit[ k * numLevels ];
+    return ( b[ l ] - b[ l - 1 ] ) / std::max( c[ l ] - c[ l - 1 ], LODSELECTOR_MIN_COST );
+}
+
+
+void LODSelector::pushUp( int k )
+{
+    int l = levels[ k ];
+    if ( l + 1 >= numLevels ) return;
+
+    Step s{ upRatio( k, l ), k, l };
+    if ( s.ratio <= 0.0f ) return;      // a finer level that is no better
+    up.push_back( s );
+    std::push_heap( up.begin(), up.end(), ByRatioLess() );
+}
+
+
+void LODSelector::pushDown( int k )
+{
+    int l = levels[ k ];
+    if ( l == 0 ) return;
+
+    down.push_back( Step{ downRatio( k, l ), k, l } );
+    std::push_heap( down.begin(), down.end(), ByRatioGreater() );
+}
+
+
+// Drops the top of the heap if it was pushed for a level that changed since
+bool LODSelector::popStale( std::vector< Step >& heap, bool maxHeap )
+{
+    const Step& top = heap.front();
+    if ( levels[ top.k ] == top.from ) return false;
+
+    if ( maxHeap ) std::pop_heap( heap.begin(), heap.end(), ByRatioLess() );
+    else std::pop_heap( heap.begin(), heap.end(), ByRatioGreater() );
+    heap.pop_back();
+    return true;
+}
+
+
+double LODSelector::select( double budget )
+{
+    steps = 0;
+    up.clear();
+    down.clear();
+
+    double total = 0.0;
+    int numActive = 0;
+    for ( int k = 0; k < (int) levels.size(); ++k ) {
+        if ( not active[ k ] ) continue;
+        total += cost[ k * numLevels + levels[ k ] ];
+        ++numActive;
+        pushUp( k );
+        pushDown( k );
+    }
+
+    auto stepDown = [&]() {
+        Step s = down.front();
+        std::pop_heap( down.begin(), down.end(), ByRatioGreater() );
+        down.pop_back();
+        total -= cost[ s.k * numLevels + s.from ] - cost[ s.k * numLevels + s.from - 1 ];
+        --levels[ s.k ];
+        ++steps;
+        pushUp( s.k );
+        pushDown( s.k );
+    };
+
+    // Over budget (the view changed, or the budget did): shed the cheapest benefit
+    while ( total > budget and not down.empty() ) {
+        if ( popStale( down, false ) ) continue;
+        stepDown();
+    }
+
+    // Best steps first; a step that does not fit may displace worse ones. The
+    // guard only bounds pathological back and forth, the budget always holds.
+    int guard = 4 * numActive * numLevels;
+    while ( not up.empty() and guard-- > 0 ) {
+        if ( popStale( up, true ) ) continue;
+
+        Step s = up.front();
+        double delta = cost[ s.k * numLevels + s.from + 1 ] - cost[ s.k * numLevels + s.from ];
+        if ( total + delta <= budget ) {
+            std::pop_heap( up.begin(), up.end(), ByRatioLess() );
+            up.pop_back();
+            total += delta;
+            ++levels[ s.k ];
+            ++steps;
+            pushUp( s.k );
+            pushDown( s.k );
+            continue;
+        }
+
+        while ( not down.empty() and popStale( down, false ) ) {}
+        if ( not down.empty() and down.front().ratio < s.ratio and down.front().k != s.k ) {
+            stepDown();
+            continue;
+        }
+
+        // Not worth making room for it
+        std::pop_heap( up.begin(), up.end(), ByRatioLess() );
+        up.pop_back();
+    }
+
+    for ( int k = 0; k < (int) active.size(); ++k ) active[ k ] = 0;
+    return total;
+}
@@ -0,0 +1,82 @@
+#ifndef LODSELECTOR_H
+#define LODSELECTOR_H
+
+#include <vector>
+
+
+/**
+ * @brief The LODSelector class Time-critical LOD selection in the spirit of
+ * Funkhouser and Sequin: every instance offers one (cost, benefit) option per
+ * level and exactly one option per instance is picked so that the total cost
+ * stays within a budget and the total benefit is as large as possible (a
+ * multiple-choice knapsack).
+ *
+ * It is solved greedily with two heaps, starting from the levels of the
+ * previous frame instead of from scratch:
+ *  - while over budget, the level step losing the least benefit per unit of
+ *    cost saved is undone;
+ *  - then the step gaining the most benefit per unit of cost is taken while
+ *    it fits, and if it does not fit, cheaper-per-unit steps already taken
+ *    are undone to make room for it.
+ * So the budget is met within one call whatever the view change, and with
+ * small view changes only a few steps are needed.
+ */
+class LODSelector
+{
+public:
+    LODSelector();
+
+    /**
+     * @brief resize Sets the number of instances and of levels per instance.
+     * Instances start at level 0 and inactive.
+     */
+    void resize( int instances, int levels );
+
+    /**
+     * @brief setOptions Makes instance k take part in the next select, from
+     * the given level (the previous frame's one), with the cost and benefit
+     * of each of its levels. Level 0 is the cheapest. Instances not given
+     * options (e.g. culled) cost nothing and keep their level.
+     */
+    void setOptions( int k, int level, const float* cost, const float* benefit );
+
+    /**
+     * @brief select Picks the levels of the instances given options since
+     * the last select.
+     * @return Total cost of the selection.
+     */
+    double select( double budget );
+
+    int level( int k ) const { return levels[ k ]; }
+    int size() const { return levels.size(); }
+
+    /**
+     * @brief lastSteps Level changes made by the last select.
+     */
+    int lastSteps() const { return steps; }
+
+private:
+    struct Step {
+        float ratio;        // benefit per unit of cost of the step
+        int k;
+        int from;           // level of k when pushed; stale once it changed
+    };
+
+    float upRatio( int k, int l ) const;
+    float downRatio( int k, int l ) const;
+
+    void pushUp( int k );
+    void pushDown( int k );
+
+    bool popStale( std::vector< Step >& heap, bool maxHeap );
+
+    int numLevels;
+    std::vector< int > levels;
+    std::vector< unsigned char > active;
+    std::vector< float > cost, benefit;     // numLevels per instance
+
+    std::vector< Step > up, down;           // max heap / min heap on ratio
+    int steps;
+};
+
+#endif // LODSELECTOR_H
@@ -19,13 +19,79 @@ void MainWindow::show() { QMainWindow::show(); }
 
 void MainWindow::on_actionQuit_triggered() { close(); }
 
-void MainWindow::on_actionLoad_triggered() {
+void MainWindow::on_actionLoad_triggered() { LoadModelDialog(0); }
+
+void MainWindow::on_actionLoad_Slot1_triggered() { LoadModelDialog(1); }
+
+void MainWindow::on_actionLoad_Slot2_triggered() { LoadModelDialog(2); }
+
+void MainWindow::on_actionLoad_Map_triggered() {
+  QString filename;
+
+  filename = QFileDialog::getOpenFileName(this, tr("Load map"), "../maps",
+                                          tr("Map Files ( *.txt )"));
+  if (!filename.isNull()) {
+    if (!ui->glwidget->LoadMap(filename)) {
+      QMessageBox::warning(this, tr("Error"),
+                           tr("The file could not be opened"));
+    }
+    else
+        ui->glwidget->updateGL();
+  }
+}
+
+void MainWindow::on_actionExport_Frame_Times_triggered() {
+  QString filename;
+
+  filename = QFileDialog::getSaveFileName(this, tr("Export frame times"),
+                                          "frametimes.csv",
+                                          tr("CSV Files ( *.csv )"));
+  if (!filename.isNull()) {
+    if (!ui->glwidget->ExportFrameTimes(filename)) {
+      QMessageBox::warning(this, tr("Error"),
+                           tr("The file could not be written"));
+    }
+  }
+}
+
+void MainWindow::on_actionRecord_Camera_Path_triggered(bool checked) {
+  if (checked) {
+    ui->glwidget->StartRecording();
+    return;
+  }
+
+  QString filename;
+
+  filename = QFileDialog::getSaveFileName(this, tr("Save camera path"),
+                                          "../paths/recording.cpth",
+                                          tr("Camera Paths ( *.cpth )"));
+  if (!ui->glwidget->StopRecording(filename)) {
+    QMessageBox::warning(this, tr("Error"),
+                         tr("The file could not be written"));
+  }
+}
+
+void MainWindow::on_actionReplay_Camera_Path_triggered() {
+  QString filename;
+
+  filename = QFileDialog::getOpenFileName(
+      this, tr("Replay camera path"), "../paths",
+      tr("Camera Paths ( *.cpth *.txt )"));
+  if (!filename.isNull()) {
+    if (!ui->glwidget->ReplayCameraPath(filename)) {
+      QMessageBox::warning(this, tr("Error"),
+                           tr("The file could not be opened"));
+    }
+  }
+}
+
+void MainWindow::LoadModelDialog(int slot) {
   QString filename;
 
   filename = QFileDialog::getOpenFileName(this, tr("Load model"), "../models",
                                           tr("PLY Files ( *.ply )"));
   if (!filename.isNull()) {
-    if (!ui->glwidget->LoadModel(filename)){
+    if (!ui->glwidget->LoadModel(filename, slot)){
       QMessageBox::warning(this, tr("Error"),
                            tr("The file could not be opened"));
     }
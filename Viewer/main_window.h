@@ -31,7 +31,45 @@ class MainWindow : public QMainWindow {
    */
   void on_actionLoad_triggered();
 
+  /**
+   * @brief on_actionLoad_Slot1_triggered Loads a PLY mesh into model slot 1.
+   */
+  void on_actionLoad_Slot1_triggered();
+
+  /**
+   * @brief on_actionLoad_Slot2_triggered Loads a PLY mesh into model slot 2.
+   */
+  void on_actionLoad_Slot2_triggered();
+
+  /**
+   * @brief on_actionLoad_Map_triggered Opens a file dialog to load a map.
+   */
+  void on_actionLoad_Map_triggered();
+
+  /**
+   * @brief on_actionExport_Frame_Times_triggered Opens a file dialog to save
+   * the last frame timings as CSV.
+   */
+  void on_actionExport_Frame_Times_triggered();
+
+  /**
+   * @brief on_actionRecord_Camera_Path_triggered Starts recording the camera,
+   * or stops and opens a file dialog to save the recording.
+   */
+  void on_actionRecord_Camera_Path_triggered(bool checked);
+
+  /**
+   * @brief on_actionReplay_Camera_Path_triggered Opens a file dialog to
+   * replay a camera path.
+   */
+  void on_actionReplay_Camera_Path_triggered();
+
  private:
+  /**
+   * @brief LoadModelDialog Opens a file dialog to load a PLY mesh into slot.
+   */
+  void LoadModelDialog(int slot);
+
   Ui::MainWindow *ui;
 };
 
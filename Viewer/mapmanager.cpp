@@ -1,52 +1,175 @@
 #include "mapmanager.h"
 
-mapManager::mapManager()
-{
-
-}
-
+#include <cstdio>
+#include <cstring>
 
-void mapManager::loadMap( const std::string filename ) {
-/*
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-      std::ifstream fin;
 
-      fin.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
-      if (!fin.is_open() || !fin.good()) return false;
-
-      int vertices = 0, faces = 0;
+namespace {
 
+inline bool isBlank( char c ) { return c == ' ' or c == '\t' or c == '\r'; }
 
+/**
+ * @brief parseRow Writes the first byte of every token of [p, eol) at
+ * out + n and returns the new n. out may be the text itself: a cell is never
+ * written ahead of the byte it comes from.
+ */
+size_t parseRow( const char* p, const char* eol, char* out, size_t n )
+{
+    unsigned prevBlank = 1;     // the row starts as after a blank
+
+#if defined(__SSE2__)
+    // 16 bytes at a time: token starts are the non-blank bytes after a
+    // blank. The usual "X . X ." rows have them at every other byte and are
+    // packed 8 at once; anything else goes bit by bit.
+    const __m128i space = _mm_set1_epi8( ' ' ), tab = _mm_set1_epi8( '\t' ), cr = _mm_set1_epi8( '\r' );
+    const __m128i lowBytes = _mm_set1_epi16( 0x00FF );
+    for ( ; eol - p >= 16; p += 16 ) {
+        __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( p ) );
+        __m128i b = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, space ), _mm_cmpeq_epi8( v, tab ) ),
+                                  _mm_cmpeq_epi8( v, cr ) );
+        unsigned blank = _mm_movemask_epi8( b );
+        unsigned starts = ~blank & ( ( blank << 1 ) | prevBlank ) & 0xFFFF;
+        prevBlank = blank >> 15;
+
+        if ( starts == 0x5555 ) {
+            __m128i even = _mm_and_si128( v, lowBytes );
+            _mm_storel_epi64( reinterpret_cast< __m128i* >( out + n ), _mm_packus_epi16( even, even ) );
+            n += 8;
+        }
+        else if ( starts == 0xAAAA ) {
+            __m128i odd = _mm_srli_epi16( v, 8 );
+            _mm_storel_epi64( reinterpret_cast< __m128i* >( out + n ), _mm_packus_epi16( odd, odd ) );
+            n += 8;
+        }
+        else {
+            for ( ; starts != 0; starts &= starts - 1 ) out[ n++ ] = p[ __builtin_ctz( starts ) ];
+        }
+    }
+#endif
+
+    for ( ; p < eol; ++p ) {
+        bool blank = isBlank( *p );
+        out[ n ] = *p;
+        n += prevBlank & not blank;
+        prevBlank = blank;
+    }
+    return n;
+}
 
-      fin->getline(line, 100);
-      if (strncmp(line, "txt", 3) != 0) return false;
+/**
+ * @brief forEachSlot Calls f( k ) for every cell k of grid holding a model
+ * slot ('0'-'2'), skipping 16 cells at a time where there is none.
+ */
+template < typename F >
+void forEachSlot( const std::vector< char >& grid, F f )
+{
+    size_t k = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_set1_epi8( '0' ), two = _mm_set1_epi8( 2 );
+    for ( ; k + 16 <= grid.size(); k += 16 ) {
+        __m128i d = _mm_sub_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i* >( &grid[ k ] ) ), zero );
+        unsigned slots = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_min_epu8( d, two ), d ) );
+        for ( ; slots != 0; slots &= slots - 1 ) f( k + __builtin_ctz( slots ) );
+    }
+#endif
+    for ( ; k < grid.size(); ++k )
+        if ( unsigned( grid[ k ] - '0' ) <= 2 ) f( k );
+}
 
-      *vertices = 0;
-      fin->getline(line, 100);
-      while (strncmp(line, "end_header", 10) != 0) {
-        if (strncmp(line, "element vertex", 14) == 0) *vertices = atoi(&line[15]);
-        fin->getline(line, 100);
-        if (strncmp(line, "element face", 12) == 0) *faces = atoi(&line[13]);
-      }
+}  // namespace
 
 
-      if (!ReadPlyHeader(&fin, &vertices, &faces)) {
-        fin.close();
-        return false;
-      }
+void MapInstance::place( float cellSize )
+{
+    offset = Eigen::Vector3f( col, 0.0f, row ) * cellSize;
+    transform.setIdentity();
+    transform.block< 3, 1 >( 0, 3 ) = offset;
+}
 
-      mesh->vertices_.resize(static_cast<size_t>(vertices) * 3);
-      ReadPlyVertices(&fin, mesh);
 
-      mesh->faces_.resize(static_cast<size_t>(faces) * 3);
-      ReadPlyFaces(&fin, mesh);
+mapManager::mapManager() : nRows( 0 ), nCols( 0 )
+{
 
-      fin.close();
+}
 
-      ComputeVertexNormals(mesh->vertices_, mesh->faces_, &mesh->normals_);
-      ComputeBoundingBox(mesh->vertices_, mesh);
 
-      return true;
+bool mapManager::loadMap( const std::string filename ) {
+    FILE* fin = std::fopen( filename.c_str(), "rb" );
+    if ( fin == nullptr ) {
+        std::cerr << "Error " + filename + " not found." << std::endl;
+        return false;
+    }
 
-      */
+    std::fseek( fin, 0, SEEK_END );
+    long bytes = std::ftell( fin );
+    std::fseek( fin, 0, SEEK_SET );
+    if ( bytes < 0 ) {
+        std::fclose( fin );
+        return false;
+    }
+    std::vector< char > text( bytes + 1, '\n' );
+    size_t read = std::fread( text.data(), 1, bytes, fin );
+    std::fclose( fin );
+    if ( read != size_t( bytes ) ) return false;
+
+    // One pass over the rows, split with memchr. Cells are compacted in place
+    // at the front of the text, and rows are only padded afterwards if their
+    // widths differ, so the usual rectangular map is never copied.
+    std::vector< size_t > rowEnd;
+    size_t width = 0, n = 0;
+    bool ragged = false;
+
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while ( p < end ) {
+        const char* eol = static_cast< const char* >( std::memchr( p, '\n', end - p ) );
+        size_t rowStart = n;
+        n = parseRow( p, eol, text.data(), n );
+        p = eol + 1;
+
+        size_t w = n - rowStart;
+        if ( w == 0 ) continue;
+        if ( not rowEnd.empty() and w != width ) ragged = true;
+        width = std::max( width, w );
+        rowEnd.push_back( n );
+    }
+
+    if ( rowEnd.empty() ) return false;
+    text.resize( n );
+    text.shrink_to_fit();
+
+    if ( ragged ) {
+        std::vector< char > padded( rowEnd.size() * width, '.' );
+        size_t start = 0;
+        for ( size_t r = 0; r < rowEnd.size(); ++r ) {
+            std::copy( text.begin() + start, text.begin() + rowEnd[ r ], padded.begin() + r * width );
+            start = rowEnd[ r ];
+        }
+        text.swap( padded );
+    }
+
+    grid.swap( text );
+    nRows = rowEnd.size();
+    nCols = width;
+    file = filename;
+
+    // Instance table, sized first so it is filled without reallocating
+    size_t count = 0;
+    forEachSlot( grid, [&]( size_t ) { ++count; } );
+    table.clear();
+    table.reserve( count );
+    forEachSlot( grid, [&]( size_t k ) {
+        MapInstance instance;
+        instance.row = k / nCols;
+        instance.col = k % nCols;
+        instance.slot = grid[ k ] - '0';
+        instance.place( 1.0f );
+        table.push_back( instance );
+    } );
+
+    return true;
 }
@@ -11,15 +11,86 @@
 #include <vector>
 
 
+/**
+ * @brief The MapInstance struct One model instance: its model slot, the map
+ * cell it stands on and its placement. transform takes the model to the
+ * cell, ( col, 0, row ) times the cell size; offset is its translation,
+ * which is what the renderer applies per instance (maps neither rotate nor
+ * scale their models).
+ */
+struct MapInstance
+{
+    int row, col;
+    int slot;
+    Eigen::Vector3f offset;
+    Eigen::Matrix< float, 4, 4, Eigen::DontAlign > transform;
+
+    /**
+     * @brief place Sets offset and transform for cells of side cellSize.
+     */
+    void place( float cellSize );
+};
+
+
+/**
+ * @brief The mapManager class Grid map read from a text file: one row per
+ * line, one cell per whitespace separated character. 'X' is a wall, 'x' a
+ * see-through wall (window), '0'-'2' a model slot and '.' free space.
+ *
+ * The cells are kept as one byte each in a single row-major array, and the
+ * cells with a model slot are listed in an instance table.
+ */
 class mapManager
 {
 public:
     mapManager();
 
-    void loadMap( const std::string filename );
+    /**
+     * @brief loadMap Reads the map at filename in one block and parses it in
+     * a single pass over the bytes.
+     * @return Whether it could be read. Rows shorter than the longest are
+     * padded with free cells.
+     */
+    bool loadMap( const std::string filename );
+
+    int rows() const { return nRows; }
+    int cols() const { return nCols; }
+    bool empty() const { return grid.empty(); }
+
+    char cell( int row, int col ) const { return grid[ size_t( row ) * nCols + col ]; }
+    bool inside( int row, int col ) const { return 0 <= row and row < rows() and 0 <= col and col < cols(); }
+
+    /**
+     * @brief isWall Whether the cell blocks movement ('X' or 'x').
+     */
+    bool isWall( int row, int col ) const { char c = cell( row, col ); return c == 'X' or c == 'x'; }
+
+    /**
+     * @brief isOpaque Whether the cell blocks sight ('X' only).
+     */
+    bool isOpaque( int row, int col ) const { return cell( row, col ) == 'X'; }
+
+    /**
+     * @brief slot Model slot of the cell, or -1 if it holds no model.
+     */
+    int slot( int row, int col ) const { char c = cell( row, col ); return c >= '0' and c <= '2' ? c - '0' : -1; }
+
+    /**
+     * @brief instances Cells holding a model, in row-major order, placed in
+     * cell units (cell size 1).
+     */
+    const std::vector< MapInstance >& instances() const { return table; }
+
+    /**
+     * @brief filename File the map was loaded from.
+     */
+    const std::string& filename() const { return file; }
 
 private:
-    std::vector< std::string > map;
+    std::vector< char > grid;
+    int nRows, nCols;
+    std::vector< MapInstance > table;
+    std::string file;
 };
 
 #endif // MAPMANAGER_H
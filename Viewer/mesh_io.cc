@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -187,16 +188,84 @@ bool ReadFromPly(const std::string &filename, TriangleMesh *mesh) {
 float boundingBox3Diagonal( TriangleMesh *mesh) {}
 
 bool WriteToPly(const std::string &filename, const TriangleMesh &mesh) {
-  (void)filename;
-  (void)mesh;
+  std::ofstream fout;
 
-  std::cerr << "Not yet implemented" << std::endl;
+  fout.open(filename.c_str(), std::ios_base::out | std::ios_base::binary);
+  if (!fout.is_open() || !fout.good()) return false;
 
-  // TODO(students): Implement storing to PLY format.
+  const size_t kVertices = mesh.vertices_.size() / 3;
+  const size_t kFaces = mesh.faces_.size() / 3;
 
-  // END.
+  // Same layout ReadFromPly expects: binary float positions, uchar+int faces.
+  fout << "ply\n"
+       << "format binary_little_endian 1.0\n"
+       << "element vertex " << kVertices << "\n"
+       << "property float x\n"
+       << "property float y\n"
+       << "property float z\n"
+       << "element face " << kFaces << "\n"
+       << "property list uchar int vertex_indices\n"
+       << "end_header\n";
 
-  return false;
+  fout.write(reinterpret_cast<const char *>(mesh.vertices_.data()),
+             kVertices * 3 * sizeof(float));
+
+  const unsigned char kVertexPerFace = 3;
+  for (size_t i = 0; i < kFaces; ++i) {
+    fout.write(reinterpret_cast<const char *>(&kVertexPerFace),
+               sizeof(unsigned char));
+    fout.write(reinterpret_cast<const char *>(&mesh.faces_[i * 3]),
+               3 * sizeof(int));
+  }
+
+  bool res = fout.good();
+  fout.close();
+  return res;
+}
+
+int WeldVertices(TriangleMesh *mesh) {
+  const size_t kVertices = mesh->vertices_.size() / 3;
+
+  // Sort the vertex ids by position so duplicates become adjacent.
+  std::vector<int> order(kVertices);
+  for (size_t i = 0; i < kVertices; ++i) order[i] = static_cast<int>(i);
+  const std::vector<float> &v = mesh->vertices_;
+  std::sort(order.begin(), order.end(), [&v](int a, int b) {
+    return std::lexicographical_compare(&v[a * 3], &v[a * 3 + 3], &v[b * 3],
+                                        &v[b * 3 + 3]);
+  });
+
+  std::vector<int> remap(kVertices);
+  std::vector<float> welded;
+  welded.reserve(mesh->vertices_.size());
+  for (size_t i = 0; i < kVertices; ++i) {
+    const int kIdx = order[i];
+    if (i == 0 || !std::equal(&v[kIdx * 3], &v[kIdx * 3 + 3],
+                              &v[order[i - 1] * 3])) {
+      welded.push_back(v[kIdx * 3]);
+      welded.push_back(v[kIdx * 3 + 1]);
+      welded.push_back(v[kIdx * 3 + 2]);
+    }
+    remap[kIdx] = static_cast<int>(welded.size() / 3) - 1;
+  }
+
+  for (size_t i = 0; i < mesh->faces_.size(); ++i)
+    mesh->faces_[i] = remap[mesh->faces_[i]];
+
+  const int kRemoved = static_cast<int>(kVertices - welded.size() / 3);
+  mesh->vertices_.swap(welded);
+
+  mesh->normals_.clear();
+  ComputeVertexNormals(mesh->vertices_, mesh->faces_, &mesh->normals_);
+  mesh->min_ = Eigen::Vector3f(std::numeric_limits<float>::max(),
+                               std::numeric_limits<float>::max(),
+                               std::numeric_limits<float>::max());
+  mesh->max_ = Eigen::Vector3f(std::numeric_limits<float>::lowest(),
+                               std::numeric_limits<float>::lowest(),
+                               std::numeric_limits<float>::lowest());
+  ComputeBoundingBox(mesh->vertices_, mesh);
+
+  return kRemoved;
 }
 
 }  // namespace data_representation
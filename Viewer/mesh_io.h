@@ -27,6 +27,14 @@ bool ReadFromPly(const std::string &filename, TriangleMesh *mesh);
  */
 bool WriteToPly(const std::string &filename, const TriangleMesh &mesh);
 
+/**
+ * @brief WeldVertices Merges the vertices that share the same position, remaps
+ * the faces accordingly and recomputes normals and bounding box.
+ * @param mesh The mesh to be welded.
+ * @return The number of vertices removed.
+ */
+int WeldVertices(TriangleMesh *mesh);
+
 }  // namespace data_representation
 
 #endif  // MESH_IO_H_
@@ -0,0 +1,157 @@
+#include "normalkernel.h"
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// atan(t) for t in [0, 1]: degree 17 minimax polynomial, max error ~2e-7 rad
+// (~4e-7 for atan2Positive, where pi - a rounds to a float)
+inline float atanUnit( float t ) {
+    float t2 = t * t;
+    return t * ( 1.0f + t2 * ( -0.33333325f + t2 * ( 0.19999189f + t2 * ( -0.14265916f + t2 * ( 0.10918862f
+             + t2 * ( -0.08156171f + t2 * ( 0.05095542f + t2 * ( -0.02142429f + t2 * 0.00424062f ) ) ) ) ) ) ) );
+}
+
+// atan2(y, x) for y >= 0, i.e. an angle in [0, pi]
+inline float atan2Positive( float y, float x ) {
+    float ax = std::fabs( x );
+    float hi = ax > y ? ax : y;
+    float lo = ax > y ? y : ax;
+    float a = hi > 0.0f ? atanUnit( lo / hi ) : 0.0f;
+    if ( y > ax ) a = 1.57079633f - a;
+    if ( x < 0.0f ) a = 3.14159265f - a;
+    return a;
+}
+
+#if defined(__AVX2__)
+inline __m256 atanUnit8( __m256 t ) {
+    __m256 t2 = _mm256_mul_ps( t, t );
+    __m256 p = _mm256_set1_ps( 0.00424062f );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( -0.02142429f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( 0.05095542f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( -0.08156171f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( 0.10918862f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( -0.14265916f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( 0.19999189f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( -0.33333325f ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( 1.0f ) );
+    return _mm256_mul_ps( p, t );
+}
+
+inline __m256 atan2Positive8( __m256 y, __m256 x ) {
+    const __m256 signMask = _mm256_set1_ps( -0.0f );
+    __m256 ax = _mm256_andnot_ps( signMask, x );
+    __m256 hi = _mm256_max_ps( ax, y );
+    __m256 lo = _mm256_min_ps( ax, y );
+    __m256 valid = _mm256_cmp_ps( hi, _mm256_setzero_ps(), _CMP_GT_OQ );
+    __m256 a = _mm256_and_ps( valid, atanUnit8( _mm256_div_ps( lo, hi ) ) );
+
+    __m256 swapped = _mm256_cmp_ps( y, ax, _CMP_GT_OQ );
+    a = _mm256_blendv_ps( a, _mm256_sub_ps( _mm256_set1_ps( 1.57079633f ), a ), swapped );
+    __m256 negative = _mm256_cmp_ps( x, _mm256_setzero_ps(), _CMP_LT_OQ );
+    a = _mm256_blendv_ps( a, _mm256_sub_ps( _mm256_set1_ps( 3.14159265f ), a ), negative );
+    return a;
+}
+#endif
+
+}  // namespace
+
+
+NormalAccumulator::NormalAccumulator( const std::vector<float>& vtx, std::vector<float>& normals )
+    : vtx( vtx ), normals( normals ), count( 0 ) {
+    normals.assign( vtx.size(), 0.0f );
+}
+
+
+void NormalAccumulator::flush() {
+    // SoA copy of the batch corners
+    alignas(32) float ax[ kBatch ], ay[ kBatch ], az[ kBatch ];
+    alignas(32) float bx[ kBatch ], by[ kBatch ], bz[ kBatch ];
+    alignas(32) float cx[ kBatch ], cy[ kBatch ], cz[ kBatch ];
+    for (int k = 0 ; k < kBatch ; ++k) {
+        // pad the tail with the last triangle, its results are ignored
+        int t = k < count ? k : count - 1;
+        ax[k] = vtx[ 3*ia[t] + 0 ]; ay[k] = vtx[ 3*ia[t] + 1 ]; az[k] = vtx[ 3*ia[t] + 2 ];
+        bx[k] = vtx[ 3*ib[t] + 0 ]; by[k] = vtx[ 3*ib[t] + 1 ]; bz[k] = vtx[ 3*ib[t] + 2 ];
+        cx[k] = vtx[ 3*ic[t] + 0 ]; cy[k] = vtx[ 3*ic[t] + 1 ]; cz[k] = vtx[ 3*ic[t] + 2 ];
+    }
+
+    // Per triangle: unit face normal and the angle at each corner
+    alignas(32) float nx[ kBatch ], ny[ kBatch ], nz[ kBatch ];
+    alignas(32) float wa[ kBatch ], wb[ kBatch ], wc[ kBatch ];
+
+#if defined(__AVX2__)
+    __m256 Ax = _mm256_load_ps( ax ), Ay = _mm256_load_ps( ay ), Az = _mm256_load_ps( az );
+    __m256 Bx = _mm256_load_ps( bx ), By = _mm256_load_ps( by ), Bz = _mm256_load_ps( bz );
+    __m256 Cx = _mm256_load_ps( cx ), Cy = _mm256_load_ps( cy ), Cz = _mm256_load_ps( cz );
+
+    __m256 abx = _mm256_sub_ps( Bx, Ax ), aby = _mm256_sub_ps( By, Ay ), abz = _mm256_sub_ps( Bz, Az );
+    __m256 acx = _mm256_sub_ps( Cx, Ax ), acy = _mm256_sub_ps( Cy, Ay ), acz = _mm256_sub_ps( Cz, Az );
+    __m256 bcx = _mm256_sub_ps( Cx, Bx ), bcy = _mm256_sub_ps( Cy, By ), bcz = _mm256_sub_ps( Cz, Bz );
+
+    __m256 Nx = _mm256_fmsub_ps( aby, acz, _mm256_mul_ps( abz, acy ) );
+    __m256 Ny = _mm256_fmsub_ps( abz, acx, _mm256_mul_ps( abx, acz ) );
+    __m256 Nz = _mm256_fmsub_ps( abx, acy, _mm256_mul_ps( aby, acx ) );
+    __m256 len = _mm256_sqrt_ps( _mm256_fmadd_ps( Nx, Nx, _mm256_fmadd_ps( Ny, Ny, _mm256_mul_ps( Nz, Nz ) ) ) );
+
+    // Degenerate triangles get a zero normal, so they add nothing
+    __m256 valid = _mm256_cmp_ps( len, _mm256_set1_ps( 1e-9f ), _CMP_GE_OQ );
+    __m256 inv = _mm256_and_ps( valid, _mm256_div_ps( _mm256_set1_ps( 1.0f ), len ) );
+    _mm256_store_ps( nx, _mm256_mul_ps( Nx, inv ) );
+    _mm256_store_ps( ny, _mm256_mul_ps( Ny, inv ) );
+    _mm256_store_ps( nz, _mm256_mul_ps( Nz, inv ) );
+
+    // |e1 x e2| is the same for the 3 corners, only the dot products change
+    __m256 dotA = _mm256_fmadd_ps( abx, acx, _mm256_fmadd_ps( aby, acy, _mm256_mul_ps( abz, acz ) ) );
+    __m256 dotB = _mm256_sub_ps( _mm256_setzero_ps(),                                                   // (c-b).(a-b)
+                                 _mm256_fmadd_ps( bcx, abx, _mm256_fmadd_ps( bcy, aby, _mm256_mul_ps( bcz, abz ) ) ) );
+    __m256 dotC = _mm256_fmadd_ps( acx, bcx, _mm256_fmadd_ps( acy, bcy, _mm256_mul_ps( acz, bcz ) ) ); // (a-c).(b-c)
+
+    _mm256_store_ps( wa, atan2Positive8( len, dotA ) );
+    _mm256_store_ps( wb, atan2Positive8( len, dotB ) );
+    _mm256_store_ps( wc, atan2Positive8( len, dotC ) );
+#else
+    for (int k = 0 ; k < count ; ++k) {
+        float abx = bx[k] - ax[k], aby = by[k] - ay[k], abz = bz[k] - az[k];
+        float acx = cx[k] - ax[k], acy = cy[k] - ay[k], acz = cz[k] - az[k];
+        float bcx = cx[k] - bx[k], bcy = cy[k] - by[k], bcz = cz[k] - bz[k];
+
+        float Nx = aby*acz - abz*acy, Ny = abz*acx - abx*acz, Nz = abx*acy - aby*acx;
+        float len = std::sqrt( Nx*Nx + Ny*Ny + Nz*Nz );
+        float inv = len >= 1e-9f ? 1.0f / len : 0.0f;
+        nx[k] = Nx * inv; ny[k] = Ny * inv; nz[k] = Nz * inv;
+
+        wa[k] = atan2Positive( len, abx*acx + aby*acy + abz*acz );
+        wb[k] = atan2Positive( len, -( bcx*abx + bcy*aby + bcz*abz ) );
+        wc[k] = atan2Positive( len, acx*bcx + acy*bcy + acz*bcz );
+    }
+#endif
+
+    // Scatter (scalar: corners of a batch may share vertices)
+    for (int k = 0 ; k < count ; ++k) {
+        normals[ 3*ia[k] + 0 ] += wa[k] * nx[k]; normals[ 3*ia[k] + 1 ] += wa[k] * ny[k]; normals[ 3*ia[k] + 2 ] += wa[k] * nz[k];
+        normals[ 3*ib[k] + 0 ] += wb[k] * nx[k]; normals[ 3*ib[k] + 1 ] += wb[k] * ny[k]; normals[ 3*ib[k] + 2 ] += wb[k] * nz[k];
+        normals[ 3*ic[k] + 0 ] += wc[k] * nx[k]; normals[ 3*ic[k] + 1 ] += wc[k] * ny[k]; normals[ 3*ic[k] + 2 ] += wc[k] * nz[k];
+    }
+    count = 0;
+}
+
+
+void NormalAccumulator::finish() {
+    if ( count > 0 ) flush();
+
+    // Finally, normalize every single norm
+    for (int i = 0; i < (int) normals.size(); i+=3) {
+        float lenSq = normals[ i + 0 ]*normals[ i + 0 ] + normals[ i + 1 ]*normals[ i + 1 ] + normals[ i + 2 ]*normals[ i + 2 ];
+        if ( lenSq >= 1e-18f ) {
+            float inv = 1.0f / std::sqrt( lenSq );
+            normals[ i + 0 ] *= inv;
+            normals[ i + 1 ] *= inv;
+            normals[ i + 2 ] *= inv;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef NORMALKERNEL_H
+#define NORMALKERNEL_H
+
+#include <vector>
+
+
+/**
+ * @brief The NormalAccumulator class Accumulates angle-weighted face normals
+ * into per-vertex normals, 8 triangles at a time (AVX2 when the build enables
+ * it, scalar otherwise). Corner angles are atan2(|e1 x e2|, e1 . e2) with a
+ * polynomial atan, so no acos/sqrt per corner is needed.
+ */
+class NormalAccumulator
+{
+public:
+    /**
+     * @brief NormalAccumulator Starts accumulating into normals, which is
+     * resized to vtx.size() and zeroed.
+     * @param vtx Vertex positions, 3 floats per vertex.
+     * @param normals Output normals, 3 floats per vertex.
+     */
+    NormalAccumulator( const std::vector<float>& vtx, std::vector<float>& normals );
+
+    /**
+     * @brief addTriangle Queues one triangle; the batch is processed when full.
+     */
+    void addTriangle( int a, int b, int c ) {
+        ia[ count ] = a; ib[ count ] = b; ic[ count ] = c;
+        if ( ++count == kBatch ) flush();
+    }
+
+    /**
+     * @brief finish Processes the pending triangles and normalizes the result.
+     */
+    void finish();
+
+    static const int kBatch = 8;
+
+private:
+    void flush();
+
+    const std::vector<float>& vtx;
+    std::vector<float>& normals;
+
+    int ia[ kBatch ], ib[ kBatch ], ic[ kBatch ];
+    int count;
+};
+
+#endif // NORMALKERNEL_H
@@ -0,0 +1,225 @@
+#include "occlusionculler.h"
+
+#include <algorithm>
+#include <utility>
+
+
+namespace {
+
+const GLfloat kCubeCorners[] = {
+    0, 0, 0,   1, 0, 0,   1, 1, 0,   0, 1, 0,
+    0, 0, 1,   1, 0, 1,   1, 1, 1,   0, 1, 1
+};
+
+const GLubyte kCubeIndices[] = {
+    0, 2, 1,  0, 3, 2,      // z = 0
+    4, 5, 6,  4, 6, 7,      // z = 1
+    0, 1, 5,  0, 5, 4,      // y = 0
+    3, 6, 2,  3, 7, 6,      // y = 1
+    0, 4, 7,  0, 7, 3,      // x = 0
+    1, 2, 6,  1, 6, 5       // x = 1
+};
+
+}  // namespace
+
+
+OcclusionCuller::OcclusionCuller( GLuint corner, GLuint boxMin, GLuint boxMax )
+    : cornerAttrib( corner ), minAttrib( boxMin ), maxAttrib( boxMax ),
+      vao( 0 ), cubeVbo( 0 ), cubeIbo( 0 ), boxVbo( 0 ),
+      frame( 0 ), batchSize( 16 ), visibleInterval( 8 ), occluded( 0 )
+{
+}
+
+
+OcclusionCuller::~OcclusionCuller()
+{
+    if ( vao == 0 ) return;
+
+    for ( const Query& q : inflight ) freeQueries.push_back( q.id );
+    if ( not freeQueries.empty() ) glDeleteQueries( freeQueries.size(), freeQueries.data() );
+    glDeleteVertexArrays( 1, &vao );
+    glDeleteBuffers( 1, &cubeVbo );
+    glDeleteBuffers( 1, &cubeIbo );
+    glDeleteBuffers( 1, &boxVbo );
+}
+
+
+void OcclusionCuller::init()
+{
+    glGenVertexArrays( 1, &vao );
+    glGenBuffers( 1, &cubeVbo );
+    glGenBuffers( 1, &cubeIbo );
+    glGenBuffers( 1, &boxVbo );
+
+    glBindVertexArray( vao );
+
+    glBindBuffer( GL_ARRAY_BUFFER, cubeVbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( kCubeCorners ), kCubeCorners, GL_STATIC_DRAW );
+    glVertexAttribPointer( cornerAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+    glEnableVertexAttribArray( cornerAttrib );
+
+    // Box min / max, one per instance; the pointers are set per query
+    glBindBuffer( GL_ARRAY_BUFFER, boxVbo );
+    glVertexAttribDivisor( minAttrib, 1 );
+    glVertexAttribDivisor( maxAttrib, 1 );
+    glEnableVertexAttribArray( minAttrib );
+    glEnableVertexAttribArray( maxAttrib );
+
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, cubeIbo );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( kCubeIndices ), kCubeIndices, GL_STATIC_DRAW );
+
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+
+void OcclusionCuller::resize( int n )
+{
+    // Results of in-flight queries would refer to the old instances
+    for ( const Query& q : inflight ) freeQueries.push_back( q.id );
+    inflight.clear();
+
+    state.resize( n );
+    for ( int k = 0; k < n; ++k ) {
+        state[ k ].visible = 1;
+        state[ k ].inFrustum = 0;
+        state[ k ].pending = 0;
+        state[ k ].lastQueried = frame - visibleInterval + k % visibleInterval;  // staggered
+    }
+    boxes.assign( 6 * n, 0.0f );
+}
+
+
+void OcclusionCuller::setBox( int k, const float min[ 3 ], const float max[ 3 ] )
+{
+    std::copy( min, min + 3, &boxes[ 6 * k ] );
+    std::copy( max, max + 3, &boxes[ 6 * k + 3 ] );
+}
+
+
+void OcclusionCuller::collect()
+{
+    size_t kept = 0;
+    for ( size_t q = 0; q < inflight.size(); ++q ) {
+        Query& query = inflight[ q ];
+
+        GLuint available = 0;
+        glGetQueryObjectuiv( query.id, GL_QUERY_RESULT_AVAILABLE, &available );
+        if ( not available ) {
+            if ( kept != q ) inflight[ kept ] = std::move( query );
+            ++kept;
+            continue;
+        }
+
+        GLuint anySamples = 0;
+        glGetQueryObjectuiv( query.id, GL_QUERY_RESULT, &anySamples );
+
+        for ( int k : query.members ) {
+            State& s = state[ k ];
+            s.pending = 0;
+            s.visible = anySamples != 0;
+
+            // A visible batch may hold occluded members: query them alone soon
+            if ( query.wasHidden and anySamples ) s.lastQueried = frame - visibleInterval;
+        }
+        freeQueries.push_back( query.id );
+    }
+    inflight.resize( kept );
+}
+
+
+void OcclusionCuller::filter( FrustumCuller& culler )
+{
+    ++frame;
+    occluded = 0;
+    hiddenCandidates.clear();
+    visibleCandidates.clear();
+
+    for ( int k = 0; k < (int) state.size(); ++k ) {
+        State& s = state[ k ];
+        if ( not culler.visible( k ) ) {
+            s.inFrustum = 0;
+            continue;
+        }
+        if ( not s.inFrustum ) {
+            s.inFrustum = 1;
+            s.visible = 1;
+        }
+
+        if ( not s.visible ) {
+            culler.hide( k );
+            ++occluded;
+            if ( not s.pending ) hiddenCandidates.push_back( k );
+        }
+        else if ( not s.pending and frame - s.lastQueried >= visibleInterval ) {
+            visibleCandidates.push_back( k );
+        }
+    }
+}
+
+
+int OcclusionCuller::issueQueries()
+{
+    int numQueries = visibleCandidates.size() + ( hiddenCandidates.size() + batchSize - 1 ) / batchSize;
+    if ( numQueries == 0 ) return 0;
+    if ( vao == 0 ) init();
+
+    // Visible candidates alone, hidden ones in batches; boxes in query order
+    std::vector< int > order( visibleCandidates );
+    order.insert( order.end(), hiddenCandidates.begin(), hiddenCandidates.end() );
+
+    uploadBoxes.resize( 6 * order.size() );
+    for ( size_t i = 0; i < order.size(); ++i )
+        std::copy( &boxes[ 6 * order[ i ] ], &boxes[ 6 * order[ i ] ] + 6, &uploadBoxes[ 6 * i ] );
+
+    glBindBuffer( GL_ARRAY_BUFFER, boxVbo );
+    glBufferData( GL_ARRAY_BUFFER, uploadBoxes.size() * sizeof( float ), uploadBoxes.data(), GL_STREAM_DRAW );
+
+    if ( (int) freeQueries.size() < numQueries ) {
+        size_t have = freeQueries.size();
+        freeQueries.resize( numQueries );
+        glGenQueries( numQueries - have, &freeQueries[ have ] );
+    }
+
+    // Only depth testing: no writes, and no face culling so a box around the
+    // camera still passes
+    GLboolean cullFace = glIsEnabled( GL_CULL_FACE );
+    glDisable( GL_CULL_FACE );
+    glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+    glDepthMask( GL_FALSE );
+    glBindVertexArray( vao );
+
+    size_t first = 0;
+    while ( first < order.size() ) {
+        bool hidden = first >= visibleCandidates.size();
+        size_t count = hidden ? std::min<size_t>( batchSize, order.size() - first ) : 1;
+
+        Query query;
+        query.id = freeQueries.back();
+        freeQueries.pop_back();
+        query.wasHidden = hidden;
+        query.members.assign( order.begin() + first, order.begin() + first + count );
+
+        glVertexAttribPointer( minAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof( float ), (const GLvoid*) ( first * 6 * sizeof( float ) ) );
+        glVertexAttribPointer( maxAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof( float ), (const GLvoid*) ( ( first * 6 + 3 ) * sizeof( float ) ) );
+
+        glBeginQuery( GL_ANY_SAMPLES_PASSED, query.id );
+        glDrawElementsInstanced( GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0, count );
+        glEndQuery( GL_ANY_SAMPLES_PASSED );
+
+        for ( int k : query.members ) {
+            state[ k ].pending = 1;
+            state[ k ].lastQueried = frame;
+        }
+        inflight.push_back( std::move( query ) );
+        first += count;
+    }
+
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glDepthMask( GL_TRUE );
+    glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+    if ( cullFace ) glEnable( GL_CULL_FACE );
+
+    return numQueries;
+}
@@ -0,0 +1,113 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "./frustumculler.h"
+
+
+/**
+ * @brief The OcclusionCuller class Hardware occlusion queries on instance
+ * bounding boxes with temporal coherence, in the spirit of CHC++:
+ *  - results are read back one or more frames later, only once available, so
+ *    the CPU never waits for the GPU;
+ *  - visible instances are drawn without waiting and re-queried only every
+ *    few frames (staggered per instance);
+ *  - previously hidden instances are queried in batches, one query for a
+ *    whole batch of boxes; a visible batch makes its members visible and has
+ *    them queried one by one next frame.
+ * Queries are GL_ANY_SAMPLES_PASSED (GL 3.3), drawn after the scene with
+ * color and depth writes off.
+ */
+class OcclusionCuller
+{
+public:
+    /**
+     * @brief OcclusionCuller Attribute locations of the box program: the unit
+     * cube corner and the per-instance box min / max.
+     */
+    OcclusionCuller( GLuint corner, GLuint boxMin, GLuint boxMax );
+    ~OcclusionCuller();
+
+    OcclusionCuller( const OcclusionCuller& ) = delete;
+    OcclusionCuller& operator=( const OcclusionCuller& ) = delete;
+
+    /**
+     * @brief resize Sets the number of instances; all start visible.
+     */
+    void resize( int n );
+    int size() const { return state.size(); }
+
+    /**
+     * @brief setBox Bounding box of instance k for this frame.
+     */
+    void setBox( int k, const float min[ 3 ], const float max[ 3 ] );
+
+    /**
+     * @brief collect Reads the results that are already available.
+     */
+    void collect();
+
+    /**
+     * @brief filter Hides from culler the instances known to be occluded and
+     * picks the ones to query this frame. Instances re-entering the frustum
+     * are assumed visible.
+     */
+    void filter( FrustumCuller& culler );
+
+    /**
+     * @brief issueQueries Draws the boxes of the instances picked by filter
+     * inside their queries. The box program must be bound, with the matrices
+     * set.
+     * @return Number of queries issued.
+     */
+    int issueQueries();
+
+    /**
+     * @brief numOccluded Instances inside the frustum hidden by the last filter.
+     */
+    int numOccluded() const { return occluded; }
+
+    void setBatchSize( int n ) { batchSize = n; }
+    void setVisibleInterval( int frames ) { visibleInterval = frames; }
+
+private:
+    struct State {
+        uint8_t visible;
+        uint8_t inFrustum;
+        uint8_t pending;
+        int lastQueried;
+    };
+
+    struct Query {
+        GLuint id;
+        std::vector< int > members;
+        bool wasHidden;
+    };
+
+    void init();
+
+    std::vector< State > state;
+    std::vector< float > boxes;         // min xyz, max xyz per instance
+
+    std::vector< int > hiddenCandidates;
+    std::vector< int > visibleCandidates;
+
+    std::vector< Query > inflight;
+    std::vector< GLuint > freeQueries;
+
+    GLuint cornerAttrib, minAttrib, maxAttrib;
+    GLuint vao, cubeVbo, cubeIbo, boxVbo;
+
+    std::vector< float > uploadBoxes;
+
+    int frame;
+    int batchSize;
+    int visibleInterval;
+    int occluded;
+};
+
+#endif // OCCLUSIONCULLER_H
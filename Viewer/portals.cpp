@@ -0,0 +1,286 @@
+#include "portals.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+const float kTwoPi = 2.0f * M_PI;
+const float kPortalMargin = 0.05f;      // cells added at both ends of a portal, for lines grazing a wall corner
+
+/**
+ * @brief The Doorway struct A gap in a wall line: cells [lo, hi) of row
+ * line if horizontal, of column line otherwise.
+ */
+struct Doorway
+{
+    bool horizontal;
+    int line, lo, hi;
+};
+
+float positiveMod( float a ) { a = std::fmod( a, kTwoPi ); return a < 0.0f ? a + kTwoPi : a; }
+
+}  // namespace
+
+
+PortalGraph::PortalGraph()
+    : nRows( 0 ), nCols( 0 ), nRooms( 0 ), eyeX( 0 ), eyeZ( 0 ), nVisible( 0 )
+{
+}
+
+
+void PortalGraph::build( const mapManager& map )
+{
+    nRows = map.rows();
+    nCols = map.cols();
+    nRooms = 0;
+    portals.clear();
+
+    // Cell k of a line, for both orientations
+    auto open = [&]( bool horizontal, int line, int k ) {
+        int row = horizontal ? line : k, col = horizontal ? k : line;
+        return map.inside( row, col ) and not map.isOpaque( row, col );
+    };
+    auto cellOf = [&]( bool horizontal, int line, int k ) { return horizontal ? line * nCols + k : k * nCols + line; };
+    auto bounded = [&]( bool horizontal, int line, int lo, int hi ) {
+        int length = horizontal ? nCols : nRows;
+        if ( lo == 0 or hi == length ) return false;
+        if ( open( horizontal, line, lo - 1 ) or open( horizontal, line, hi ) ) return false;
+        for ( int k = lo ; k < hi ; ++k ) if ( not open( horizontal, line, k ) ) return false;
+        return true;
+    };
+    auto anyOpen = [&]( bool horizontal, int line, int lo, int hi ) {
+        for ( int k = lo ; k < hi ; ++k ) if ( open( horizontal, line, k ) ) return true;
+        return false;
+    };
+
+    // Doorways: short runs between two wall cells, open on both sides, and
+    // not the inside of a corridor (the same gap before and after)
+    std::vector< Doorway > doors;
+    std::vector< int > doorOf( nRows * nCols, -1 );
+    for ( int o = 0 ; o < 2 ; ++o ) {
+        bool horizontal = o == 0;
+        int lines = horizontal ? nRows : nCols, length = horizontal ? nCols : nRows;
+        for ( int line = 0 ; line < lines ; ++line ) {
+            for ( int lo = 0 ; lo < length ; ) {
+                if ( not open( horizontal, line, lo ) ) { ++lo; continue; }
+                int hi = lo;
+                while ( hi < length and open( horizontal, line, hi ) ) ++hi;
+
+                bool door = hi - lo <= PORTAL_MAX_WIDTH and bounded( horizontal, line, lo, hi )
+                        and anyOpen( horizontal, line - 1, lo, hi ) and anyOpen( horizontal, line + 1, lo, hi )
+                        and not ( bounded( horizontal, line - 1, lo, hi ) and bounded( horizontal, line + 1, lo, hi ) );
+                for ( int k = lo ; k < hi and door ; ++k ) door = doorOf[ cellOf( horizontal, line, k ) ] < 0;
+                if ( door ) {
+                    for ( int k = lo ; k < hi ; ++k ) doorOf[ cellOf( horizontal, line, k ) ] = doors.size();
+                    doors.push_back( Doorway{ horizontal, line, lo, hi } );
+                }
+                lo = hi;
+            }
+        }
+    }
+
+    // Rooms of what is left. Doorways that do not join two different rooms
+    // go back to the floor and the rooms are filled again; one touching
+    // another doorway is given back at a time, so of two in a row one stays.
+    std::vector< char > alive( doors.size(), 1 );
+    std::vector< int > stack;
+    auto sideRoom = [&]( const Doorway& d, int side, bool* touchesDoor ) {
+        int found = -1;
+        for ( int k = d.lo ; k < d.hi ; ++k ) {
+            if ( not open( d.horizontal, d.line + side, k ) ) continue;
+            int r = roomOf[ cellOf( d.horizontal, d.line + side, k ) ];
+            if ( r < 0 ) { *touchesDoor = true; return -1; }
+            if ( found >= 0 and r != found ) return -1;
+            found = r;
+        }
+        return found;
+    };
+    for ( bool changed = true ; changed ; ) {
+        roomOf.assign( nRows * nCols, -1 );
+        nRooms = 0;
+        for ( int start = 0 ; start < nRows * nCols ; ++start ) {
+            if ( roomOf[ start ] >= 0 or doorOf[ start ] >= 0 or map.isOpaque( start / nCols, start % nCols ) ) continue;
+            roomOf[ start ] = nRooms;
+            stack.assign( 1, start );
+            while ( not stack.empty() ) {
+                int c = stack.back();
+                stack.pop_back();
+                const int row = c / nCols, col = c % nCols;
+                const int next[ 4 ][ 2 ] = { { row - 1, col }, { row + 1, col }, { row, col - 1 }, { row, col + 1 } };
+                for ( const int* n : next ) {
+                    if ( not map.inside( n[0], n[1] ) or map.isOpaque( n[0], n[1] ) ) continue;
+                    int k = n[0] * nCols + n[1];
+                    if ( roomOf[ k ] >= 0 or doorOf[ k ] >= 0 ) continue;
+                    roomOf[ k ] = nRooms;
+                    stack.push_back( k );
+                }
+            }
+            ++nRooms;
+        }
+
+        changed = false;
+        int touching = -1;
+        for ( size_t d = 0 ; d < doors.size() ; ++d ) {
+            if ( not alive[ d ] ) continue;
+            bool touchesDoor = false;
+            int a = sideRoom( doors[ d ], -1, &touchesDoor ), b = sideRoom( doors[ d ], 1, &touchesDoor );
+            if ( a >= 0 and b >= 0 and a != b ) continue;
+            if ( touchesDoor ) {
+                if ( touching < 0 ) touching = d;
+                continue;
+            }
+            alive[ d ] = 0;
+            changed = true;
+        }
+        if ( not changed and touching >= 0 ) {
+            alive[ touching ] = 0;
+            changed = true;
+        }
+        for ( size_t d = 0 ; d < doors.size() ; ++d )
+            if ( not alive[ d ] and doorOf[ cellOf( doors[ d ].horizontal, doors[ d ].line, doors[ d ].lo ) ] == int( d ) )
+                for ( int k = doors[ d ].lo ; k < doors[ d ].hi ; ++k ) doorOf[ cellOf( doors[ d ].horizontal, doors[ d ].line, k ) ] = -1;
+    }
+
+    // Doorway cells belong to the room before them; the portal is their edge
+    // towards the room after them, in cell units with cells centered on
+    // integers
+    for ( size_t d = 0 ; d < doors.size() ; ++d ) {
+        if ( not alive[ d ] ) continue;
+        const Doorway& door = doors[ d ];
+        bool touchesDoor = false;
+        int a = sideRoom( door, -1, &touchesDoor ), b = sideRoom( door, 1, &touchesDoor );
+        for ( int k = door.lo ; k < door.hi ; ++k ) roomOf[ cellOf( door.horizontal, door.line, k ) ] = a;
+
+        float edge = door.line + 0.5f, lo = door.lo - 0.5f - kPortalMargin, hi = door.hi - 0.5f + kPortalMargin;
+        Portal p = door.horizontal ? Portal{ a, b, lo, edge, hi, edge } : Portal{ a, b, edge, lo, edge, hi };
+        portals.push_back( p );
+        std::swap( p.from, p.to );
+        portals.push_back( p );
+    }
+
+    std::sort( portals.begin(), portals.end(), []( const Portal& p, const Portal& q ) { return p.from < q.from; } );
+    firstPortal.assign( nRooms + 1, 0 );
+    for ( const Portal& p : portals ) ++firstPortal[ p.from + 1 ];
+    for ( int r = 0 ; r < nRooms ; ++r ) firstPortal[ r + 1 ] += firstPortal[ r ];
+
+    views.assign( nRooms, std::vector< Wedge >() );
+    nVisible = 0;
+}
+
+
+bool PortalGraph::traverse( const Eigen::Matrix4f& projection, const Eigen::Matrix4f& viewModel, float cellSize )
+{
+    Eigen::Matrix4f inverse = viewModel.inverse();
+    Eigen::Vector4f eye = inverse * Eigen::Vector4f( 0, 0, 0, 1 );
+    Eigen::Matrix3f toMap = inverse.block< 3, 3 >( 0, 0 );
+
+    // The frustum seen from above is the cone of its four edges. If an edge
+    // points behind the view direction (looking down) take every direction.
+    Eigen::Vector3f forward = toMap * Eigen::Vector3f( 0, 0, -1 );
+    float forwardAngle = std::atan2( forward[2], forward[0] );
+    bool all = std::abs( forward[0] ) + std::abs( forward[2] ) < 1e-6f;
+    float lo = 0.0f, hi = 0.0f;
+    Eigen::Matrix4f unproject = projection.inverse();
+    for ( int corner = 0 ; corner < 4 and not all ; ++corner ) {
+        Eigen::Vector4f p = unproject * Eigen::Vector4f( corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, 1, 1 );
+        Eigen::Vector3f edge = toMap * ( p.head< 3 >() / p[3] );
+        if ( std::abs( edge[0] ) + std::abs( edge[2] ) < 1e-6f ) { all = true; break; }
+        float a = positiveMod( std::atan2( edge[2], edge[0] ) - forwardAngle + M_PI ) - M_PI;
+        if ( std::abs( a ) >= M_PI / 2 ) all = true;
+        lo = corner == 0 ? a : std::min( lo, a );
+        hi = corner == 0 ? a : std::max( hi, a );
+    }
+
+    float x = eye[0] / eye[3] / cellSize, z = eye[2] / eye[3] / cellSize;
+    if ( all ) return traverse( x, z, 0.0f, kTwoPi );
+    return traverse( x, z, forwardAngle + lo, hi - lo );
+}
+
+
+bool PortalGraph::traverse( float x, float z, float from, float width )
+{
+    eyeX = x;
+    eyeZ = z;
+    for ( std::vector< Wedge >& v : views ) v.clear();
+    onPath.assign( nRooms, 0 );
+    nVisible = 0;
+
+    int r = room( std::floor( z + 0.5f ), std::floor( x + 0.5f ) );
+    if ( r < 0 ) return false;
+
+    enter( r, Wedge{ positiveMod( from ), std::min( width, kTwoPi ) }, 0 );
+    return true;
+}
+
+
+void PortalGraph::enter( int r, Wedge w, int depth )
+{
+    // Nothing new behind a room already reached with a wider interval
+    for ( const Wedge& seen : views[ r ] )
+        if ( seen.width >= kTwoPi or positiveMod( w.from - seen.from ) + w.width <= seen.width ) return;
+
+    nVisible += views[ r ].empty();
+    views[ r ].push_back( w );
+    if ( depth == PORTAL_MAX_DEPTH ) return;
+
+    onPath[ r ] = 1;
+    for ( int i = firstPortal[ r ] ; i < firstPortal[ r + 1 ] ; ++i ) {
+        const Portal& p = portals[ i ];
+        if ( onPath[ p.to ] ) continue;
+
+        // From inside the doorway the portal does not narrow anything
+        Eigen::Vector2f a( p.x0 - eyeX, p.z0 - eyeZ ), b( p.x1 - eyeX, p.z1 - eyeZ );
+        Eigen::Vector2f ab = b - a;
+        float t = std::max( 0.0f, std::min( 1.0f, -a.dot( ab ) / ab.squaredNorm() ) );
+        if ( ( a + t * ab ).norm() < 1.0f ) {
+            enter( p.to, w, depth + 1 );
+            continue;
+        }
+
+        float from = std::atan2( a[1], a[0] );
+        float width = positiveMod( std::atan2( b[1], b[0] ) - from + M_PI ) - M_PI;
+        if ( width < 0.0f ) {
+            from += width;
+            width = -width;
+        }
+
+        // The interval through the portal: up to two pieces, the portal
+        // starting inside w or before it
+        if ( w.width >= kTwoPi ) {
+            enter( p.to, Wedge{ positiveMod( from ), width }, depth + 1 );
+            continue;
+        }
+        float offset = positiveMod( from - w.from );
+        if ( offset <= w.width )
+            enter( p.to, Wedge{ positiveMod( w.from + offset ), std::min( width, w.width - offset ) }, depth + 1 );
+        if ( offset - kTwoPi + width >= 0.0f )
+            enter( p.to, Wedge{ w.from, std::min( offset - kTwoPi + width, w.width ) }, depth + 1 );
+    }
+    onPath[ r ] = 0;
+}
+
+
+bool PortalGraph::overlaps( const Wedge& w, float from, float width ) const
+{
+    if ( w.width >= kTwoPi ) return true;
+    float offset = positiveMod( from - w.from );
+    return offset <= w.width or offset + width >= kTwoPi;
+}
+
+
+bool PortalGraph::circleVisible( int r, float x, float z, float radius ) const
+{
+    if ( not roomVisible( r ) ) return false;
+
+    float dx = x - eyeX, dz = z - eyeZ;
+    float distance = std::sqrt( dx * dx + dz * dz );
+    if ( distance <= radius ) return true;
+
+    float half = std::asin( radius / distance );
+    float center = std::atan2( dz, dx );
+    for ( const Wedge& w : views[ r ] )
+        if ( overlaps( w, center - half, 2 * half ) ) return true;
+    return false;
+}
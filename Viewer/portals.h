@@ -0,0 +1,112 @@
+#ifndef PORTALS_H
+#define PORTALS_H
+
+#include <vector>
+
+#include <eigen3/Eigen/Geometry>
+
+#include "./mapmanager.h"
+
+
+#define PORTAL_MAX_WIDTH 3      // widest gap in a wall taken as a doorway, in cells
+#define PORTAL_MAX_DEPTH 64     // portals crossed along one path at most
+
+
+/**
+ * @brief The Portal struct Opening from one room to another: a segment in
+ * map cell units (x = col, z = row). Each doorway is stored once per
+ * direction.
+ */
+struct Portal
+{
+    int from, to;
+    float x0, z0, x1, z1;
+};
+
+
+/**
+ * @brief The PortalGraph class Rooms and portals of a map, and the rooms and
+ * directions seen from a camera through them.
+ *
+ * Doorways are gaps of at most PORTAL_MAX_WIDTH non-opaque cells in a wall
+ * line, open on both sides; windows ('x') count as gaps. Rooms are the
+ * 4-connected regions left once the doorway cells are taken out, and each
+ * doorway joins its cells to the room before it and becomes a portal to the
+ * room after it. Gaps that do not end up between two different rooms are
+ * plain floor.
+ *
+ * traverse starts from the room of the camera with the view frustum seen
+ * from above as an angular interval around the eye, and crosses every portal
+ * the interval reaches with the interval narrowed to the portal. Like the
+ * PVS, the map is taken as 2D: walls hide everything behind them at any
+ * height.
+ */
+class PortalGraph
+{
+public:
+    PortalGraph();
+
+    /**
+     * @brief build Extracts the rooms and portals of map.
+     */
+    void build( const mapManager& map );
+
+    bool empty() const { return roomOf.empty(); }
+    int numRooms() const { return nRooms; }
+    int numPortals() const { return portals.size() / 2; }
+
+    /**
+     * @brief room Room of cell (row, col), or -1 if it is opaque or outside
+     * the map.
+     */
+    int room( int row, int col ) const {
+        if ( row < 0 or row >= nRows or col < 0 or col >= nCols ) return -1;
+        return roomOf[ row * nCols + col ];
+    }
+
+    /**
+     * @brief traverse Finds what is seen through the portals from the eye of
+     * viewModel, the space the map lives in scaled by cellSize. Returns
+     * false, leaving nothing visible, if the eye is not in a room.
+     */
+    bool traverse( const Eigen::Matrix4f& projection, const Eigen::Matrix4f& viewModel, float cellSize );
+
+    /**
+     * @brief traverse Same from an eye (in cell units) looking at the
+     * directions of the interval [from, from + width] (radians around y,
+     * atan2( z, x ); width 2 pi or more for all of them).
+     */
+    bool traverse( float eyeX, float eyeZ, float from, float width );
+
+    /**
+     * @brief Results of the last traverse.
+     */
+    bool roomVisible( int r ) const { return r >= 0 and not views[ r ].empty(); }
+    int visibleRooms() const { return nVisible; }
+
+    /**
+     * @brief circleVisible Whether a circle of room r (in cell units) is in
+     * some interval the room was reached with.
+     */
+    bool circleVisible( int r, float x, float z, float radius ) const;
+
+private:
+    struct Wedge {
+        float from, width;
+    };
+
+    void enter( int r, Wedge w, int depth );
+    bool overlaps( const Wedge& w, float from, float width ) const;
+
+    int nRows, nCols, nRooms;
+    std::vector< int > roomOf;
+    std::vector< Portal > portals;
+    std::vector< int > firstPortal;     // portals of room r: [firstPortal[r], firstPortal[r + 1])
+
+    float eyeX, eyeZ;
+    std::vector< std::vector< Wedge > > views;
+    std::vector< char > onPath;
+    int nVisible;
+};
+
+#endif // PORTALS_H
@@ -0,0 +1,306 @@
+#include "pvs.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+
+#define PVS_MAGIC "PVS2"
+
+
+namespace {
+
+/**
+ * @brief addCells Merges the sorted cells [cells, cells + n) into the sorted
+ * runs of a cell, joining the runs that end up adjacent.
+ */
+template < typename Run >
+void addCells( std::vector< Run >& runs, const int* cells, int n )
+{
+    std::vector< Run > merged;
+    merged.reserve( runs.size() + n );
+    auto append = [&]( int first, int last ) {
+        if ( not merged.empty() and first <= merged.back().last )
+            merged.back().last = std::max( merged.back().last, last );
+        else
+            merged.push_back( Run{ first, last } );
+    };
+
+    size_t r = 0;
+    int i = 0;
+    while ( r < runs.size() or i < n ) {
+        if ( i == n or ( r < runs.size() and runs[ r ].first <= cells[ i ] ) ) {
+            append( runs[ r ].first, runs[ r ].last );
+            ++r;
+        }
+        else {
+            append( cells[ i ], cells[ i ] + 1 );
+            ++i;
+        }
+    }
+    runs.swap( merged );
+}
+
+template < typename Run >
+bool contains( const std::vector< Run >& runs, int cell )
+{
+    auto r = std::upper_bound( runs.begin(), runs.end(), cell, []( int c, const Run& run ) { return c < run.first; } );
+    return r != runs.begin() and cell < ( r - 1 )->last;
+}
+
+}  // namespace
+
+
+PotentiallyVisibleSet::PotentiallyVisibleSet() : nRows( 0 ), nCols( 0 ), mapHash( 0 )
+{
+}
+
+
+void PotentiallyVisibleSet::clear()
+{
+    nRows = 0;
+    nCols = 0;
+    mapHash = 0;
+    std::vector< uint64_t >().swap( firstRun );
+    std::vector< Run >().swap( runs );
+}
+
+
+uint32_t PotentiallyVisibleSet::hashMap( const mapManager& map )
+{
+    // FNV-1a over the cells
+    uint32_t h = 2166136261u;
+    for ( int r = 0; r < map.rows(); ++r ) {
+        for ( int c = 0; c < map.cols(); ++c ) {
+            h ^= uint8_t( map.cell( r, c ) );
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+
+// Appends to touched every cell reached from cell that mark does not hold
+// yet, and marks it. rays holds the (dx, dy) of the directions of each origin.
+void PotentiallyVisibleSet::castRays( const mapManager& map, int cell, const std::vector< double >& rays,
+                                      int samplesPerSide, std::vector< int >& mark, std::vector< int >& touched ) const
+{
+    int r0 = cell / nCols, c0 = cell % nCols;
+    int directions = rays.size() / 2 / ( samplesPerSide * samplesPerSide );
+    mark[ cell ] = cell;
+    touched.push_back( cell );
+
+    for ( int s = 0; s < samplesPerSide * samplesPerSide; ++s ) {
+        // Origin inside the cell (x = column, y = row)
+        double ox = c0 + ( s % samplesPerSide + 0.5 ) / samplesPerSide;
+        double oy = r0 + ( s / samplesPerSide + 0.5 ) / samplesPerSide;
+
+        for ( int d = 0; d < directions; ++d ) {
+            double dx = rays[ 2 * ( s * directions + d ) ], dy = rays[ 2 * ( s * directions + d ) + 1 ];
+
+            int cx = c0, cy = r0;
+            int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+            double deltaX = dx != 0.0 ? std::fabs( 1.0 / dx ) : 1e30;
+            double deltaY = dy != 0.0 ? std::fabs( 1.0 / dy ) : 1e30;
+            double tMaxX = dx > 0 ? ( cx + 1 - ox ) * deltaX : ( ox - cx ) * deltaX;
+            double tMaxY = dy > 0 ? ( cy + 1 - oy ) * deltaY : ( oy - cy ) * deltaY;
+
+            while ( true ) {
+                if ( tMaxX < tMaxY ) { cx += stepX; tMaxX += deltaX; }
+                else                 { cy += stepY; tMaxY += deltaY; }
+
+                if ( not map.inside( cy, cx ) ) break;
+
+                int target = cy * nCols + cx;
+                if ( mark[ target ] != cell ) {
+                    mark[ target ] = cell;
+                    touched.push_back( target );
+                }
+                if ( map.isOpaque( cy, cx ) ) break;
+            }
+        }
+    }
+}
+
+
+bool PotentiallyVisibleSet::compute( const mapManager& map, int threads, int samplesPerSide, int directions,
+                                     const std::atomic<bool>* cancel )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    clear();
+    int numCells = map.rows() * map.cols();
+    if ( numCells > PVS_MAX_CELLS ) {
+        std::cout << "PVS: " << map.rows() << "x" << map.cols() << " cells, more than " << PVS_MAX_CELLS
+                  << "; not computed" << std::endl;
+        return false;
+    }
+    nRows = map.rows();
+    nCols = map.cols();
+
+    if ( threads <= 0 ) threads = std::max( 1u, std::thread::hardware_concurrency() );
+    auto cancelled = [&]() { return cancel != nullptr and cancel->load(); };
+    auto run = [&]( std::function< void( int ) > worker ) {
+        std::vector< std::thread > pool;
+        for ( int t = 0; t < threads; ++t ) pool.emplace_back( worker, t );
+        for ( std::thread& t : pool ) t.join();
+    };
+
+    // Ray directions, rotated per origin so the rays do not line up
+    std::vector< double > rays;
+    rays.reserve( 2 * samplesPerSide * samplesPerSide * directions );
+    for ( int s = 0; s < samplesPerSide * samplesPerSide; ++s ) {
+        double jitter = std::fmod( s * 0.618033988749895, 1.0 );
+        for ( int d = 0; d < directions; ++d ) {
+            double angle = 2.0 * M_PI * ( d + jitter ) / directions;
+            rays.push_back( std::cos( angle ) );
+            rays.push_back( std::sin( angle ) );
+        }
+    }
+
+    // Runs reached from every cell. Every thread owns the cells it takes, so
+    // no locking; mark keeps each cell from being added twice.
+    std::vector< std::vector< Run > > reached( numCells );
+    std::atomic<int> next( 0 );
+    run( [&]( int ) {
+        std::vector< int > mark( numCells, -1 ), touched;
+        int cell;
+        while ( ( cell = next++ ) < numCells and not cancelled() ) {
+            if ( map.isOpaque( cell / nCols, cell % nCols ) ) continue;
+            touched.clear();
+            castRays( map, cell, rays, samplesPerSide, mark, touched );
+            std::sort( touched.begin(), touched.end() );
+            addCells( reached[ cell ], touched.data(), touched.size() );
+        }
+    } );
+
+    // Symmetrize: each thread finds the cells b its cells a reach without b
+    // reaching a back. Those are rays missed by the sampling, so only a few
+    // pairs, added to the runs of b afterwards (again one thread per b).
+    std::vector< std::vector< std::pair< int, int > > > missed( threads );
+    next = 0;
+    run( [&]( int t ) {
+        int a;
+        while ( ( a = next++ ) < numCells and not cancelled() )
+            for ( const Run& r : reached[ a ] )
+                for ( int b = r.first; b < r.last; ++b )
+                    if ( not reached[ b ].empty() and not contains( reached[ b ], a ) )
+                        missed[ t ].push_back( std::make_pair( b, a ) );
+    } );
+    if ( cancelled() ) {
+        clear();
+        return false;
+    }
+
+    std::vector< std::pair< int, int > > pairs;
+    for ( const auto& m : missed ) pairs.insert( pairs.end(), m.begin(), m.end() );
+    std::sort( pairs.begin(), pairs.end() );
+    std::vector< size_t > groups;     // first pair of each b
+    for ( size_t i = 0; i < pairs.size(); ++i )
+        if ( i == 0 or pairs[ i ].first != pairs[ i - 1 ].first ) groups.push_back( i );
+    groups.push_back( pairs.size() );
+
+    next = 0;
+    run( [&]( int ) {
+        std::vector< int > cells;
+        int g;
+        while ( ( g = next++ ) + 1 < (int) groups.size() ) {
+            cells.clear();
+            for ( size_t i = groups[ g ]; i < groups[ g + 1 ]; ++i ) cells.push_back( pairs[ i ].second );
+            addCells( reached[ pairs[ groups[ g ] ].first ], cells.data(), cells.size() );
+        }
+    } );
+
+    // Flatten
+    firstRun.assign( numCells + 1, 0 );
+    for ( int c = 0; c < numCells; ++c ) firstRun[ c + 1 ] = firstRun[ c ] + reached[ c ].size();
+    runs.reserve( firstRun[ numCells ] );
+    for ( int c = 0; c < numCells; ++c ) {
+        runs.insert( runs.end(), reached[ c ].begin(), reached[ c ].end() );
+        std::vector< Run >().swap( reached[ c ] );
+    }
+    mapHash = hashMap( map );
+
+    double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    std::cout << "PVS: " << nRows << "x" << nCols << " cells, " << runs.size() << " runs ("
+              << pairs.size() << " added to symmetrize), " << threads << " threads, " << ms << " ms" << std::endl;
+    return true;
+}
+
+
+int PotentiallyVisibleSet::visibleCount( int row, int col ) const
+{
+    int cell = row * nCols + col;
+    int n = 0;
+    for ( uint64_t r = firstRun[ cell ]; r < firstRun[ cell + 1 ]; ++r ) n += runs[ r ].last - runs[ r ].first;
+    return n;
+}
+
+
+bool PotentiallyVisibleSet::save( const std::string& filename ) const
+{
+    std::ofstream fout( filename.c_str(), std::ios_base::out | std::ios_base::binary );
+    if ( not fout.is_open() ) return false;
+
+    // Run count per cell, then every run
+    int numCells = nRows * nCols;
+    std::vector< uint32_t > counts( numCells );
+    for ( int c = 0; c < numCells; ++c ) counts[ c ] = firstRun[ c + 1 ] - firstRun[ c ];
+
+    int32_t header[ 2 ] = { nRows, nCols };
+    fout.write( PVS_MAGIC, 4 );
+    fout.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+    fout.write( reinterpret_cast<const char*>( &mapHash ), sizeof( mapHash ) );
+    fout.write( reinterpret_cast<const char*>( counts.data() ), counts.size() * sizeof( uint32_t ) );
+    fout.write( reinterpret_cast<const char*>( runs.data() ), runs.size() * sizeof( Run ) );
+    return fout.good();
+}
+
+
+bool PotentiallyVisibleSet::load( const std::string& filename, const mapManager& map )
+{
+    std::ifstream fin( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( not fin.is_open() ) return false;
+
+    char magic[ 4 ];
+    int32_t header[ 2 ];
+    uint32_t hash;
+    fin.read( magic, 4 );
+    fin.read( reinterpret_cast<char*>( header ), sizeof( header ) );
+    fin.read( reinterpret_cast<char*>( &hash ), sizeof( hash ) );
+    if ( not fin.good() or std::memcmp( magic, PVS_MAGIC, 4 ) != 0 ) return false;
+    if ( header[0] != map.rows() or header[1] != map.cols() or hash != hashMap( map ) ) return false;
+
+    int numCells = header[0] * header[1];
+    std::vector< uint32_t > counts( numCells );
+    fin.read( reinterpret_cast<char*>( counts.data() ), counts.size() * sizeof( uint32_t ) );
+    if ( not fin.good() ) return false;
+
+    std::vector< uint64_t > first( numCells + 1, 0 );
+    for ( int c = 0; c < numCells; ++c ) first[ c + 1 ] = first[ c ] + counts[ c ];
+    std::vector< Run > loaded( first[ numCells ] );
+    fin.read( reinterpret_cast<char*>( loaded.data() ), loaded.size() * sizeof( Run ) );
+    if ( not fin.good() ) return false;
+
+    nRows = header[0];
+    nCols = header[1];
+    mapHash = hash;
+    firstRun.swap( first );
+    runs.swap( loaded );
+    return true;
+}
+
+
+void PotentiallyVisibleSet::loadOrCompute( const std::string& filename, const mapManager& map,
+                                           const std::atomic<bool>* cancel )
+{
+    if ( load( filename, map ) ) return;
+
+    if ( compute( map, 0, 4, 512, cancel ) and not save( filename ) )
+        std::cerr << "Could not write " << filename << std::endl;
+}
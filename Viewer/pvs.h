@@ -0,0 +1,96 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./mapmanager.h"
+
+
+#define PVS_MAX_CELLS ( 1 << 18 )     // larger maps get no PVS (rays per cell make it too slow)
+
+
+/**
+ * @brief The PotentiallyVisibleSet class Cell-to-cell visibility of a map:
+ * for every non-opaque cell, the sorted runs of cells that some ray from it
+ * reaches. Rays are traced with a 2D DDA and stop at the first opaque ('X')
+ * cell, which is itself marked visible. The relation is made symmetric
+ * afterwards to patch rays missed in one direction.
+ *
+ * A run is a half-open range [first, last) of cell indices (row * cols + col).
+ * What a cell sees is usually a few runs per map row, so the set takes space
+ * in proportion to it instead of cells^2 bits.
+ */
+class PotentiallyVisibleSet
+{
+public:
+    PotentiallyVisibleSet();
+
+    /**
+     * @brief compute Casts samplesPerSide^2 origins x directions rays from
+     * every non-opaque cell of map, split over threads (0 = hardware
+     * concurrency), which also make the result symmetric. Returns false,
+     * leaving the set empty, if the map has more than PVS_MAX_CELLS cells or
+     * cancel was set meanwhile.
+     */
+    bool compute( const mapManager& map, int threads = 0, int samplesPerSide = 4, int directions = 512,
+                  const std::atomic<bool>* cancel = nullptr );
+
+    /**
+     * @brief save Writes the runs (and the map size and hash they belong to).
+     */
+    bool save( const std::string& filename ) const;
+
+    /**
+     * @brief load Reads runs written by save. Fails if they were computed for
+     * another map.
+     */
+    bool load( const std::string& filename, const mapManager& map );
+
+    /**
+     * @brief loadOrCompute Loads filename if it matches map, otherwise computes
+     * the PVS and saves it there. cancel as in compute.
+     */
+    void loadOrCompute( const std::string& filename, const mapManager& map, const std::atomic<bool>* cancel = nullptr );
+
+    void clear();
+    bool empty() const { return firstRun.empty(); }
+    int rows() const { return nRows; }
+    int cols() const { return nCols; }
+
+    /**
+     * @brief visible Whether cell (toRow, toCol) may be seen from (fromRow,
+     * fromCol). Both must be inside the map; opaque cells see nothing.
+     */
+    bool visible( int fromRow, int fromCol, int toRow, int toCol ) const {
+        int a = fromRow * nCols + fromCol, b = toRow * nCols + toCol;
+        const Run* lo = runs.data() + firstRun[ a ];
+        const Run* hi = runs.data() + firstRun[ a + 1 ];
+        const Run* r = std::upper_bound( lo, hi, b, []( int cell, const Run& run ) { return cell < run.first; } );
+        return r != lo and b < ( r - 1 )->last;
+    }
+
+    /**
+     * @brief visibleCount Number of cells visible from (row, col).
+     */
+    int visibleCount( int row, int col ) const;
+
+private:
+    struct Run {
+        int32_t first, last;
+    };
+
+    void castRays( const mapManager& map, int cell, const std::vector< double >& rays, int samplesPerSide,
+                   std::vector< int >& mark, std::vector< int >& touched ) const;
+    static uint32_t hashMap( const mapManager& map );
+
+    int nRows, nCols;
+    uint32_t mapHash;
+    std::vector< uint64_t > firstRun;   // runs of cell c: [firstRun[c], firstRun[c + 1])
+    std::vector< Run > runs;
+};
+
+#endif // PVS_H
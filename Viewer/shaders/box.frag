@@ -0,0 +1,7 @@
+#version 330
+
+out vec4 frag_color;
+
+void main (void) {
+    frag_color = vec4(1.0);
+}
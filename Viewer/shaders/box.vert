@@ -0,0 +1,13 @@
+#version 330
+
+layout (location = 0) in vec3 corner;   // unit cube
+layout (location = 1) in vec3 boxMin;   // per instance
+layout (location = 2) in vec3 boxMax;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+void main(void)  {
+    gl_Position = projection * view * model * vec4(mix(boxMin, boxMax, corner), 1);
+}
@@ -0,0 +1,104 @@
+#version 330
+
+smooth in vec3 local;
+flat in vec3 to_eye;
+flat in vec3 sphere_center;
+
+uniform sampler2D color_atlas;          // rgb, coverage
+uniform sampler2D normal_depth_atlas;   // object-space normal, depth
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+uniform mat3 normal_matrix;
+uniform float radius;
+
+// IMPOSTOR_FRAMES and IMPOSTOR_FRAME_SIZE (impostor.h)
+const float kFrames = 8.0;
+const float kFrameSize = 64.0;
+
+out vec4 frag_color;
+
+float signNotZero(float x) {
+    return x >= 0.0 ? 1.0 : -1.0;
+}
+
+// Octahedral map of the sphere, y up; same as ImpostorAtlas::octDecode
+vec2 octEncode(vec3 d) {
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    if (d.y >= 0.0) return d.xz;
+    return vec2((1.0 - abs(d.z)) * signNotZero(d.x), (1.0 - abs(d.x)) * signNotZero(d.z));
+}
+
+vec3 octDecode(vec2 p) {
+    vec3 d = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (d.y < 0.0) d.xz = vec2((1.0 - abs(p.y)) * signNotZero(p.x), (1.0 - abs(p.x)) * signNotZero(p.y));
+    return normalize(d);
+}
+
+// Same as ImpostorAtlas::frameBasis
+void frameBasis(vec3 dir, out vec3 right, out vec3 up) {
+    vec3 reference = abs(dir.y) > 0.99 ? vec3(0, 0, 1) : vec3(0, 1, 0);
+    right = normalize(cross(reference, dir));
+    up = cross(dir, right);
+}
+
+// Adds view f of the atlas, reprojected at this quad point, with weight w
+void addFrame(vec2 f, float w, inout vec4 color, inout vec3 normal, inout vec3 position, inout float covered) {
+    vec3 dir = octDecode((f + 0.5) / kFrames * 2.0 - 1.0);
+    vec3 right, up;
+    frameBasis(dir, right, up);
+
+    vec2 uv = vec2(dot(local, right), dot(local, up));
+    if (any(greaterThan(abs(uv), vec2(1.0)))) return;
+
+    // Stay inside the view, or filtering bleeds the neighbours in
+    float border = 0.5 / kFrameSize;
+    vec2 st = (f + clamp(uv * 0.5 + 0.5, border, 1.0 - border)) / kFrames;
+    vec4 c = texture(color_atlas, st);
+    vec4 nd = texture(normal_depth_atlas, st);
+
+    float a = w * c.a;
+    color += w * c;
+    normal += a * nd.xyz;
+    position += a * (uv.x * right + uv.y * up + (1.0 - 2.0 * nd.w) * dir);
+    covered += a;
+}
+
+void main (void) {
+    // The four views around the direction to the camera, bilinearly weighted
+    vec2 g = (octEncode(to_eye) * 0.5 + 0.5) * kFrames - 0.5;
+    vec2 base = floor(g);
+    vec2 t = g - base;
+
+    vec4 color = vec4(0.0);
+    vec3 normal = vec3(0.0);
+    vec3 position = vec3(0.0);
+    float covered = 0.0;
+    for (int k = 0; k < 4; ++k) {
+        vec2 o = vec2(k & 1, k >> 1);
+        vec2 f = clamp(base + o, 0.0, kFrames - 1.0);
+        float w = mix(1.0 - t.x, t.x, o.x) * mix(1.0 - t.y, t.y, o.y);
+        addFrame(f, w, color, normal, position, covered);
+    }
+    if (color.a < 0.5) discard;
+
+    vec3 eye_vertex = (view * model * vec4(sphere_center + radius * position / covered, 1.0)).xyz;
+    vec4 clip = projection * vec4(eye_vertex, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // Same lighting as phong.frag
+    vec3 L = vec3(0, 0, 1);
+
+    vec3 N = normalize(normal_matrix * normal);
+    vec3 E = normalize(-eye_vertex);
+    vec3 R = normalize(-reflect(L, N));
+
+    vec3 base_color = color.rgb / color.a;
+    vec3 Iamb = base_color;
+    vec3 Idiff = base_color * vec3(max(dot(N, L), 0.0));
+    vec3 Ispec = base_color * pow(max(dot(R, E), 0.0), 2.2);
+    Ispec = clamp(Ispec, 0.0, 1.0);
+
+    frag_color = vec4(Iamb * 0.4 + Idiff * 0.6 + Ispec * 0.2, 1.0);
+}
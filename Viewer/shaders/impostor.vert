@@ -0,0 +1,29 @@
+#version 330
+
+layout (location = 0) in vec3 corner;     // quad corner, xy in [-1, 1]
+layout (location = 2) in vec4 instance;   // xyz: offset
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+// Bounding sphere of the model
+uniform vec3 center;
+uniform float radius;
+
+// View axes and camera position, in the space the instance offsets are in
+uniform vec3 camera_right;
+uniform vec3 camera_up;
+uniform vec3 eye;
+
+smooth out vec3 local;          // quad point relative to the center, in radii
+flat out vec3 to_eye;
+flat out vec3 sphere_center;
+
+void main(void)  {
+    sphere_center = center + instance.xyz;
+    local = corner.x * camera_right + corner.y * camera_up;
+    to_eye = normalize(eye - sphere_center);
+
+    gl_Position = projection * view * model * vec4(sphere_center + radius * local, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330
+
+smooth in vec3 object_normal;
+
+vec3 color = vec3(0.6);
+
+layout (location = 0) out vec4 frag_color;          // rgb, coverage
+layout (location = 1) out vec4 frag_normal_depth;   // object-space normal, depth
+
+void main (void) {
+    frag_color = vec4(color, 1.0);
+    frag_normal_depth = vec4(normalize(object_normal), gl_FragCoord.z);
+}
@@ -0,0 +1,21 @@
+#version 330
+
+layout (location = 0) in vec3 vert;
+layout (location = 1) in vec3 normal;
+
+// Bounding sphere of the model and basis of the view being baked
+uniform vec3 center;
+uniform float radius;
+uniform vec3 right;
+uniform vec3 up;
+uniform vec3 dir;       // from the center towards the viewer
+
+smooth out vec3 object_normal;
+
+void main(void)  {
+    // Orthographic, the sphere fills the view and depth [-1, 1]
+    vec3 p = (vert - center) / radius;
+    object_normal = normal;
+
+    gl_Position = vec4(dot(p, right), dot(p, up), -dot(p, dir), 1.0);
+}
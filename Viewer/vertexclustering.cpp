@@ -2,8 +2,17 @@
 
 #include "./mesh_io.h"
 #include "./triangle_mesh.h"
+
+#include <chrono>
 using namespace std;
 
+typedef std::chrono::steady_clock Clock;
+
+// Milliseconds elapsed since start
+static double msSince( Clock::time_point start ) {
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
 
 // Get all Q[v] matrices, for each v in vertices
 void VertexClustering::calcQMatrices( std::vector<float>& vtx, std::vector<float>& norm ) {
@@ -22,74 +31,217 @@ void VertexClustering::calcQMatrices( std::vector<float>& vtx, std::vector<float
 }
 
 // Get the new normals for a new set of vertices and faces
-// similar to Mesh_IO::ComputeFaceNormals except with some optimizations
+// similar to Mesh_IO::ComputeFaceNormals, but batched (see NormalAccumulator)
 void VertexClustering::getNewNormals(const std::vector<float> &newVtx, const std::vector<int> &newFaces,   std::vector<float> &newNormals  ) {
-    std::vector< float > faceNormals( newFaces.size(), 0.0f );
-    //std::vector< float > newNormals( newVtx.size(), 0.0f);
-
-
-    //for each face grab vtx 3-by-3, get the normal per face
-    for (int i = 0; i < (int) newFaces.size(); i+=3) {
-        // get vertices from face
-        Eigen::Vector3f vtx1( newVtx[ 3*newFaces[i+0] + 0 ], newVtx[ 3*newFaces[i+0] + 1 ], newVtx[ 3*newFaces[i+0] + 2 ] );
-        Eigen::Vector3f vtx2( newVtx[ 3*newFaces[i+1] + 0 ], newVtx[ 3*newFaces[i+1] + 1 ], newVtx[ 3*newFaces[i+1] + 2 ] );
-        Eigen::Vector3f vtx3( newVtx[ 3*newFaces[i+2] + 0 ], newVtx[ 3*newFaces[i+2] + 1 ], newVtx[ 3*newFaces[i+2] + 2 ] );
-
-        Eigen::Vector3f tri[3] = {vtx1, vtx2, vtx3};
-
-        //get the face's normal via cross-product
-        Eigen::Vector3f vtx1to2 = vtx2 - vtx1;
-        Eigen::Vector3f vtx1to3 = vtx3 - vtx1;
-        Eigen::Vector3f nrml = vtx1to2.cross( vtx1to3 );
-
-        double norma = nrml.norm();
-        if ( norma >= 1e-9 ) {
-            //Sum normalized normal to faceNormals
-            nrml.normalize();
-            faceNormals[i + 0] = nrml[0];
-            faceNormals[i + 1] = nrml[1];
-            faceNormals[i + 2] = nrml[2];
+    NormalAccumulator accumulator( newVtx, newNormals );
+    for (int i = 0; i < (int) newFaces.size(); i+=3)
+        accumulator.addTriangle( newFaces[ i+0 ], newFaces[ i+1 ], newFaces[ i+2 ] );
+    accumulator.finish();
+}
+
+
+// Split the vertices of one grid cell into subclusters of similar normals.
+// Each vertex joins the closest cone (by normal dot product) if it is within
+// NORMAL_CONE_COS of its axis, otherwise it opens a new cone. A second pass
+// reassigns every vertex to its closest final axis (one k-means step) so the
+// result does not depend on the vertex order. Only cells whose normals really
+// diverge end up with more than one representative.
+// On return subclusterOf[k] is the subcluster of cell[k], numbered 0..n-1 by
+// first use, and coneNormals holds the n unit axes in the same order (a zero
+// axis if the normals of a subcluster cancel out).
+void VertexClustering::clusterCellNormals( const std::vector<int> &cell, const std::vector<float> &normals,
+                                           std::vector<int> &subclusterOf, std::vector<float> &coneNormals ) {
+    int CellSize = cell.size();
+    subclusterOf.resize( CellSize );
+    coneNormals.resize( 0 );
+
+    // Greedy cone bucketing; coneNormals keeps the (unnormalized) normal sum per cone
+    for (int k = 0 ; k < CellSize; ++k) {
+        Eigen::Vector3f n( normals[ 3*cell[k] + 0 ], normals[ 3*cell[k] + 1 ], normals[ 3*cell[k] + 2 ] );
+        int numCones = coneNormals.size() / 3;
+        int best = -1;
+        float bestDot = NORMAL_CONE_COS;
+        for (int c = 0 ; c < numCones; ++c) {
+            Eigen::Vector3f axis( coneNormals[ 3*c + 0 ], coneNormals[ 3*c + 1 ], coneNormals[ 3*c + 2 ] );
+            float len = axis.norm();
+            float dotProd = ( len >= 1e-9 ) ? axis.dot( n ) / len : 1.0f;
+            if ( dotProd >= bestDot ) {
+                bestDot = dotProd;
+                best = c;
+            }
+        }
+        if ( best < 0 ) {
+            best = numCones;
+            coneNormals.push_back( 0.0f ); coneNormals.push_back( 0.0f ); coneNormals.push_back( 0.0f );
         }
-        //else  skip, already 0!
+        coneNormals[ 3*best + 0 ] += n[0];
+        coneNormals[ 3*best + 1 ] += n[1];
+        coneNormals[ 3*best + 2 ] += n[2];
+        subclusterOf[ k ] = best;
+    }
 
-        // Angle per each triangle vertex
-        for (int j = 0 ; j < 3 ; ++j) {
-            // rotation: pivot per iteration is [ j -> j1 -> j2 ]
+    int numCones = coneNormals.size() / 3;
+    for (int c = 0 ; c < numCones; ++c) {
+        Eigen::Vector3f axis( coneNormals[ 3*c + 0 ], coneNormals[ 3*c + 1 ], coneNormals[ 3*c + 2 ] );
+        if ( axis.norm() >= 1e-9 ) axis.normalize();
+        coneNormals[ 3*c + 0 ] = axis[0]; coneNormals[ 3*c + 1 ] = axis[1]; coneNormals[ 3*c + 2 ] = axis[2];
+    }
+    if ( numCones == 1 ) return;
+
+    // Refinement: reassign to the closest final axis, then drop emptied cones
+    std::vector< int > remap( numCones, -1 );
+    int numUsed = 0;
+    for (int k = 0 ; k < CellSize; ++k) {
+        Eigen::Vector3f n( normals[ 3*cell[k] + 0 ], normals[ 3*cell[k] + 1 ], normals[ 3*cell[k] + 2 ] );
+        int best = subclusterOf[ k ];
+        float bestDot = -2.0f;
+        for (int c = 0 ; c < numCones; ++c) {
+            float dotProd = coneNormals[ 3*c + 0 ]*n[0] + coneNormals[ 3*c + 1 ]*n[1] + coneNormals[ 3*c + 2 ]*n[2];
+            if ( dotProd > bestDot ) {
+                bestDot = dotProd;
+                best = c;
+            }
+        }
+        if ( remap[ best ] < 0 ) remap[ best ] = numUsed++;
+        subclusterOf[ k ] = remap[ best ];
+    }
 
-            //int j0 = (j+0) % 3;
-            int j1 = (j+1) % 3;
-            int j2 = (j+2) % 3;
+    // Axes of the used cones, in the order of their new ids
+    std::vector< float > used( 3*numUsed );
+    for (int c = 0 ; c < numCones; ++c) {
+        if ( remap[ c ] < 0 ) continue;
+        for (int i = 0 ; i < 3; ++i) used[ 3*remap[ c ] + i ] = coneNormals[ 3*c + i ];
+    }
+    coneNormals.swap( used );
+}
 
-            //get its normal
-            vtx1to2 = tri[ j1 ] - tri[ j ];
-            vtx1to3 = tri[ j2 ] - tri[ j ];
 
-            float dotProd = vtx1to2.dot( vtx1to3 );
-            dotProd = -(dotProd < 0.0f) * dotProd;
-            double phi = acos( dotProd / (vtx1to3.norm()*vtx1to2.norm()) );
+// Measure the geometric error of the first numLevels (simplified) levels against
+// the full-resolution mesh; the rest keep error 0. The BVH over the original mesh
+// is shared by all levels. numThreads as in measureError.
+void VertexClustering::measureErrors( std::vector<float>& vtx, std::vector<int>& faces, int numLevels, int numSamples,
+                                      int numThreads ) {
+    TriangleBVH originalBVH;
+    originalBVH.build( vtx, faces );
+
+    errorPerLOD.assign( vtxPerLOD.size(), LODError() );
+    for (int i = 0; i < numLevels and i < (int) vtxPerLOD.size(); ++i) {
+        errorPerLOD[ i ] = measureError( vtx, faces, originalBVH, vtxPerLOD[ i ], facesPerLOD[ i ], numSamples, numThreads );
+        std::cout << "LOD " << i << ": Hausdorff " << errorPerLOD[ i ].hausdorff
+                  << " (fwd " << errorPerLOD[ i ].forward << ", bwd " << errorPerLOD[ i ].backward
+                  << "), RMS " << errorPerLOD[ i ].rms << "\n";
+    }
+}
 
-            //Sum faceNormals to the new normals w/ respective angle ponderation
-            newNormals[ 3*newFaces[ i+j ] + 0 ] += phi*faceNormals[ i + 0 ];
-            newNormals[ 3*newFaces[ i+j ] + 1 ] += phi*faceNormals[ i + 1 ];
-            newNormals[ 3*newFaces[ i+j ] + 2 ] += phi*faceNormals[ i + 2 ];
 
+// Re-index the original faces with the cluster of each vertex, dropping the
+// faces that collapsed (two or more corners in the same cluster). Every kept
+// face is handed to the normal kernel right away, while it is still in cache,
+// so the normals of newVtx come out of the same pass.
+void VertexClustering::remapFaces( const std::vector<int> &faces, const std::vector<int> &vtxToCluster, const std::vector<float> &newVtx,
+                                   std::vector<int> &newFaces, std::vector<float> &newNormals, LevelStats *stats ) {
+    Clock::time_point start = Clock::now();
+    int NumFaces = faces.size() / 3;
+    newFaces.resize( 0 );
+    NormalAccumulator accumulator( newVtx, newNormals );
+    // Get the vtxs from each face
+    for (int i = 0 ; i < NumFaces ; ++i) {
+        int vtx1 = faces[ 3*i + 0 ];
+        int vtx2 = faces[ 3*i + 1 ];
+        int vtx3 = faces[ 3*i + 2 ];
+
+        // Get for each vtx its corresponding cell in the grid:
+        int idx1 = vtxToCluster[ vtx1 ];
+        int idx2 = vtxToCluster[ vtx2 ];
+        int idx3 = vtxToCluster[ vtx3 ];
+
+        // If all vtxs belong to a different cell (i.e. no matching cells) and were marked
+        if ( idx1 != idx2 and idx2 != idx3 and idx1 != idx3 and idx1 >= 0 and idx2 >= 0 and idx3 >= 0) {
+            //Add those faces to the newFaces vector
+            newFaces.push_back( idx1 );
+            newFaces.push_back( idx2 );
+            newFaces.push_back( idx3 );
+            accumulator.addTriangle( idx1, idx2, idx3 );
         }
     }
+    double remapMs = msSince( start );
 
-    // Finally, normalize every single norm
-    for (int i = 0; i < (int) newNormals.size(); i+=3) {
-        Eigen::Vector3f nrml( newNormals[i + 0], newNormals[ i + 1 ], newNormals[ i + 2 ] );
-
-        double norma = nrml.norm();
-        if ( norma >= 1e-9 ) {
-            //Sum normalized normal to newNormals
-            nrml.normalize();
-            newNormals[ i + 0 ] = nrml[0];
-            newNormals[ i + 1 ] = nrml[1];
-            newNormals[ i + 2 ] = nrml[2];
-        }
+    start = Clock::now();
+    accumulator.finish();
+
+    if ( stats ) {
+        stats->remapMs   = remapMs;
+        stats->normalsMs = msSince( start );
+    }
+}
+
+
+// Representative of a set of vertices: the point minimizing the summed quadric
+// Qmat if it is well defined and inside [cellMin, cellMax], the mean otherwise
+Eigen::Vector3f VertexClustering::getQuadricPoint( const std::vector<float> &vtx, const std::vector<int> &cell, const Eigen::Matrix4f &Qmat,
+                                                   const Eigen::Vector3f &cellMin, const Eigen::Vector3f &cellMax ) {
+    Eigen::Matrix4f Qsolve = Qmat;
+    Eigen::Matrix4f Qinv = Eigen::Matrix4f::Zero();
+    bool isQInvertible = false;
+    Qsolve(3,0) = 0.0f; Qsolve(3,1) = 0.0f; Qsolve(3,2) = 0.0f; Qsolve(3,3) = 1.0f;
+    Qsolve.computeInverseWithCheck( Qinv, isQInvertible, 0.1 );
+    ++quadricSolves;
+    quadricInvertible += isQInvertible;
+    if ( isQInvertible ) {
+        Eigen::Vector4f Vvec = Qinv * Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f );
+        Eigen::Vector3f myV ( Vvec[0], Vvec[1], Vvec[2] );
+        if ( (cellMin.array() <= myV.array()).all() and (myV.array() <= cellMax.array()).all() )
+            return myV;
+    }
+
+    Eigen::Vector3f sum( 0.0f, 0.0f, 0.0f );
+    for (int j = 0 ; j < (int) cell.size(); ++j)
+        sum += Eigen::Vector3f( vtx[ 3*cell[j] + 0 ], vtx[ 3*cell[j] + 1 ], vtx[ 3*cell[j] + 2 ] );
+    return sum / cell.size();
+}
+
+
+// Adaptive octree clustering: a node becomes a single representative if the
+// mean quadric error of its vertices (squared distance to their tangent planes)
+// is below maxErrorSq, otherwise it is split in 8 children, up to ADAPTIVE_MAX_DEPTH.
+void VertexClustering::subdivideOctree( const std::vector<float> &vtx, const std::vector<int> &cell,
+                                        const Eigen::Vector3f &cellMin, const Eigen::Vector3f &cellMax,
+                                        int depth, float maxErrorSq,
+                                        std::vector<int> &vtxToCluster, std::vector<float> &newVtx ) {
+    int CellSize = cell.size();
+    if ( CellSize == 0 ) return;
+    ++octreeNodes;
+
+    Eigen::Matrix4f Qmat = Eigen::Matrix4f::Zero();
+    for (int j = 0 ; j < CellSize; ++j) Qmat += QMatrixPerVert[ cell[j] ];
+
+    Eigen::Vector3f myV = getQuadricPoint( vtx, cell, Qmat, cellMin, cellMax );
+    Eigen::Vector4f myV4( myV[0], myV[1], myV[2], 1.0f );
+    float error = myV4.dot( Qmat * myV4 ) / CellSize;
+
+    if ( error <= maxErrorSq or depth >= ADAPTIVE_MAX_DEPTH or CellSize == 1 ) {
+        ++octreeLeaves;
+        int cluster = newVtx.size() / 3;
+        for (int j = 0 ; j < CellSize; ++j) vtxToCluster[ cell[j] ] = cluster;
+        newVtx.push_back( myV[ 0 ] );
+        newVtx.push_back( myV[ 1 ] );
+        newVtx.push_back( myV[ 2 ] );
+        return;
+    }
+
+    // Split by the cell center: child = x + 2y + 4z
+    Eigen::Vector3f center = ( cellMin + cellMax ) / 2;
+    std::vector< int > children[ 8 ];
+    for (int j = 0 ; j < CellSize; ++j) {
+        int idx = cell[j];
+        int child = (vtx[3*idx + 0] >= center[0]) + 2*(vtx[3*idx + 1] >= center[1]) + 4*(vtx[3*idx + 2] >= center[2]);
+        children[ child ].push_back( idx );
+    }
+    for (int c = 0 ; c < 8 ; ++c) {
+        Eigen::Vector3f childMin( (c & 1) ? center[0] : cellMin[0], (c & 2) ? center[1] : cellMin[1], (c & 4) ? center[2] : cellMin[2] );
+        Eigen::Vector3f childMax( (c & 1) ? cellMax[0] : center[0], (c & 2) ? cellMax[1] : center[1], (c & 4) ? cellMax[2] : center[2] );
+        subdivideOctree( vtx, children[ c ], childMin, childMax, depth + 1, maxErrorSq, vtxToCluster, newVtx );
     }
-    //return newNormals;
 }
 
 
@@ -105,8 +257,10 @@ bool vtxLEQ( Eigen::Vector3f& A, Eigen::Vector3f& B ) {
 
 
 int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& faces, std::vector<float>& normals,
-                                     Eigen::Vector3f& min, Eigen::Vector3f& max, std::string method )
+                                     Eigen::Vector3f& min, Eigen::Vector3f& max, std::string method, ClusterStats *stats )
 {
+    Clock::time_point buildStart = Clock::now();
+
     //Set up data structures
     MAX_LOD = 10;
     int STEP = 2;
@@ -120,18 +274,28 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
     // Dimensions
     float xDim = (max[0] - min[0]);    float yDim = (max[1] - min[1]);    float zDim = (max[2] - min[2]);
     int NumVertices = vtx.size() / 3;
-    int NumFaces = faces.size() / 3;
 
-    if (method == "Error Quadrics" )
+    if (method == "Error Quadrics" or method == "Adaptive Octree" )
         calcQMatrices(vtx, normals);
 
 
-    std::vector< std::vector<float> > Grid( MAX_LOD*MAX_LOD*MAX_LOD );
+    std::vector< std::vector<int> > Grid( MAX_LOD*MAX_LOD*MAX_LOD );
     std::vector<float> newVtx(0);
     std::vector<int>   newFaces(0);
     std::vector< float > newNormals(0);
     std::vector< int > numVtx_To_cellGrid( NumVertices, -1 );
 
+    // Shape-Preserving scratch space, reused by every occupied cell
+    std::vector< int > subclusterOf;
+    std::vector< float > coneNormals;
+    std::vector< float > coneSums;
+
+
+    ClusterStats st;
+    st.method = method;
+    st.inVertices = NumVertices;
+    st.inFaces = faces.size() / 3;
+    st.setupMs = msSince( buildStart );
 
     std::cout << "There are " << (MAX_LOD / STEP) + 1 << " items to add\n" ;
     int NumLods = 0; //1
@@ -139,6 +303,7 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
     newVtx.resize(0);
     newFaces.resize(0);
     newNormals.resize(0);
+
 /*
     // Use void mesh values as LOD 0 ("no" detail)
     vtxPerLOD[0]   = newVtx ;
@@ -146,11 +311,22 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
     normPerLOD[0]  = newNormals ;
 */
 
+    if ( method == "Adaptive Octree" ) {
+        NumLods = buildOctreeLevels( vtx, faces, min, max, MAX_LOD / STEP, st );
+        return finishLevels( vtx, faces, normals, NumLods, buildStart, st, stats );
+    }
+
     // For each level of detail 2 to MAX_LOD+1 ...
     for (int LOD = 2; LOD <= RATIO*MAX_LOD; LOD += RATIO*STEP )
     {
         int level3D = LOD*LOD*LOD; // LOD ^ 3
 
+        LevelStats ls;
+        ls.resolution = LOD;
+        ls.totalCells = level3D;
+        quadricSolves = quadricInvertible = 0;
+        Clock::time_point t = Clock::now();
+
         // Create new structures for this LOD
         newVtx.resize(0);
         newFaces.resize(0);
@@ -162,41 +338,21 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
 
         // For each vertex...
 
-        if ( method == "Shape-Preserving" ) {
-            // Set 3D uniform grid size w/normal sign and dimensions per cell
-            //
-            // Normal 0 = {-X, -Y, -Z}, 1 = {X, -Y, -Z}, .., 7 = {+X, +Y, -+Z}
-            Grid.clear( );
-            Grid.resize( 8 * level3D );
-            for (int idx = 0 ; idx < NumVertices ; ++idx) {
-                // Place index into grid; if index==LOD subtract one
-                int vtX = (int) ( (vtx[3*idx + 0] - min(0)) / gridCellX );      vtX -= (vtX == LOD);
-                int vtY = (int) ( (vtx[3*idx + 1] - min(1)) / gridCellY );      vtY -= (vtY == LOD);
-                int vtZ = (int) ( (vtx[3*idx + 2] - min(2)) / gridCellZ );      vtZ -= (vtZ == LOD);
-
-                // Indexing = x + y*lvl + z*(lvl**2) = x + lvl( y + lvl(z) )
-                int gridPos = vtX + LOD*(vtY + LOD*vtZ) ;
-
-                int sign = (0.0f <= normals[3*idx + 0]) + 2*(0.0f <= normals[3*idx + 1]) + 4*(0.0f <= normals[3*idx + 2]);
-
-                Grid[ 8*gridPos + sign ].push_back( idx ); //8*i + j, i= lvl, j=norm dir BROKEN :(
-            }
-        }
-        else {
-            // Set 3D uniform grid size and dimensions per cell
-            Grid.clear( );
-            Grid.resize( level3D );
-            for (int idx = 0 ; idx < NumVertices ; ++idx) {
-                // Place index into grid; if index==LOD subtract one
-                int vtX = (int) ( (vtx[3*idx + 0] - min(0)) / gridCellX );      vtX -= (vtX == LOD);
-                int vtY = (int) ( (vtx[3*idx + 1] - min(1)) / gridCellY );      vtY -= (vtY == LOD);
-                int vtZ = (int) ( (vtx[3*idx + 2] - min(2)) / gridCellZ );      vtZ -= (vtZ == LOD);
-
-                // Indexing = x + y*lvl + z*(lvl**2) = x + lvl( y + lvl(z) )
-                int gridPos = vtX + LOD*(vtY + LOD*vtZ) ;
-                Grid[ gridPos ].push_back( idx );
-            }
+        // Set 3D uniform grid size and dimensions per cell
+        Grid.clear( );
+        Grid.resize( level3D );
+        for (int idx = 0 ; idx < NumVertices ; ++idx) {
+            // Place index into grid; if index==LOD subtract one
+            int vtX = (int) ( (vtx[3*idx + 0] - min(0)) / gridCellX );      vtX -= (vtX == LOD);
+            int vtY = (int) ( (vtx[3*idx + 1] - min(1)) / gridCellY );      vtY -= (vtY == LOD);
+            int vtZ = (int) ( (vtx[3*idx + 2] - min(2)) / gridCellZ );      vtZ -= (vtZ == LOD);
+
+            // Indexing = x + y*lvl + z*(lvl**2) = x + lvl( y + lvl(z) )
+            int gridPos = vtX + LOD*(vtY + LOD*vtZ) ;
+            Grid[ gridPos ].push_back( idx );
         }
+        ls.binningMs = msSince( t );
+        t = Clock::now();
 
 
         int NumSkips = 0;
@@ -216,6 +372,8 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
                     }
                     Qmat(3,0) = 0.0f; Qmat(3,1) = 0.0f; Qmat(3,2) = 0.0f; Qmat(3,3) = 1.0f;
                     Qmat.computeInverseWithCheck( Qinv, isQInvertible, 0.1 );
+                    ++quadricSolves;
+                    quadricInvertible += isQInvertible;
                     if ( isQInvertible ) {
                         Eigen::Vector4f Vvec = Qinv * Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f );
                         Eigen::Vector3f minCell( min[0] + gridCellX*0.0  +  gridCellX* (i % LOD),
@@ -266,35 +424,33 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
             }
         }
         else if ( method == "Shape-Preserving" ) {
-            // for each cell...
+            // for each occupied cell, split its vertices into normal cones
             for (int i = 0 ; i < level3D ; ++i) {
-                // ... and for each normal direction...
-                int sumItems = 0;
-                for (int j = 0 ; j < 8 ; ++j) {
-                    int GridSize = Grid[ 8*i + j ].size();
-                    sumItems += GridSize;
-                    if ( GridSize > 0 ) {
-                        // Get vertex mean:
-                        float sumX, sumY, sumZ;
-                        sumZ = sumY = sumX = 0.0f;
-
-                        for (int k = 0 ; k < GridSize; ++k) {
-                            int myFace = Grid[ 8*i + j ][ k ];
-                            sumX += vtx[ 3*myFace + 0 ];
-                            sumY += vtx[ 3*myFace + 1 ];
-                            sumZ += vtx[ 3*myFace + 2 ];
-
-                            // link old vtx with new by describing which cell in the grid has it
-                            numVtx_To_cellGrid[ Grid[8*i + j][k] ] = 8*i + j - NumSkips; // cell[ #vtx ] = i;
-                        }
-
-                        // Add those vertices to the newVtx vector
-                        newVtx.push_back( sumX / GridSize );
-                        newVtx.push_back( sumY / GridSize );
-                        newVtx.push_back( sumZ / GridSize );
+                int GridSize = Grid[ i ].size();
+                if ( GridSize > 0 ) {
+                    clusterCellNormals( Grid[ i ], normals, subclusterOf, coneNormals );
+
+                    // Get vertex mean per subcluster
+                    int numCones = coneNormals.size() / 3;
+                    coneSums.assign( 4*numCones, 0.0f );
+                    for (int k = 0 ; k < GridSize; ++k) {
+                        int myFace = Grid[ i ][ k ];
+                        int cone = subclusterOf[ k ];
+                        coneSums[ 4*cone + 0 ] += vtx[ 3*myFace + 0 ];
+                        coneSums[ 4*cone + 1 ] += vtx[ 3*myFace + 1 ];
+                        coneSums[ 4*cone + 2 ] += vtx[ 3*myFace + 2 ];
+                        coneSums[ 4*cone + 3 ] += 1.0f;
+
+                        // link old vtx with new by describing which subcluster has it
+                        numVtx_To_cellGrid[ myFace ] = newVtx.size() / 3 + cone;
+                    }
 
+                    // Add those vertices to the newVtx vector
+                    for (int c = 0 ; c < numCones; ++c) {
+                        newVtx.push_back( coneSums[ 4*c + 0 ] / coneSums[ 4*c + 3 ] );
+                        newVtx.push_back( coneSums[ 4*c + 1 ] / coneSums[ 4*c + 3 ] );
+                        newVtx.push_back( coneSums[ 4*c + 2 ] / coneSums[ 4*c + 3 ] );
                     }
-                    else ++NumSkips;
                 }
             }
         }
@@ -347,33 +503,26 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
             }
         }
 
-        vtxPerLOD[NumLods]   = newVtx;
-        // Get the vtxs from each face
-        for (int i = 0 ; i < NumFaces ; ++i) {
-            int vtx1 = faces[ 3*i + 0 ];
-            int vtx2 = faces[ 3*i + 1 ];
-            int vtx3 = faces[ 3*i + 2 ];
-
-            // Get for each vtx its corresponding cell in the grid:
-            int idx1 = numVtx_To_cellGrid[ vtx1 ];
-            int idx2 = numVtx_To_cellGrid[ vtx2 ];
-            int idx3 = numVtx_To_cellGrid[ vtx3 ];
-
-            // If all vtxs belong to a different cell (i.e. no matching cells) and were marked
-            if ( idx1 != idx2 and idx2 != idx3 and idx1 != idx3 and idx1 >= 0 and idx2 >= 0 and idx3 >= 0) {
-                //Add those faces to the newFaces vector
-                newFaces.push_back( idx1 );
-                newFaces.push_back( idx2 );
-                newFaces.push_back( idx3 );
+        ls.representativeMs = msSince( t );
 
-            }
-        }
+        vtxPerLOD[NumLods]   = newVtx;
+        remapFaces( faces, numVtx_To_cellGrid, newVtx, newFaces, newNormals, &ls );
         facesPerLOD[NumLods] = newFaces;
-
-        newNormals.resize( vtx.size() );
-        getNewNormals( vtxPerLOD[NumLods], facesPerLOD[NumLods], newNormals );
         normPerLOD[NumLods]  = newNormals;
 
+        ls.allocBytes = level3D * sizeof( std::vector<int> ) + newVtx.capacity() * sizeof(float)
+                      + newFaces.capacity() * sizeof(int) + newNormals.capacity() * sizeof(float)
+                      + numVtx_To_cellGrid.capacity() * sizeof(int);
+        for (int i = 0 ; i < level3D ; ++i) {
+            ls.occupiedCells += !Grid[ i ].empty();
+            ls.allocBytes += Grid[ i ].capacity() * sizeof(int);
+        }
+        ls.quadricSolves = quadricSolves;
+        ls.quadricInvertible = quadricInvertible;
+        ls.outVertices = newVtx.size() / 3;
+        ls.outFaces = newFaces.size() / 3;
+        st.levels.push_back( ls );
+
         ++NumLods;
         std::cout << NumLods << "th item is the next iteration to add...\n";
 
@@ -381,14 +530,136 @@ int VertexClustering::buildCluster( std::vector<float>& vtx, std::vector<int>& f
         if (LOD == 2) LOD = RATIO*2;
     }
 
+    return finishLevels( vtx, faces, normals, NumLods, buildStart, st, stats );
+}
+
+
+// Adaptive Octree levels: each one is defined by an error bound (a fraction of
+// the bounding box diagonal) instead of a grid size. The bound is halved per
+// level, and again while the level comes out with as many vertices as the one
+// before, so no two levels are the same (unless the octree cannot split any
+// further within ADAPTIVE_MAX_RETRIES halvings).
+int VertexClustering::buildOctreeLevels( const std::vector<float>& vtx, const std::vector<int>& faces,
+                                         const Eigen::Vector3f& min, const Eigen::Vector3f& max,
+                                         int numLevels, ClusterStats& st ) {
+    int NumVertices = vtx.size() / 3;
+    float diag = (max - min).norm();
+    std::vector< int > allVtx( NumVertices );
+    for (int idx = 0 ; idx < NumVertices ; ++idx) allVtx[ idx ] = idx;
+
+    std::vector<float> newVtx(0);
+    std::vector<int>   newFaces(0);
+    std::vector< float > newNormals(0);
+    std::vector< int > numVtx_To_cellGrid( NumVertices, -1 );
+
+    float maxError = diag * ADAPTIVE_BASE_ERROR;
+    int prevVertices = 0;
+    int NumLods = 0;
+    for ( ; NumLods < numLevels ; ++NumLods, maxError /= 2 ) {
+        LevelStats ls;
+        Clock::time_point t = Clock::now();
+
+        for (int retry = 0 ; ; ++retry, maxError /= 2) {
+            quadricSolves = quadricInvertible = octreeNodes = octreeLeaves = 0;
+            newVtx.resize(0);
+            std::fill(numVtx_To_cellGrid.begin(), numVtx_To_cellGrid.end(), -1);  // clean array
+            subdivideOctree( vtx, allVtx, min, max, 0, maxError*maxError, numVtx_To_cellGrid, newVtx );
+            if ( (int) newVtx.size() / 3 != prevVertices or retry == ADAPTIVE_MAX_RETRIES ) break;
+        }
+        ls.resolution = maxError;
+        ls.representativeMs = msSince( t );
+        prevVertices = newVtx.size() / 3;
+
+        vtxPerLOD[NumLods] = newVtx;
+        remapFaces( faces, numVtx_To_cellGrid, newVtx, newFaces, newNormals, &ls );
+        facesPerLOD[NumLods] = newFaces;
+        normPerLOD[NumLods]  = newNormals;
+
+        ls.occupiedCells = octreeLeaves;
+        ls.totalCells = octreeNodes;
+        ls.quadricSolves = quadricSolves;
+        ls.quadricInvertible = quadricInvertible;
+        ls.outVertices = newVtx.size() / 3;
+        ls.outFaces = newFaces.size() / 3;
+        ls.allocBytes = newVtx.capacity() * sizeof(float) + newFaces.capacity() * sizeof(int)
+                      + newNormals.capacity() * sizeof(float) + numVtx_To_cellGrid.capacity() * sizeof(int);
+        st.levels.push_back( ls );
+        std::cout << "Error bound " << maxError << ": " << newVtx.size() / 3 << " vertices\n";
+    }
+    return NumLods;
+}
+
+
+// Add the full detail level after the NumLods simplified ones, trim every
+// level and fill in the stats. Returns the level count for buildCluster.
+int VertexClustering::finishLevels( std::vector<float>& vtx, std::vector<int>& faces, std::vector<float>& normals,
+                                    int NumLods, Clock::time_point buildStart, ClusterStats& st, ClusterStats *stats ) {
     std::cout << "Ended with " << NumLods << " items\n";
     //Finally add full detail LOD at the end
     vtxPerLOD[NumLods]   = vtx;
     facesPerLOD[NumLods] = faces;
     normPerLOD[NumLods]  = normals;
 
+    // Trim every level to its real size and keep the counts for the scheduler
+    infoPerLOD.assign( vtxPerLOD.size(), LODInfo() );
+    for (int i = 0; i < (int) vtxPerLOD.size(); ++i) {
+        if ( i > NumLods ) {
+            std::vector< float >().swap( vtxPerLOD[ i ] );
+            std::vector< int >().swap( facesPerLOD[ i ] );
+            std::vector< float >().swap( normPerLOD[ i ] );
+        }
+        vtxPerLOD[ i ].shrink_to_fit();
+        facesPerLOD[ i ].shrink_to_fit();
+        normPerLOD[ i ].shrink_to_fit();
+
+        infoPerLOD[ i ].numVertices = vtxPerLOD[ i ].size() / 3;
+        infoPerLOD[ i ].numFaces    = facesPerLOD[ i ].size() / 3;
+        infoPerLOD[ i ].gpuBytes    = vtxPerLOD[ i ].size() * sizeof(float) + normPerLOD[ i ].size() * sizeof(float)
+                                    + facesPerLOD[ i ].size() * sizeof(int);
+    }
+
+    st.totalMs = msSince( buildStart );
+    if ( stats ) *stats = st;
+
 
     return NumLods + 2;
 }
 
 
+// Free the CPU copies of every level (once they live on the GPU). Only the
+// per-level counts in infoPerLOD and the measured errors are kept.
+void VertexClustering::releaseCPUData() {
+    for (int i = 0; i < (int) vtxPerLOD.size(); ++i) {
+        std::vector< float >().swap( vtxPerLOD[ i ] );
+        std::vector< int >().swap( facesPerLOD[ i ] );
+        std::vector< float >().swap( normPerLOD[ i ] );
+    }
+    std::vector< Eigen::Matrix4f >().swap( QMatrixPerVert );
+    std::vector< std::vector< int > >().swap( Grid );
+}
+
+
+size_t VertexClustering::cpuBytes( int level ) const {
+    return vtxPerLOD[ level ].capacity() * sizeof(float) + normPerLOD[ level ].capacity() * sizeof(float)
+         + facesPerLOD[ level ].capacity() * sizeof(int);
+}
+
+
+// One line per level: counts, bytes resident in RAM and bytes uploaded to the GPU
+std::string VertexClustering::memoryReport() const {
+    std::ostringstream report;
+    size_t totalCPU = 0, totalGPU = 0;
+    for (int i = 0; i < (int) infoPerLOD.size(); ++i) {
+        if ( infoPerLOD[ i ].numVertices == 0 ) continue;
+        size_t cpu = cpuBytes( i );
+        report << "LOD " << i << ": " << infoPerLOD[ i ].numVertices << " vtx, " << infoPerLOD[ i ].numFaces
+               << " faces, CPU " << cpu / 1024.0 << " KB, GPU " << infoPerLOD[ i ].gpuBytes / 1024.0 << " KB\n";
+        totalCPU += cpu;
+        totalGPU += infoPerLOD[ i ].gpuBytes;
+    }
+    totalCPU += QMatrixPerVert.capacity() * sizeof(Eigen::Matrix4f);
+    report << "Total: CPU " << totalCPU / 1024.0 << " KB (quadrics included), GPU " << totalGPU / 1024.0 << " KB\n";
+    return report.str();
+}
+
+
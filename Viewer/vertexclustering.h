@@ -1,9 +1,11 @@
 #ifndef VERTEXCLUSTERING_H
 #define VERTEXCLUSTERING_H
 
-#include "glwidget.h"
 #include "mesh_io.h"
 #include "./triangle_mesh.h"
+#include "./lodmetrics.h"
+#include "./normalkernel.h"
+#include "./clusterstats.h"
 
 
 #include <fstream>
@@ -11,31 +13,80 @@
 #include <memory>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <chrono>
 #include <limits>
 #include <eigen3/Eigen/Geometry>
 
 
+// Shape-Preserving: max angle between a vertex normal and its subcluster axis (cos 45 deg)
+#define NORMAL_CONE_COS 0.7071f
+
+// Adaptive Octree: error bound of the coarsest level (fraction of the bbox diagonal) and max depth
+#define ADAPTIVE_BASE_ERROR 0.05f
+#define ADAPTIVE_MAX_DEPTH  8
+#define ADAPTIVE_MAX_RETRIES 8  // extra halvings of the bound to make a level differ from the previous one
+
+// Per-level metadata that survives releaseCPUData()
+struct LODInfo
+{
+    int numVertices;
+    int numFaces;
+    size_t gpuBytes;
+
+    LODInfo() : numVertices(0), numFaces(0), gpuBytes(0) {}
+};
+
 class VertexClustering
 {
 public:
     int buildCluster( std::vector<float>& vtx, std::vector<int>& faces, std::vector<float>& normals,
-                      Eigen::Vector3f& min, Eigen::Vector3f& max, std::string method );
+                      Eigen::Vector3f& min, Eigen::Vector3f& max, std::string method, ClusterStats *stats = nullptr );
 
     void calcQMatrices( std::vector<float>& vtx, std::vector<float>& norm );
     void getNewNormals(const std::vector<float> &newVtx, const std::vector<int> &newFaces, std::vector<float> &newNormals  );
+    void releaseCPUData();
+    size_t cpuBytes( int level ) const;
+    std::string memoryReport() const;
+
+    void measureErrors( std::vector<float>& vtx, std::vector<int>& faces, int numLevels, int numSamples = 50000,
+                        int numThreads = 0 );
+    void clusterCellNormals( const std::vector<int> &cell, const std::vector<float> &normals,
+                             std::vector<int> &subclusterOf, std::vector<float> &coneNormals );
+    void remapFaces( const std::vector<int> &faces, const std::vector<int> &vtxToCluster, const std::vector<float> &newVtx,
+                     std::vector<int> &newFaces, std::vector<float> &newNormals, LevelStats *stats = nullptr );
+    Eigen::Vector3f getQuadricPoint( const std::vector<float> &vtx, const std::vector<int> &cell, const Eigen::Matrix4f &Qmat,
+                                     const Eigen::Vector3f &cellMin, const Eigen::Vector3f &cellMax );
+    void subdivideOctree( const std::vector<float> &vtx, const std::vector<int> &cell,
+                          const Eigen::Vector3f &cellMin, const Eigen::Vector3f &cellMax,
+                          int depth, float maxErrorSq,
+                          std::vector<int> &vtxToCluster, std::vector<float> &newVtx );
+    int buildOctreeLevels( const std::vector<float>& vtx, const std::vector<int>& faces,
+                           const Eigen::Vector3f& min, const Eigen::Vector3f& max,
+                           int numLevels, ClusterStats& st );
+    int finishLevels( std::vector<float>& vtx, std::vector<int>& faces, std::vector<float>& normals,
+                      int NumLods, std::chrono::steady_clock::time_point buildStart, ClusterStats& st, ClusterStats *stats );
 
 
     std::vector < std::vector< float > > vtxPerLOD;
     std::vector < std::vector< int > >   facesPerLOD;
     std::vector < std::vector< float > > normPerLOD;
+    std::vector < LODError >             errorPerLOD;
+    std::vector < LODInfo >              infoPerLOD;
 private:
     int MAX_LOD;
 
-    std::vector < std::vector< float > > Grid;
+    std::vector < std::vector< int > > Grid;
     std::vector< Eigen::Matrix4f > QMatrixPerVert;
+
+    // Per-level counters for ClusterStats
+    int quadricSolves;
+    int quadricInvertible;
+    int octreeNodes;
+    int octreeLeaves;
 };
 
 #endif // VERTEXCLUSTERING_H
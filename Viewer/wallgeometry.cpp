@@ -0,0 +1,202 @@
+#include "wallgeometry.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <eigen3/Eigen/Geometry>
+
+
+namespace {
+
+struct ChunkMesh
+{
+    std::vector< float > vertices;      // position, normal
+    std::vector< GLuint > indices;
+};
+
+
+/**
+ * @brief addQuad Appends the quad p, p + u, p + u + v, p + v facing n.
+ */
+void addQuad( ChunkMesh& mesh, const Eigen::Vector3f& p, Eigen::Vector3f u, Eigen::Vector3f v, const Eigen::Vector3f& n )
+{
+    if ( u.cross( v ).dot( n ) < 0.0f ) std::swap( u, v );
+
+    GLuint first = mesh.vertices.size() / 6;
+    const Eigen::Vector3f corners[ 4 ] = { p, p + u, p + u + v, p + v };
+    for ( const Eigen::Vector3f& c : corners ) {
+        mesh.vertices.insert( mesh.vertices.end(), c.data(), c.data() + 3 );
+        mesh.vertices.insert( mesh.vertices.end(), n.data(), n.data() + 3 );
+    }
+    const GLuint quad[ 6 ] = { 0, 1, 2, 0, 2, 3 };
+    for ( GLuint i : quad ) mesh.indices.push_back( first + i );
+}
+
+
+/**
+ * @brief meshChunk Walls of the cells [r0, r1) x [c0, c1). Neighbours outside
+ * the chunk are still looked up in the map, so no face is left between two
+ * walls of different chunks.
+ */
+void meshChunk( const mapManager& map, float d, int r0, int r1, int c0, int c1, ChunkMesh& mesh )
+{
+    auto solid = [&]( int row, int col ) { return map.inside( row, col ) and map.isOpaque( row, col ); };
+    const float half = d / 2;
+    const int width = c1 - c0;
+
+    // Tops and bottoms: grow a run along the row, then down the rows while
+    // the whole run is still wall
+    std::vector< char > used( ( r1 - r0 ) * width, 0 );
+    auto taken = [&]( int row, int col ) { return used[ ( row - r0 ) * width + col - c0 ] != 0; };
+    for ( int r = r0 ; r < r1 ; ++r ) {
+        for ( int c = c0 ; c < c1 ; ++c ) {
+            if ( not solid( r, c ) or taken( r, c ) ) continue;
+
+            int w = 1;
+            while ( c + w < c1 and solid( r, c + w ) and not taken( r, c + w ) ) ++w;
+            int h = 1;
+            for ( bool grow = true ; grow and r + h < r1 ; ) {
+                for ( int k = c ; k < c + w and grow ; ++k ) grow = solid( r + h, k ) and not taken( r + h, k );
+                if ( grow ) ++h;
+            }
+            for ( int y = r ; y < r + h ; ++y )
+                std::fill_n( used.begin() + ( y - r0 ) * width + c - c0, w, 1 );
+
+            Eigen::Vector3f u( w * d, 0, 0 ), v( 0, 0, h * d );
+            addQuad( mesh, Eigen::Vector3f( c * d - half,  half, r * d - half ), u, v, Eigen::Vector3f( 0,  1, 0 ) );
+            addQuad( mesh, Eigen::Vector3f( c * d - half, -half, r * d - half ), u, v, Eigen::Vector3f( 0, -1, 0 ) );
+        }
+    }
+
+    // Sides are one wall high, so a maximal run along the face is already a
+    // maximal rectangle. A face is kept where the neighbour is not a wall.
+    const Eigen::Vector3f up( 0, d, 0 );
+    for ( int side = -1 ; side <= 1 ; side += 2 ) {
+        for ( int r = r0 ; r < r1 ; ++r ) {         // faces along z
+            for ( int c = c0 ; c < c1 ; ) {
+                int w = 0;
+                while ( c + w < c1 and solid( r, c + w ) and not solid( r + side, c + w ) ) ++w;
+                if ( w == 0 ) { ++c; continue; }
+                addQuad( mesh, Eigen::Vector3f( c * d - half, -half, r * d + side * half ),
+                         Eigen::Vector3f( w * d, 0, 0 ), up, Eigen::Vector3f( 0, 0, side ) );
+                c += w;
+            }
+        }
+        for ( int c = c0 ; c < c1 ; ++c ) {         // faces along x
+            for ( int r = r0 ; r < r1 ; ) {
+                int h = 0;
+                while ( r + h < r1 and solid( r + h, c ) and not solid( r + h, c + side ) ) ++h;
+                if ( h == 0 ) { ++r; continue; }
+                addQuad( mesh, Eigen::Vector3f( c * d + side * half, -half, r * d - half ),
+                         Eigen::Vector3f( 0, 0, h * d ), up, Eigen::Vector3f( side, 0, 0 ) );
+                r += h;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+
+WallGeometry::WallGeometry( GLuint vertex, GLuint normal, GLuint instance )
+    : vertexAttrib( vertex ), normalAttrib( normal ), instanceAttrib( instance ),
+      nCols( 0 ), totalTriangles( 0 ), boxTriangles( 0 ), drawn( 0 ), calls( 0 )
+{
+}
+
+
+WallGeometry::~WallGeometry()
+{
+    clear();
+}
+
+
+void WallGeometry::clear()
+{
+    for ( WallChunk& chunk : chunks ) {
+        glDeleteBuffers( 1, &chunk.vbo );
+        glDeleteBuffers( 1, &chunk.ibo );
+        glDeleteVertexArrays( 1, &chunk.vao );
+    }
+    chunks.clear();
+    totalTriangles = 0;
+    boxTriangles = 0;
+}
+
+
+void WallGeometry::build( const mapManager& map, float cellSize )
+{
+    clear();
+    nCols = map.cols();
+
+    for ( int r = 0 ; r < map.rows() ; ++r )
+        for ( int c = 0 ; c < map.cols() ; ++c )
+            boxTriangles += map.isOpaque( r, c ) ? 12 : 0;
+
+    ChunkMesh mesh;
+    for ( int r0 = 0 ; r0 < map.rows() ; r0 += WALL_CHUNK ) {
+        for ( int c0 = 0 ; c0 < map.cols() ; c0 += WALL_CHUNK ) {
+            mesh.vertices.clear();
+            mesh.indices.clear();
+            meshChunk( map, cellSize, r0, std::min( r0 + WALL_CHUNK, map.rows() ),
+                       c0, std::min( c0 + WALL_CHUNK, map.cols() ), mesh );
+            if ( mesh.indices.empty() ) continue;
+
+            // Sphere around the bounds of the vertices
+            Eigen::Vector3f lo = Eigen::Vector3f::Constant( std::numeric_limits< float >::max() ), hi = -lo;
+            for ( size_t v = 0 ; v < mesh.vertices.size() ; v += 6 ) {
+                Eigen::Map< const Eigen::Vector3f > p( &mesh.vertices[ v ] );
+                lo = lo.cwiseMin( p );
+                hi = hi.cwiseMax( p );
+            }
+
+            WallChunk chunk;
+            Eigen::Map< Eigen::Vector3f >( chunk.center ) = ( lo + hi ) / 2;
+            chunk.radius = ( hi - lo ).norm() / 2;
+            chunk.indexCount = mesh.indices.size();
+            for ( int r = r0 ; r < std::min( r0 + WALL_CHUNK, map.rows() ) ; ++r )
+                for ( int c = c0 ; c < std::min( c0 + WALL_CHUNK, map.cols() ) ; ++c )
+                    if ( map.isOpaque( r, c ) ) chunk.walls.push_back( r * nCols + c );
+
+            glGenVertexArrays( 1, &chunk.vao );
+            glGenBuffers( 1, &chunk.vbo );
+            glGenBuffers( 1, &chunk.ibo );
+            glBindVertexArray( chunk.vao );
+            glBindBuffer( GL_ARRAY_BUFFER, chunk.vbo );
+            glBufferData( GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof( float ), mesh.vertices.data(), GL_STATIC_DRAW );
+            glVertexAttribPointer( vertexAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof( float ), (const GLvoid*) 0 );
+            glEnableVertexAttribArray( vertexAttrib );
+            glVertexAttribPointer( normalAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof( float ), (const GLvoid*) ( 3 * sizeof( float ) ) );
+            glEnableVertexAttribArray( normalAttrib );
+            glDisableVertexAttribArray( instanceAttrib );
+            glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, chunk.ibo );
+            glBufferData( GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof( GLuint ), mesh.indices.data(), GL_STATIC_DRAW );
+            glBindVertexArray( 0 );
+            glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+            chunks.push_back( std::move( chunk ) );
+            totalTriangles += chunk.indexCount / 3;
+        }
+    }
+}
+
+
+void WallGeometry::draw( const Frustum& frustum )
+{
+    drawn = 0;
+    calls = 0;
+    if ( chunks.empty() ) return;
+
+    // The instance attribute is not an array here: a constant zero offset
+    glVertexAttrib4f( instanceAttrib, 0.0f, 0.0f, 0.0f, 0.0f );
+    for ( const WallChunk& chunk : chunks ) {
+        if ( not frustum.sphereVisible( chunk.center[0], chunk.center[1], chunk.center[2], chunk.radius ) ) continue;
+
+        glBindVertexArray( chunk.vao );
+        glDrawElements( GL_TRIANGLES, chunk.indexCount, GL_UNSIGNED_INT, 0 );
+        drawn += chunk.indexCount / 3;
+        ++calls;
+    }
+    glBindVertexArray( 0 );
+}
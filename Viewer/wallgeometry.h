@@ -0,0 +1,101 @@
+#ifndef WALLGEOMETRY_H
+#define WALLGEOMETRY_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "./frustumculler.h"
+#include "./mapmanager.h"
+
+
+#define WALL_CHUNK 32       // map cells per side of a wall chunk
+
+
+/**
+ * @brief The WallChunk struct Static wall geometry of a WALL_CHUNK^2 block
+ * of the map: its own vertex and index buffers, a bounding sphere to skip it
+ * when it is out of the frustum, and the cells of its walls.
+ */
+struct WallChunk
+{
+    GLuint vao, vbo, ibo;
+    GLsizei indexCount;
+    float center[ 3 ];
+    float radius;
+    std::vector< int > walls;       // row * cols + col
+};
+
+
+/**
+ * @brief The WallGeometry class Walls of a map ('X' cells; windows are left
+ * out) as a few static meshes. Within each chunk the tops and bottoms of
+ * adjacent walls are merged greedily into maximal rectangles and the sides
+ * into maximal runs, and faces between two walls are dropped.
+ *
+ * The wall of cell (row, col) is a cube of side cellSize centered at
+ * ( col, 0, row ) * cellSize, as GLWidget::WallBox. Vertices are position and
+ * normal interleaved like the GeometryArena, so the walls are drawn with the
+ * same program as the instances, with a zero per-instance offset.
+ */
+class WallGeometry
+{
+public:
+    WallGeometry( GLuint vertexAttrib, GLuint normalAttrib, GLuint instanceAttrib );
+    ~WallGeometry();
+
+    WallGeometry( const WallGeometry& ) = delete;
+    WallGeometry& operator=( const WallGeometry& ) = delete;
+
+    /**
+     * @brief build Meshes the walls of map and uploads one buffer pair per
+     * non-empty chunk, replacing the previous walls.
+     */
+    void build( const mapManager& map, float cellSize );
+
+    void clear();
+    bool empty() const { return chunks.empty(); }
+
+    /**
+     * @brief draw Draws the chunks whose sphere is in frustum. The program
+     * must be bound with its uniforms set.
+     */
+    void draw( const Frustum& frustum );
+
+    /**
+     * @brief forEachWall Calls f( row, col ) for every wall of the chunks
+     * whose sphere is in frustum.
+     */
+    template < typename F >
+    void forEachWall( const Frustum& frustum, F f ) const {
+        for ( const WallChunk& chunk : chunks ) {
+            if ( not frustum.sphereVisible( chunk.center[0], chunk.center[1], chunk.center[2], chunk.radius ) ) continue;
+            for ( int cell : chunk.walls ) f( cell / nCols, cell % nCols );
+        }
+    }
+
+    /**
+     * @brief Stats of the walls built: triangles of the merged meshes, and
+     * of one box per wall with every face.
+     */
+    int triangles() const { return totalTriangles; }
+    int naiveTriangles() const { return boxTriangles; }
+    int numChunks() const { return chunks.size(); }
+
+    /**
+     * @brief Stats of the last draw.
+     */
+    int drawnTriangles() const { return drawn; }
+    int drawCalls() const { return calls; }
+
+private:
+    GLuint vertexAttrib, normalAttrib, instanceAttrib;
+
+    std::vector< WallChunk > chunks;
+    int nCols;
+
+    int totalTriangles, boxTriangles;
+    int drawn, calls;
+};
+
+#endif // WALLGEOMETRY_H